@@ -28,6 +28,7 @@
 #import <Accelerate/Accelerate.h>
 
 #include <VideoCore/rtmp/RTMPSession.h>
+#include <VideoCore/stream/BitrateController.h>
 #include <VideoCore/transforms/RTMP/AACPacketizer.h>
 #include <VideoCore/transforms/RTMP/H264Packetizer.h>
 #include <VideoCore/transforms/Split.h>
@@ -76,6 +77,7 @@ namespace videocore { namespace simpleApi {
 }
 
 static const int kMinVideoBitrate = 32000;
+static const float kProbeHeadroom = 0.75f; // fraction of the probed bandwidth used for the initial video bitrate
 
 @interface VCSimpleSession()
 {
@@ -101,6 +103,7 @@ static const int kMinVideoBitrate = 32000;
     std::shared_ptr<videocore::Apple::MP4Multiplexer> m_muxer;
 
     std::shared_ptr<videocore::IOutputSession> m_outputSession;
+    std::shared_ptr<videocore::BitrateController> m_bitrateController;
 
 
     // properties
@@ -687,9 +690,23 @@ static const int kMinVideoBitrate = 32000;
 
     _bpsCeiling = _bitrate;
 
-    if ( self.useAdaptiveBitrate ) {
-        _bitrate = 500000;
-    }
+    videocore::BitrateControllerConfig bitrateConfig;
+    bitrateConfig.minBitrate = kMinVideoBitrate;
+    bitrateConfig.maxBitrate = _bpsCeiling;
+    bitrateConfig.probeHeadroom = kProbeHeadroom;
+    m_bitrateController = std::make_shared<videocore::BitrateController>(bitrateConfig);
+
+    // With adaptive bitrate the encoder starts at the ceiling.  The burst of media sent while publishing starts
+    // is measured by the bandwidth probe, which then picks the real starting bitrate.
+    m_outputSession->setBandwidthProbeCallback([=](float measured, bool linkLimited)
+                                               {
+                                                   auto video = std::dynamic_pointer_cast<videocore::IEncoder>( bSelf->m_h264Encoder );
+                                                   if(video && bSelf.useAdaptiveBitrate) {
+                                                       auto decision = bSelf->m_bitrateController->probe(measured, linkLimited);
+                                                       video->setBitrate(decision.videoBitrate);
+                                                       NSLog(@"Bandwidth probe: %f (%d) VideoBR: %d", measured, linkLimited, video->bitrate());
+                                                   }
+                                               });
 
     m_outputSession->setBandwidthCallback([=](float vector, float predicted, int inst)
                                           {
@@ -746,17 +763,18 @@ static const int kMinVideoBitrate = 32000;
 //                                                      }
 
 
-                                                      if(videoBr > 1152000) {
-                                                          video->setBitrate(std::min(int((videoBr / 384000 + vector )) * 384000, bSelf->_bpsCeiling) );
-                                                      }
-                                                      else if( videoBr > 512000 ) {
-                                                          video->setBitrate(std::min(int((videoBr / 128000 + vector )) * 128000, bSelf->_bpsCeiling) );
-                                                      }
-                                                      else if( videoBr > 128000 ) {
-                                                          video->setBitrate(std::min(int((videoBr / 64000 + vector )) * 64000, bSelf->_bpsCeiling) );
-                                                      }
-                                                      else {
-                                                          video->setBitrate(std::max(std::min(int((videoBr / 32000 + vector )) * 32000, bSelf->_bpsCeiling), kMinVideoBitrate) );
+                                                      videocore::ThroughputResult result;
+                                                      result.vector = vector;
+                                                      result.targetBytesPerSecond = predicted;
+                                                      result.measuredBytesPerSecond = inst;
+                                                      result.confidence = 1.f;
+                                                      result.reason = videocore::kThroughputReasonNoData;
+
+                                                      // Step from what the encoder is running at; it may have clamped an earlier request.
+                                                      bSelf->m_bitrateController->applied(videoBr);
+                                                      auto decision = bSelf->m_bitrateController->update(result, std::chrono::steady_clock::now());
+                                                      if(decision.changed) {
+                                                          video->setBitrate(decision.videoBitrate);
                                                       }
                                                       NSLog(@"(%f) VideoBR: %d (%f)", vector, video->bitrate(), predicted);
                                                   } /* if(vector != 0) */
@@ -0,0 +1,79 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+#ifndef videocore_Bench_hpp
+#define videocore_Bench_hpp
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+namespace videocore { namespace bench {
+    
+    using Clock = std::chrono::steady_clock;
+    
+    inline double seconds(Clock::time_point from, Clock::time_point to)
+    {
+        return std::chrono::duration<double>(to - from).count();
+    }
+    
+    /*!
+     *  Call f repeatedly for at least minSeconds, after a short warm up, and return the mean time per call in
+     *  seconds.
+     */
+    template<typename F>
+    double timePerCall(F f, double minSeconds = 0.5)
+    {
+        for ( int i = 0 ; i < 16 ; ++i ) {
+            f();
+        }
+        size_t calls = 0;
+        size_t batch = 1;
+        const auto start = Clock::now();
+        double elapsed = 0.;
+        do {
+            for ( size_t i = 0 ; i < batch ; ++i ) {
+                f();
+            }
+            calls += batch;
+            batch *= 2;
+            elapsed = seconds(start, Clock::now());
+        } while(elapsed < minSeconds);
+        return elapsed / double(calls);
+    }
+    
+    /*! The p-th percentile, 0 to 1, of values.  Sorts values. */
+    inline double percentile(std::vector<double>& values, double p)
+    {
+        if(values.empty()) {
+            return 0.;
+        }
+        std::sort(values.begin(), values.end());
+        const size_t i = std::min(values.size() - 1, size_t(p * double(values.size())));
+        return values[i];
+    }
+}}
+
+#endif
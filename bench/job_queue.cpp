@@ -0,0 +1,216 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+
+/*
+ *  Enqueue latency and throughput of JobQueue.
+ *
+ *  Producer threads flood one queue with small lambdas, timing every 16th enqueue, and the run ends when the queue
+ *  has run every job.  JobQueue is compared with a mutex-protected std::queue of shared_ptr<Job> drained by a
+ *  thread of its own, which is how the queue worked before, and allocations are counted through operator new.
+ */
+
+#include <VideoCore/system/JobQueue.hpp>
+
+#include "Bench.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <queue>
+#include <thread>
+#include <vector>
+
+using namespace videocore;
+using namespace videocore::bench;
+
+namespace {
+    
+    std::atomic<int64_t> g_allocations(0);
+}
+
+void* operator new(size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if(!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+namespace {
+    
+    const int64_t kJobsPerProducer = 200000;
+    const int64_t kSampleEvery = 16;
+    
+    /*! The queue as it was: one thread, one lock, an allocation and a signal for every job. */
+    class LockedQueue
+    {
+    public:
+        LockedQueue() : m_exiting(false), m_thread([this]() { thread(); }) {}
+        ~LockedQueue() {
+            {
+                std::lock_guard<std::mutex> l(m_mutex);
+                m_exiting = true;
+            }
+            m_cond.notify_all();
+            m_thread.join();
+        }
+        template<typename F>
+        void enqueue(F&& job) {
+            auto j = std::make_shared<Job>(std::function<void()>(std::forward<F>(job)));
+            {
+                std::lock_guard<std::mutex> l(m_mutex);
+                m_jobs.push(j);
+            }
+            m_cond.notify_all();
+        }
+    private:
+        void thread() {
+            std::unique_lock<std::mutex> l(m_mutex);
+            while(!m_exiting) {
+                if(m_jobs.empty()) {
+                    m_cond.wait(l);
+                    continue;
+                }
+                auto j = m_jobs.front();
+                m_jobs.pop();
+                l.unlock();
+                (*j)();
+                l.lock();
+            }
+        }
+        std::mutex                          m_mutex;
+        std::condition_variable             m_cond;
+        std::queue<std::shared_ptr<Job>>    m_jobs;
+        bool                                m_exiting;
+        std::thread                         m_thread;
+    };
+    
+    struct Result {
+        double  jobsPerSecond;
+        double  p50, p99, p999;     /*!< Enqueue latency, ns */
+        double  allocationsPerJob;
+        bool    exact;
+    };
+    
+    template<typename Queue>
+    Result run(Queue& queue, int producers)
+    {
+        std::atomic<int64_t> ran(0);
+        std::atomic<int64_t> sum(0);
+        std::atomic<bool> go(false);
+        std::vector<std::vector<double>> latencies(producers);
+        std::vector<std::thread> threads;
+        
+        for ( int p = 0 ; p < producers ; ++p ) {
+            latencies[p].reserve(size_t(kJobsPerProducer / kSampleEvery + 1));
+            threads.emplace_back([&, p]() {
+                std::vector<double>& latency = latencies[p];
+                const int64_t a = p, b = 2, c = 3;
+                while(!go.load()) {
+                    std::this_thread::yield();
+                }
+                for ( int64_t i = 0 ; i < kJobsPerProducer ; ++i ) {
+                    // Three captures, about what a session's jobs carry.
+                    auto job = [&ran, &sum, a, b, c]() {
+                        sum.fetch_add(a + b * c, std::memory_order_relaxed);
+                        ran.fetch_add(1, std::memory_order_relaxed);
+                    };
+                    if(i % kSampleEvery == 0) {
+                        const auto start = Clock::now();
+                        queue.enqueue(job);
+                        latency.push_back(seconds(start, Clock::now()) * 1.0e9);
+                    } else {
+                        queue.enqueue(job);
+                    }
+                }
+            });
+        }
+        
+        const int64_t total = kJobsPerProducer * producers;
+        const int64_t allocations = g_allocations.load();
+        const auto start = Clock::now();
+        go = true;
+        for ( auto & t : threads ) {
+            t.join();
+        }
+        while(ran.load() < total) {
+            std::this_thread::yield();
+        }
+        const double elapsed = seconds(start, Clock::now());
+        const int64_t allocated = g_allocations.load() - allocations;
+        
+        std::vector<double> all;
+        for ( auto & l : latencies ) {
+            all.insert(all.end(), l.begin(), l.end());
+        }
+        Result r;
+        r.jobsPerSecond = double(total) / elapsed;
+        r.p50 = percentile(all, 0.5);
+        r.p99 = percentile(all, 0.99);
+        r.p999 = percentile(all, 0.999);
+        r.allocationsPerJob = double(allocated) / double(total);
+        int64_t expected = 0;
+        for ( int p = 0 ; p < producers ; ++p ) {
+            expected += kJobsPerProducer * (p + 6);
+        }
+        r.exact = ran.load() == total && sum.load() == expected;
+        return r;
+    }
+    
+    void print(const char* name, int producers, const Result& r)
+    {
+        printf("%-10s %9d   %8.2f   %8.0f %8.0f %9.0f   %10.2f%s\n", name, producers, r.jobsPerSecond / 1.0e6,
+               r.p50, r.p99, r.p999, r.allocationsPerJob, r.exact ? "" : "  BAD");
+    }
+}
+
+int main()
+{
+    const int producerCounts[] = { 1, 2, 4, 8 };
+    
+    printf("%u hardware threads, %lld jobs per producer, latency in ns\n\n", std::thread::hardware_concurrency(), (long long)kJobsPerProducer);
+    printf("queue      producers   Mjobs/s        p50      p99     p99.9   allocs/job\n");
+    for ( int producers : producerCounts ) {
+        {
+            JobQueue queue("bench");
+            print("JobQueue", producers, run(queue, producers));
+        }
+        {
+            LockedQueue queue;
+            print("locked", producers, run(queue, producers));
+        }
+    }
+    printf("\nBAD marks a run that lost or repeated a job.\n");
+    return 0;
+}
@@ -0,0 +1,86 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+
+/*
+ *  Samples per second, on one core, of the mix bus kernels in system/audio/MixKernels.
+ *
+ *  The Makefile builds this three times: as shipped (AVX2 picked at runtime on x86), with VC_MIX_NO_AVX2 (SSE2 on
+ *  x86, NEON on ARM) and with VC_MIX_SCALAR (no SIMD), so the rows of the three runs compare directly.
+ */
+
+#include <VideoCore/system/audio/MixKernels.h>
+
+#include "Bench.hpp"
+
+#include <vector>
+
+using namespace videocore;
+using namespace videocore::bench;
+
+#if defined(VC_MIX_SCALAR)
+static const char* kKernels = "scalar";
+#elif defined(VC_MIX_NO_AVX2)
+static const char* kKernels = "SSE2 / NEON";
+#else
+static const char* kKernels = "as shipped (AVX2 when the CPU has it)";
+#endif
+
+namespace {
+    
+    const size_t kFrames = 1024;    // one mix window
+    const int    kChannels = 2;
+    const size_t kSamples = kFrames * kChannels;
+    
+    template<typename F>
+    void row(const char* name, F f)
+    {
+        const double t = timePerCall(f);
+        printf("  %-34s %8.0f Msamples/s\n", name, double(kSamples) / t / 1.0e6);
+    }
+}
+
+int main()
+{
+    std::vector<int16_t> s16(kSamples);
+    std::vector<float>   f32(kSamples);
+    std::vector<float>   bus(kSamples, 0.f);
+    for ( size_t i = 0 ; i < kSamples ; ++i ) {
+        s16[i] = int16_t((i * 7919) & 0xFFFF);
+        f32[i] = float(int(i % 2001) - 1000) * 1.0e-3f;
+    }
+    uint32_t dither[4] = { 0x9E3779B9, 0x7F4A7C15, 0x85EBCA6B, 0xC2B2AE35 };
+    volatile float sink = 0.f;
+    
+    printf("Mix kernels: %s, %zu stereo frames per call\n", kKernels, kFrames);
+    
+    row("accumulateSamples int16", [&]() { accumulateSamples(bus.data(), s16.data(), kSamples, 0.5f); });
+    row("accumulateSamples float", [&]() { accumulateSamples(bus.data(), f32.data(), kSamples, 0.5f); });
+    row("accumulateRamp", [&]() { accumulateRamp(bus.data(), f32.data(), kFrames, kChannels, 0.5f, 1.0e-6f); });
+    row("scaleRamp", [&]() { scaleRamp(bus.data(), kFrames, kChannels, 1.f, 0.f); });
+    row("addTriangularDither", [&]() { addTriangularDither(bus.data(), kSamples, dither, 1.0e-9f); });
+    row("peakLevel", [&]() { sink = sink + peakLevel(f32.data(), kSamples); });
+    row("dotProduct", [&]() { sink = sink + dotProduct(f32.data(), bus.data(), kSamples); });
+    return 0;
+}
@@ -0,0 +1,145 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+
+/*
+ *  THD+N and throughput of the polyphase resampler in system/audio/Resampler, for each quality preset.
+ *
+ *  THD+N is measured on a -6 dBFS sine: the output is least-squares fitted with a sine of the expected frequency,
+ *  so the filter delay does not matter, and the residual over the whole band (harmonics, aliases, imaging and
+ *  noise) is reported relative to the fitted tone.  The first and last quarter of the output are left out so
+ *  that the filter start up is not counted.
+ */
+
+#include <VideoCore/system/audio/Resampler.h>
+
+#include "Bench.hpp"
+
+#include <cmath>
+#include <vector>
+
+using namespace videocore;
+using namespace videocore::bench;
+
+namespace {
+    
+    const int    kChannels = 2;
+    const size_t kChunkFrames = 1024;
+    
+    struct Conversion { int in; int out; double tone; };
+    
+    /*! Convert a sine in kChunkFrames buffers and return THD+N in dB. */
+    double thdn(const Conversion& c, ResamplerQuality_t quality)
+    {
+        Resampler r(c.in, c.out, kChannels, quality);
+        
+        const size_t inFrames = size_t(c.in) * 2;
+        std::vector<float> in(inFrames * kChannels);
+        for ( size_t i = 0 ; i < inFrames ; ++i ) {
+            const float v = 0.5f * float(std::sin(2. * M_PI * c.tone * double(i) / c.in));
+            for ( int ch = 0 ; ch < kChannels ; ++ch ) {
+                in[i * kChannels + ch] = v;
+            }
+        }
+        
+        std::vector<float> out;
+        std::vector<float> chunk(r.maxOutputFrames(kChunkFrames) * kChannels);
+        for ( size_t i = 0 ; i < inFrames ; i += kChunkFrames ) {
+            const size_t n = std::min(kChunkFrames, inFrames - i);
+            const size_t m = r.process(&in[i * kChannels], n, chunk.data(), chunk.size() / kChannels);
+            out.insert(out.end(), chunk.begin(), chunk.begin() + m * kChannels);
+        }
+        
+        // Fit a * sin + b * cos at the tone frequency to the left channel.
+        const size_t frames = out.size() / kChannels;
+        const size_t first = frames / 4;
+        const size_t last = frames * 3 / 4;
+        double ss = 0., cc = 0., sc = 0., ys = 0., yc = 0.;
+        for ( size_t j = first ; j < last ; ++j ) {
+            const double w = 2. * M_PI * c.tone * double(j) / c.out;
+            const double s = std::sin(w), k = std::cos(w), y = out[j * kChannels];
+            ss += s * s; cc += k * k; sc += s * k; ys += y * s; yc += y * k;
+        }
+        const double det = ss * cc - sc * sc;
+        const double a = (ys * cc - yc * sc) / det;
+        const double b = (yc * ss - ys * sc) / det;
+        
+        double signal = 0., residual = 0.;
+        for ( size_t j = first ; j < last ; ++j ) {
+            const double w = 2. * M_PI * c.tone * double(j) / c.out;
+            const double fit = a * std::sin(w) + b * std::cos(w);
+            const double e = out[j * kChannels] - fit;
+            signal += fit * fit;
+            residual += e * e;
+        }
+        return 10. * std::log10(residual / signal);
+    }
+    
+    /*! Stereo frames converted per second, as a multiple of realtime. */
+    double realtime(const Conversion& c, ResamplerQuality_t quality)
+    {
+        Resampler r(c.in, c.out, kChannels, quality);
+        std::vector<float> in(kChunkFrames * kChannels);
+        for ( size_t i = 0 ; i < in.size() ; ++i ) {
+            in[i] = float(std::sin(double(i) * 0.01));
+        }
+        std::vector<float> out(r.maxOutputFrames(kChunkFrames) * kChannels);
+        const double t = timePerCall([&]() { r.process(in.data(), kChunkFrames, out.data(), out.size() / kChannels); });
+        return double(kChunkFrames) / t / c.in;
+    }
+}
+
+int main()
+{
+    const Conversion conversions[] = {
+        { 44100, 48000, 1000. }, { 44100, 48000, 10000. },
+        { 48000, 44100, 1000. }, { 48000, 44100, 10000. },
+        { 16000, 44100, 1000. },
+        { 44100, 44101, 1000. },     // no small reduced ratio: interpolated phases
+    };
+    
+    printf("THD+N in dB, -6 dBFS sine, stereo, %zu frame buffers\n\n", kChunkFrames);
+    printf("  conversion             tone       low    medium      high\n");
+    for ( auto & c : conversions ) {
+        printf("  %5d -> %5d Hz   %6.0f Hz", c.in, c.out, c.tone);
+        for ( int q = kResamplerQualityLow ; q <= kResamplerQualityHigh ; ++q ) {
+            printf("  %8.1f", thdn(c, ResamplerQuality_t(q)));
+        }
+        printf("\n");
+    }
+    
+    printf("\nThroughput, stereo on one core, multiple of realtime\n\n");
+    printf("  conversion                     low    medium      high\n");
+    for ( auto & c : conversions ) {
+        if(c.tone != 1000.) {
+            continue;
+        }
+        printf("  %5d -> %5d Hz         ", c.in, c.out);
+        for ( int q = kResamplerQualityLow ; q <= kResamplerQualityHigh ; ++q ) {
+            printf("  %8.0f", realtime(c, ResamplerQuality_t(q)));
+        }
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,141 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+
+/*
+ *  Every conversion in system/audio/SampleFormat: each format to and from float, interleaved and planar, timed on
+ *  one core over 1024 stereo frames.  The interleaved conversions are also compared with a plain per-sample loop,
+ *  which they must match bit for bit, including the saturation of out of range input.
+ */
+
+#include <VideoCore/system/audio/SampleFormat.h>
+
+#include "Bench.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+using namespace videocore;
+using namespace videocore::bench;
+
+namespace {
+    
+    const size_t kFrames = 1024;
+    const size_t kChannels = 2;
+    const size_t kSamples = kFrames * kChannels;
+    
+    int64_t integerAt(const uint8_t* p, SampleFormat_t format)
+    {
+        switch(format) {
+            case kSampleFormatS8:  return *(const int8_t*)p;
+            case kSampleFormatS16: { int16_t v; memcpy(&v, p, 2); return v; }
+            case kSampleFormatS24: {
+                int32_t v = 0;
+                memcpy(&v, p, 3);           // native (little endian) order
+                return (v << 8) >> 8;
+            }
+            case kSampleFormatS32: { int32_t v; memcpy(&v, p, 4); return v; }
+            default: return 0;
+        }
+    }
+    
+    /*! The plain loop: one sample at a time. */
+    void referenceToFloat(float* dst, const uint8_t* src, SampleFormat_t format, size_t count)
+    {
+        const size_t bytes = bytesPerSample(format);
+        if(format == kSampleFormatF32) {
+            memcpy(dst, src, count * sizeof(float));
+            return;
+        }
+        const float scale = 1.f / float(int64_t(1) << (bytes * 8 - 1));
+        for ( size_t i = 0 ; i < count ; ++i ) {
+            dst[i] = float(integerAt(src + i * bytes, format)) * scale;
+        }
+    }
+    void referenceFromFloat(uint8_t* dst, const float* src, SampleFormat_t format, size_t count)
+    {
+        const size_t bytes = bytesPerSample(format);
+        if(format == kSampleFormatF32) {
+            memcpy(dst, src, count * sizeof(float));
+            return;
+        }
+        const double full = double(int64_t(1) << (bytes * 8 - 1));
+        for ( size_t i = 0 ; i < count ; ++i ) {
+            const double v = std::max(-full, std::min(full - 1., std::nearbyint(double(src[i]) * full)));
+            const int32_t s = int32_t(v);
+            memcpy(dst + i * bytes, &s, bytes);     // the low bytes, in little endian order
+        }
+    }
+    
+    double nanoseconds(double seconds) { return seconds * 1.0e9; }
+}
+
+int main()
+{
+    const SampleFormat_t formats[] = { kSampleFormatS8, kSampleFormatS16, kSampleFormatS24, kSampleFormatS32, kSampleFormatF32 };
+    const char* names[] = { "s8", "s16", "s24", "s32", "f32" };
+    
+    // Mostly in range, with some samples well past full scale to exercise saturation.
+    std::vector<float> source(kSamples);
+    for ( size_t i = 0 ; i < kSamples ; ++i ) {
+        source[i] = float(std::sin(double(i) * 0.37)) * ((i % 97) == 0 ? 3.f : 0.99f);
+    }
+    
+    printf("ns per %zu stereo frames, one core; x = speedup over the plain loop\n\n", kFrames);
+    printf("  fmt    to float          from float        to float planar   from float planar   exact\n");
+    
+    for ( size_t f = 0 ; f < sizeof(formats) / sizeof(formats[0]) ; ++f ) {
+        const SampleFormat_t format = formats[f];
+        const size_t bytes = bytesPerSample(format);
+        std::vector<uint8_t> packed(kSamples * bytes);
+        std::vector<uint8_t> reference(kSamples * bytes);
+        std::vector<float>   floats(kSamples);
+        std::vector<float>   referenceFloats(kSamples);
+        std::vector<uint8_t> planeStorage(kSamples * bytes);
+        void* planes[kChannels] = { planeStorage.data(), planeStorage.data() + kFrames * bytes };
+        const void* constPlanes[kChannels] = { planes[0], planes[1] };
+        
+        // Correctness against the plain loop, both ways.
+        convertFromFloat(packed.data(), source.data(), format, kSamples);
+        referenceFromFloat(reference.data(), source.data(), format, kSamples);
+        bool exact = packed == reference;
+        convertToFloat(floats.data(), packed.data(), format, kSamples);
+        referenceToFloat(referenceFloats.data(), packed.data(), format, kSamples);
+        exact = exact && memcmp(floats.data(), referenceFloats.data(), kSamples * sizeof(float)) == 0;
+        
+        const double toFloat    = timePerCall([&]() { convertToFloat(floats.data(), packed.data(), format, kSamples); });
+        const double fromFloat  = timePerCall([&]() { convertFromFloat(packed.data(), source.data(), format, kSamples); });
+        const double toPlanar   = timePerCall([&]() { convertToFloat(floats.data(), constPlanes, format, kFrames, kChannels); });
+        const double fromPlanar = timePerCall([&]() { convertFromFloat(planes, source.data(), format, kFrames, kChannels); });
+        const double refTo      = timePerCall([&]() { referenceToFloat(floats.data(), packed.data(), format, kSamples); });
+        const double refFrom    = timePerCall([&]() { referenceFromFloat(reference.data(), source.data(), format, kSamples); });
+        
+        printf("  %-4s %7.0f (%5.1fx)  %7.0f (%5.1fx)  %9.0f          %9.0f          %s\n", names[f],
+               nanoseconds(toFloat), refTo / toFloat, nanoseconds(fromFloat), refFrom / fromFloat,
+               nanoseconds(toPlanar), nanoseconds(fromPlanar), exact ? "yes" : "NO");
+    }
+    return 0;
+}
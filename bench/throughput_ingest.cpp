@@ -0,0 +1,159 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+
+/*
+ *  Contention microbenchmark for the throughput sample ingest path (TCPThroughputAdaptation::add*Sample).
+ *
+ *  Writer threads add samples as fast as they can while a collector summarises them once a millisecond, the way
+ *  the sampling job does once per interval.  IntervalAccumulator is compared with a mutex-protected vector, which
+ *  is how samples were ingested before, and every run checks that no sample was lost or counted twice.
+ */
+
+#include <VideoCore/stream/IntervalAccumulator.hpp>
+#include <VideoCore/stream/TCPThroughputAdaptation.h>
+
+#include "Bench.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace videocore;
+using namespace videocore::bench;
+
+namespace {
+    
+    const int64_t kSamplesPerWriter = 2000000;
+    
+    /*! The ingest path as it was: every sample is pushed into a vector under a lock. */
+    class LockedSamples
+    {
+    public:
+        void add(int64_t value) {
+            std::lock_guard<std::mutex> l(m_mutex);
+            m_samples.push_back(value);
+        }
+        IntervalSummary<int64_t> collect() {
+            std::vector<int64_t> samples;
+            {
+                std::lock_guard<std::mutex> l(m_mutex);
+                samples.swap(m_samples);
+            }
+            IntervalSummary<int64_t> s = { 0, 0, 0, 0, int64_t(samples.size()) };
+            for ( auto v : samples ) {
+                s.sum += v;
+            }
+            return s;
+        }
+    private:
+        std::mutex           m_mutex;
+        std::vector<int64_t> m_samples;
+    };
+    
+    struct Result {
+        double  samplesPerSecond;
+        bool    exact;
+    };
+    
+    template<typename Sink>
+    Result run(Sink& sink, int writers)
+    {
+        std::atomic<bool> done(false);
+        int64_t count = 0;
+        int64_t sum = 0;
+        
+        std::thread collector([&]() {
+            while(!done.load()) {
+                const auto s = sink.collect();
+                count += s.count;
+                sum += s.sum;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        });
+        
+        const auto start = Clock::now();
+        std::vector<std::thread> threads;
+        for ( int w = 0 ; w < writers ; ++w ) {
+            threads.emplace_back([&sink]() {
+                for ( int64_t i = 0 ; i < kSamplesPerWriter ; ++i ) {
+                    sink.add(1 + (i & 1023));
+                }
+            });
+        }
+        for ( auto & t : threads ) {
+            t.join();
+        }
+        const double elapsed = seconds(start, Clock::now());
+        done = true;
+        collector.join();
+        
+        const auto s = sink.collect();
+        count += s.count;
+        sum += s.sum;
+        
+        int64_t expected = 0;
+        for ( int64_t i = 0 ; i < kSamplesPerWriter ; ++i ) {
+            expected += 1 + (i & 1023);
+        }
+        return { double(kSamplesPerWriter) * writers / elapsed,
+                 count == kSamplesPerWriter * writers && sum == expected * writers };
+    }
+    
+    /*! The three samples RTMPSession adds for every chunk it writes, through the public interface. */
+    struct AdaptationSink {
+        TCPThroughputAdaptation adaptation;
+        IntervalSummary<int64_t> collect() { return { 0, 0, 0, 0, 0 }; }
+        void add(int64_t value) {
+            adaptation.addBufferSizeSample(size_t(value));
+            adaptation.addSentBytesSample(size_t(value));
+            adaptation.addBufferDurationSample(value & 63);
+        }
+    };
+}
+
+int main()
+{
+    const int writerCounts[] = { 1, 2, 4, 8 };
+    
+    printf("%u hardware threads, %lld samples per writer\n\n", std::thread::hardware_concurrency(), (long long)kSamplesPerWriter);
+    printf("writers   accumulator Msamples/s   locked vector Msamples/s   adaptation Mchunks/s\n");
+    for ( int writers : writerCounts ) {
+        IntervalAccumulator<int64_t> accumulator;
+        LockedSamples locked;
+        AdaptationSink adaptation;
+        
+        const Result a = run(accumulator, writers);
+        const Result l = run(locked, writers);
+        const Result t = run(adaptation, writers);
+        
+        printf("%7d   %15.1f%s   %19.1f%s   %18.1f\n", writers,
+               a.samplesPerSecond / 1.0e6, a.exact ? "    " : " BAD",
+               l.samplesPerSecond / 1.0e6, l.exact ? "    " : " BAD",
+               t.samplesPerSecond / 1.0e6);
+    }
+    printf("\nBAD marks a run that lost or double counted a sample.\n");
+    return 0;
+}
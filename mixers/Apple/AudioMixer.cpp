@@ -56,10 +56,29 @@ namespace videocore { namespace Apple {
             AudioConverterDispose(it.second.converter);
         }
     }
-    std::shared_ptr<Buffer>
+    void
+    AudioMixer::unregisterSource(std::shared_ptr<ISource> source)
+    {
+        GenericAudioMixer::unregisterSource(source);
+        
+        const auto hash = std::hash<std::shared_ptr<ISource>>()(source);
+        
+        std::unique_lock<std::mutex> l(m_converterMutex);
+        for ( auto it = m_converters.begin() ; it != m_converters.end() ; ) {
+            if(it->first.first == hash) {
+                AudioConverterDispose(it->second.converter);
+                it = m_converters.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    void
     AudioMixer::resample(const uint8_t* const buffer,
                          size_t size,
-                         AudioBufferMetadata& metadata)
+                         AudioBufferMetadata& metadata,
+                         MixSource& source,
+                         std::vector<float>& out)
     {
         const auto inFrequncyInHz = metadata.getData<kAudioMetadataFrequencyInHz>();
         const auto inBitsPerChannel = metadata.getData<kAudioMetadataBitsPerChannel>();
@@ -69,25 +88,18 @@ namespace videocore { namespace Apple {
         const auto inNumberFrames = metadata.getData<kAudioMetadataNumberFrames>();
         const auto inUsesOSStruct = metadata.getData<kAudioMetadataUsesOSStruct>();
         
-        if(m_outFrequencyInHz == inFrequncyInHz &&
-           m_outBitsPerChannel == inBitsPerChannel &&
-           m_outChannelCount == inChannelCount
-           && !(inFlags & kAudioFormatFlagIsNonInterleaved)
-           && !(inFlags & kAudioFormatFlagIsFloat))
-        {
-            // No resampling necessary
-            return std::make_shared<Buffer>();
-        }
-        
-        uint64_t hash = uint64_t(inBytesPerFrame&0xFF) << 56 | uint64_t(inFlags&0xFF) << 48 | uint64_t(inChannelCount&0xFF) << 40
+        uint64_t format = uint64_t(inBytesPerFrame&0xFF) << 56 | uint64_t(inFlags&0xFF) << 48 | uint64_t(inChannelCount&0xFF) << 40
                         | uint64_t(inBitsPerChannel&0xFF) << 32 | inFrequncyInHz;
+        auto hash = std::make_pair(std::hash<std::shared_ptr<ISource>>()(metadata.getData<kAudioMetadataSource>().lock()), format);
+        
+        std::unique_lock<std::mutex> l(m_converterMutex);
         
         auto it = m_converters.find(hash) ;
         ConverterInst converter = {0};
         
         if(it == m_converters.end()) {
             AudioStreamBasicDescription in = {0};
-            AudioStreamBasicDescription out = {0};
+            AudioStreamBasicDescription outFormat = {0};
             
             in.mFormatID = kAudioFormatLinearPCM;
             in.mFormatFlags =  inFlags;
@@ -98,19 +110,19 @@ namespace videocore { namespace Apple {
             in.mFramesPerPacket = 1;
             in.mBytesPerPacket = in.mBytesPerFrame * in.mFramesPerPacket;
             
-            out.mFormatID = kAudioFormatLinearPCM;
-            out.mFormatFlags =  kAudioFormatFlagIsSignedInteger | kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsPacked;
-            out.mChannelsPerFrame = m_outChannelCount;
-            out.mSampleRate = m_outFrequencyInHz;
-            out.mBitsPerChannel = m_outBitsPerChannel;
-            out.mBytesPerFrame = (out.mBitsPerChannel * out.mChannelsPerFrame) / 8;
-            out.mFramesPerPacket = 1;
-            out.mBytesPerPacket = out.mBytesPerFrame * out.mFramesPerPacket;
+            outFormat.mFormatID = kAudioFormatLinearPCM;
+            outFormat.mFormatFlags =  kAudioFormatFlagIsFloat | kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsPacked;
+            outFormat.mChannelsPerFrame = inChannelCount;
+            outFormat.mSampleRate = m_outFrequencyInHz;
+            outFormat.mBitsPerChannel = 32;
+            outFormat.mBytesPerFrame = (outFormat.mBitsPerChannel * outFormat.mChannelsPerFrame) / 8;
+            outFormat.mFramesPerPacket = 1;
+            outFormat.mBytesPerPacket = outFormat.mBytesPerFrame * outFormat.mFramesPerPacket;
             
             converter.asbdIn = in;
-            converter.asbdOut = out;
+            converter.asbdOut = outFormat;
             
-            OSStatus ret = AudioConverterNew(&in, &out, &converter.converter);
+            OSStatus ret = AudioConverterNew(&in, &outFormat, &converter.converter);
             
             AudioConverterSetProperty(converter.converter,
                                       kAudioConverterSampleRateConverterComplexity,
@@ -138,39 +150,40 @@ namespace videocore { namespace Apple {
         } else {
             converter = it->second;
         }
+        l.unlock();
         
         auto & in = converter.asbdIn;
-        auto & out = converter.asbdOut;
+        auto & outFormat = converter.asbdOut;
 
         const double inSampleCount = inNumberFrames;
         const double ratio = static_cast<double>(inFrequncyInHz) / static_cast<double>(m_outFrequencyInHz);
         
         const double outBufferSampleCount = std::round(double(inSampleCount) / ratio);
         
-        const size_t outBufferSize = out.mBytesPerPacket * outBufferSampleCount;
-        const auto outBuffer = std::make_shared<Buffer>(outBufferSize);
+        const size_t outBufferSize = outFormat.mBytesPerPacket * outBufferSampleCount;
+        out.resize(outBufferSize / sizeof(float));
         
         
-        std::unique_ptr<UserData> ud(new UserData());
-        ud->size = static_cast<int>(size);
-        ud->data = const_cast<uint8_t*>(buffer);
-        ud->p = inUsesOSStruct ? 0 : ud->data;
-        ud->packetSize = in.mBytesPerPacket;
-        ud->numberPackets = inSampleCount;
-        ud->numChannels = inChannelCount;
-        ud->isInterleaved = !(inFlags & kAudioFormatFlagIsNonInterleaved);
-        ud->usesOSStruct = inUsesOSStruct;
+        UserData ud = {0};
+        ud.size = static_cast<int>(size);
+        ud.data = const_cast<uint8_t*>(buffer);
+        ud.p = inUsesOSStruct ? 0 : ud.data;
+        ud.packetSize = in.mBytesPerPacket;
+        ud.numberPackets = inSampleCount;
+        ud.numChannels = inChannelCount;
+        ud.isInterleaved = !(inFlags & kAudioFormatFlagIsNonInterleaved);
+        ud.usesOSStruct = inUsesOSStruct;
         
         AudioBufferList outBufferList;
         outBufferList.mNumberBuffers = 1;
         outBufferList.mBuffers[0].mDataByteSize = static_cast<UInt32>(outBufferSize);
-        outBufferList.mBuffers[0].mNumberChannels = m_outChannelCount;
-        outBufferList.mBuffers[0].mData = (*outBuffer)();
+        outBufferList.mBuffers[0].mNumberChannels = inChannelCount;
+        outBufferList.mBuffers[0].mData = out.data();
         
         UInt32 sampleCount = outBufferSampleCount;
         OSStatus ret = AudioConverterFillComplexBuffer(converter.converter, /* AudioConverterRef inAudioConverter */
                                         AudioMixer::ioProc, /* AudioConverterComplexInputDataProc inInputDataProc */
-                                        ud.get(), /* void *inInputDataProcUserData */
+                                        &ud, /* void *inInputDataProcUserData */
                                         &sampleCount, /* UInt32 *ioOutputDataPacketSize */
                                         &outBufferList, /* AudioBufferList *outOutputData */
                                         NULL /* AudioStreamPacketDescription *outPacketDescription */
@@ -179,8 +192,20 @@ namespace videocore { namespace Apple {
             DLog("ret = %d (%x)", (int)ret, (unsigned)ret);
         }
       
-        outBuffer->setSize(outBufferList.mBuffers[0].mDataByteSize);
-        return outBuffer;
+        out.resize(outBufferList.mBuffers[0].mDataByteSize / sizeof(float));
+    }
+    bool
+    AudioMixer::skipResample(size_t size,
+                             AudioBufferMetadata& metadata,
+                             MixSource& source,
+                             size_t& frames)
+    {
+        const auto inFrequncyInHz = metadata.getData<kAudioMetadataFrequencyInHz>();
+        const auto inNumberFrames = metadata.getData<kAudioMetadataNumberFrames>();
+        
+        const double ratio = static_cast<double>(inFrequncyInHz) / static_cast<double>(m_outFrequencyInHz);
+        frames = size_t(std::round(double(inNumberFrames) / ratio));
+        return true;
     }
     //http://stackoverflow.com/questions/6610958/os-x-ios-sample-rate-conversion-for-a-buffer-using-audioconverterfillcomplex
     OSStatus
@@ -29,7 +29,8 @@
 #include <iostream>
 #include <VideoCore/mixers/GenericAudioMixer.h>
 #include <AudioToolbox/AudioToolbox.h>
-#include <unordered_map>
+#include <map>
+#include <mutex>
 
 namespace videocore { namespace Apple {
     /*
@@ -57,6 +58,9 @@ namespace videocore { namespace Apple {
         /*! Destructor */
         ~AudioMixer();
         
+        /*! IMixer::unregisterSource */
+        void unregisterSource(std::shared_ptr<ISource> source);
+        
     protected:
         
         /*!
@@ -66,12 +70,24 @@ namespace videocore { namespace Apple {
          * \param buffer    The input samples
          * \param size      The buffer size in bytes
          * \param metadata  The associated AudioBufferMetadata that specifies the properties of this buffer.
-         *
-         * \return An audio buffer that has been resampled to match the output properties of the mixer.
+         * \param source    State of the source that sent the buffer.
+         * \param out       Receives interleaved float samples at the output sampling rate of the mixer, with the channel
+         *                  count of the buffer.
+         */
+        void resample(const uint8_t* const buffer,
+                      size_t size,
+                      AudioBufferMetadata& metadata,
+                      MixSource& source,
+                      std::vector<float>& out);
+        
+        /*!
+         *  Stands for a silent buffer with the number of frames resample would ask the converter for.  The
+         *  converter only ever saw silence from the buffer before, so its history is silent already.
          */
-        std::shared_ptr<Buffer> resample(const uint8_t* const buffer,
-                                         size_t size,
-                                         AudioBufferMetadata& metadata);
+        bool skipResample(size_t size,
+                          AudioBufferMetadata& metadata,
+                          MixSource& source,
+                          size_t& frames);
 
     private:
         /*! Used by AudioConverterFillComplexBuffer. Do not call manually. */
@@ -85,7 +101,9 @@ namespace videocore { namespace Apple {
         
         using ConverterInst = struct { AudioStreamBasicDescription asbdIn, asbdOut; AudioConverterRef converter; };
         
-        std::unordered_map<uint64_t, ConverterInst> m_converters;
+        /*! One converter per source and input format, so each source keeps its own filter state. */
+        std::map<std::pair<std::size_t, uint64_t>, ConverterInst> m_converters;
+        std::mutex m_converterMutex;
         
         
     };
@@ -23,97 +23,101 @@
 
  */
 #include <VideoCore/mixers/GenericAudioMixer.h>
+#include <VideoCore/system/audio/MixKernels.h>
+#include <VideoCore/system/audio/SampleFormat.h>
+#include <algorithm>
+#include <cmath>
 #include <sstream>
 #include <vector>
 #include <stdint.h>
 
 
-#ifndef INT16_MAX
-#define INT16_MAX 0x7FFF
-#endif
-#ifndef INT16_MIN
-#define INT16_MIN ~INT16_MAX
-#endif
-
-static inline int16_t b8_to_b16(void* v) {
-    int16_t val = *(int8_t*)v;
-    return val * 0xFF;
-}
-static inline int16_t b16_to_b16(void*  v) {
-    return *(int16_t*)v;
-}
-
-static inline int16_t b32_to_b16(void*  v) {
-    int16_t val = (*(int32_t*)v / 0xFFFF);
-    return val;
-}
-static inline int16_t b24_to_b16(void* v) {
-
-    static const int m = 1U << 23;
-
-    uint8_t* p = (uint8_t*)v;
-
-    union {
-        int32_t x;
-        uint8_t in[4];
-    };
-    in[0] = p[0];
-    in[1] = p[1];
-    in[2] = p[2];
-    in[3] = 0;
-
-    int32_t r =  (x ^ m) - m;
-
-    return b32_to_b16(&r);
-
-}
 extern std::string g_tmpFolder;
 
+// kAudioMetadataFlags bits, as CoreAudio's kAudioFormatFlagIsFloat and kAudioFormatFlagIsNonInterleaved
+static const int kAudioFlagIsFloat = 1 << 0;
+static const int kAudioFlagIsNonInterleaved = 1 << 5;
+static const int kMaxPlanes = 32;
+
 static const int kMixWindowCount = 100;
+static const int kMixSourceWindows = 8;     // minimum capacity of each source's ring, in mix windows
+static const size_t kMaxMixSources = 64;
+static const float kGainRampDuration = 0.01f;   // seconds for the gain of a source to go from 0 to 1
+
+static const double kDriftPhaseTime = 5.;       // seconds to pull a source's timeline back onto its arrival times
+static const double kMaxDriftAdjust = 0.005;
 //static const int kWindowBufferCount = 0;
 
 static const float kE = 2.7182818284590f;
 
 namespace videocore {
 
-    inline int16_t TPMixSamples(int16_t a, int16_t b) {
-        return
-        // If both samples are negative, mixed signal must have an amplitude between the lesser of A and B, and the minimum permissible negative amplitude
-        a < 0 && b < 0 ?
-        ((int)a + (int)b) - (((int)a * (int)b)/INT16_MIN) :
-        
-        // If both samples are positive, mixed signal must have an amplitude between the greater of A and B, and the maximum permissible positive amplitude
-        ( a > 0 && b > 0 ?
-         ((int)a + (int)b) - (((int)a * (int)b)/INT16_MAX)
-         
-         // If samples are on opposite sides of the 0-crossing, mixed signal should reflect that samples cancel each other out somewhat
-         :
-         a + b);
-    }
-    
     GenericAudioMixer::GenericAudioMixer(int outChannelCount,
                                          int outFrequencyInHz,
                                          int outBitsPerChannel,
                                          double frameDuration)
     :
-    m_bufferDuration(frameDuration),
+    m_outgoingWindow(nullptr),
+    m_limiter(outFrequencyInHz),
+    m_meteringInterval(0.1),
+    m_epoch(std::chrono::steady_clock::now()),
     m_frameDuration(frameDuration),
+    m_bufferDuration(frameDuration),
+    m_mixQueue("com.videocore.audiomixer", kJobQueuePriorityHigh),
+    m_mixTimer(0),
+    m_mixWindowIndex(0),
+    m_emittedFrames(0),
+    m_sources(std::make_shared<SourceTable>()),
+    m_resamplerQuality(kResamplerQualityMedium),
+    m_driftCompensation(true),
+    m_outLayout(ChannelLayout::defaultForChannelCount(outChannelCount)),
     m_outChannelCount(outChannelCount),
     m_outFrequencyInHz(outFrequencyInHz),
     m_outBitsPerChannel(outBitsPerChannel),
     m_exiting(false),
-    m_mixQueue("com.videocore.audiomix", kJobQueuePriorityHigh),
-    m_outgoingWindow(nullptr),
-    m_catchingUp(false),
-    m_epoch(std::chrono::steady_clock::now())
+    m_started(false),
+    m_pullMode(false),
+    m_pulling(false),
+    m_pulledFrames(0)
+    {
+        // Lined up on a cache line by hand: operator new only promises the alignment of the fundamental types.
+        size_t space = sizeof(MixSlot) * kMaxMixSources + alignof(MixSlot);
+        m_slotStorage.reset(new uint8_t[space]);
+        void* p = m_slotStorage.get();
+        m_slots = static_cast<MixSlot*>(std::align(alignof(MixSlot), sizeof(MixSlot) * kMaxMixSources, p, space));
+        for ( size_t i = 0 ; i < kMaxMixSources ; ++i ) {
+            new (&m_slots[i]) MixSlot();
+        }
+        setupWindows();
+        // A tick that takes longer than its window is a glitch; show it in the queue's metrics.
+        m_mixQueue.set_job_budget(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(m_frameDuration)));
+    }
+    GenericAudioMixer::~GenericAudioMixer()
+    {
+        m_exiting = true;
+        // Ticks already queued are skipped; the barrier waits out one in progress, which may set a new timer.
+        m_mixQueue.mark_exiting();
+        m_mixQueue.enqueue_sync([this]() {
+            if(m_mixTimer) {
+                m_mixQueue.cancel(m_mixTimer);
+                m_mixTimer = 0;
+            }
+        });
+    }
+    void
+    GenericAudioMixer::setupWindows()
     {
         // stereo: 2 * 16 / 8 = 4 bytes per sample
-        m_bytesPerSample = outChannelCount * outBitsPerChannel / 8;
+        m_bytesPerSample = m_outChannelCount * m_outBitsPerChannel / 8;
 
         
+        const size_t windowSamples = size_t(m_frameDuration * m_outFrequencyInHz) * m_outChannelCount;
+        
+        m_windows.clear();
         for ( int i = 0 ; i < kMixWindowCount ; ++i ) {
-            m_windows.emplace_back(std::make_shared<MixWindow>(m_bytesPerSample * frameDuration * outFrequencyInHz));
+            m_windows.emplace_back(std::make_shared<MixWindow>(windowSamples));
         }
+        m_outputBuffer.resize(windowSamples);
         for ( int i = 0 ; i < kMixWindowCount-1 ; ++i ) {
             m_windows[i]->next = m_windows[i+1].get();
             m_windows[i+1]->prev = m_windows[i+1].get();
@@ -123,26 +127,247 @@ namespace videocore {
         
         m_currentWindow = m_windows[0].get();
         m_currentWindow->start = std::chrono::steady_clock::now();
-
-
+        m_outgoingWindow = nullptr;
+        
+        m_programMeter.setFormat(m_outFrequencyInHz, m_outLayout);
+        m_programMeter.setInterval(m_meteringInterval);
     }
-    GenericAudioMixer::~GenericAudioMixer()
+    void
+    GenericAudioMixer::start()
     {
-        m_exiting = true;
-        m_mixThreadCond.notify_all();
-        if(m_mixThread.joinable()) {
-            m_mixThread.join();
+        if(m_pullMode) {
+            std::unique_lock<std::mutex> l(m_mixMutex);
+            m_pulledFrames = 0;
+            m_currentWindow->start = m_epoch;
+            m_pulling = true;
+            return;
         }
-        m_mixQueue.mark_exiting();
-        m_mixQueue.enqueue_sync([]() {});
+        {
+            std::unique_lock<std::mutex> l(m_mixMutex);
+            m_mixStart = m_epoch;
+            m_mixWindowIndex = 0;
+            m_emittedFrames = 0;
+            m_currentWindow->start = m_mixStart;
+            m_currentWindow->next->start = windowStart(1);
+        }
+        m_started = true;
+        m_mixQueue.enqueue([this]() { mixTick(); });
     }
     void
-    GenericAudioMixer::start()
+    GenericAudioMixer::setOutputDither(bool dither)
     {
-        m_mixThread = std::thread([this]() {
-            pthread_setname_np("com.videocore.audiomixer");
-            this->mixThread();
-        });
+        std::unique_lock<std::mutex> l(m_mixMutex);
+        m_limiter.setDither(dither);
+    }
+    void
+    GenericAudioMixer::setResamplerQuality(ResamplerQuality_t quality)
+    {
+        m_resamplerQuality = quality;
+    }
+    void
+    GenericAudioMixer::setDriftCompensation(bool compensate)
+    {
+        m_driftCompensation = compensate;
+    }
+    void
+    GenericAudioMixer::setMeteringInterval(double interval)
+    {
+        m_meteringInterval = std::max(0., interval);
+    }
+    bool
+    GenericAudioMixer::programLevels(AudioLevels& levels) const
+    {
+        return m_programMeter.levels(levels);
+    }
+    bool
+    GenericAudioMixer::sourceLevels(std::weak_ptr<ISource> source,
+                                    AudioLevels& levels) const
+    {
+        auto mixSource = findSource(source.lock());
+        if(mixSource) {
+            return mixSource->meter.levels(levels);
+        }
+        return false;
+    }
+    void
+    GenericAudioMixer::addOutput(std::shared_ptr<IOutput> output,
+                                 int frequencyInHz,
+                                 const ChannelLayout& layout,
+                                 double frameDuration)
+    {
+        if(!output || frequencyInHz <= 0 || !layout.isSpecified() || frameDuration <= 0.) {
+            return;
+        }
+        auto mixOutput = std::make_shared<MixOutput>();
+        mixOutput->output = output;
+        mixOutput->frequencyInHz = frequencyInHz;
+        mixOutput->layout = layout;
+        mixOutput->frameCount = std::max(size_t(1), size_t(std::floor(frameDuration * frequencyInHz + 0.5)));
+        
+        std::unique_lock<std::mutex> l(m_mixMutex);
+        prepareOutput(*mixOutput);
+        m_extraOutputs.push_back(mixOutput);
+    }
+    void
+    GenericAudioMixer::removeOutput(std::shared_ptr<IOutput> output)
+    {
+        std::unique_lock<std::mutex> l(m_mixMutex);
+        m_extraOutputs.erase(std::remove_if(m_extraOutputs.begin(), m_extraOutputs.end(),
+                                            [&](const std::shared_ptr<MixOutput>& o) { return o->output.lock() == output; }),
+                             m_extraOutputs.end());
+    }
+    void
+    GenericAudioMixer::prepareOutput(MixOutput& output)
+    {
+        const size_t busFrames = size_t(m_frameDuration * m_outFrequencyInHz);
+        const int channelCount = output.layout.channelCount;
+        
+        output.busLayout = m_outLayout;
+        output.matrix = ChannelMatrix::remix(m_outLayout, output.layout);
+        output.resampler.reset();
+        if(output.frequencyInHz != m_outFrequencyInHz) {
+            output.resampler = std::make_shared<Resampler>(m_outFrequencyInHz, output.frequencyInHz, channelCount, m_resamplerQuality);
+        }
+        // Room for a whole bus window on top of the filter history (64 frames at most), so that the mix thread
+        // never allocates.
+        const size_t maxFrames = size_t(std::ceil(double(busFrames + 64) * output.frequencyInHz / m_outFrequencyInHz)) + 2;
+        
+        output.remixed.assign(busFrames * channelCount, 0.f);
+        output.pending.assign((output.frameCount + maxFrames) * channelCount, 0.f);
+        output.pendingFrames = 0;
+        output.buffer.assign(output.frameCount * channelCount, 0);
+        output.quiet = true;
+    }
+    void
+    GenericAudioMixer::feedOutput(MixOutput& output,
+                                  const float* samples,
+                                  size_t frameCount,
+                                  uint64_t busFrame)
+    {
+        if(output.busLayout != m_outLayout || (output.resampler ? output.resampler->inFrequencyInHz() : output.frequencyInHz) != m_outFrequencyInHz) {
+            prepareOutput(output);
+        }
+        if(!output.started) {
+            output.startFrame = int64_t((double(busFrame) * output.frequencyInHz) / m_outFrequencyInHz + 0.5);
+            output.started = true;
+        }
+        const int channelCount = output.layout.channelCount;
+        const size_t room = output.pending.size() / channelCount - output.pendingFrames;
+        float* dst = &output.pending[output.pendingFrames * channelCount];
+        size_t frames = std::min(frameCount, room);
+        
+        if(!samples && output.quiet) {
+            // Silence after silence: the resampler has nothing left to ring out.
+            frames = output.resampler ? std::min(output.resampler->skip(frameCount), room) : frames;
+            std::fill(dst, dst + frames * channelCount, 0.f);
+        } else {
+            const float* in = samples;
+            if(!in) {
+                std::fill(output.remixed.begin(), output.remixed.end(), 0.f);
+                in = output.remixed.data();
+            } else if(!output.matrix.isIdentity()) {
+                output.matrix.apply(in, output.remixed.data(), frameCount);
+                in = output.remixed.data();
+            }
+            if(output.resampler) {
+                frames = output.resampler->process(in, frameCount, dst, room);
+            } else {
+                std::copy(in, in + frames * channelCount, dst);
+            }
+        }
+        output.quiet = !samples;
+        output.pendingFrames += frames;
+        
+        auto out = output.output.lock();
+        std::shared_ptr<videocore::ISource> blank;
+        size_t offset = 0;
+        
+        while(output.pendingFrames - offset >= output.frameCount) {
+            convertFromFloat(output.buffer.data(), &output.pending[offset * channelCount], kSampleFormatS16, output.frameCount * channelCount);
+            
+            const MediaTime time(output.startFrame + int64_t(output.framesEmitted), output.frequencyInHz);
+            AudioBufferMetadata md ( time.seconds() * 1000. );
+            md.mediaTime = time;
+            md.setData(output.frequencyInHz,
+                       16,
+                       channelCount,
+                       0,
+                       channelCount * int(sizeof(int16_t)),
+                       (int)output.frameCount,
+                       false,
+                       false,
+                       blank,
+                       output.layout);
+            if(out) {
+                out->pushBuffer((const uint8_t*)output.buffer.data(), output.buffer.size() * sizeof(int16_t), md);
+            }
+            output.framesEmitted += output.frameCount;
+            offset += output.frameCount;
+        }
+        if(offset) {
+            std::copy(output.pending.begin() + offset * channelCount, output.pending.begin() + output.pendingFrames * channelCount, output.pending.begin());
+            output.pendingFrames -= offset;
+        }
+    }
+    void
+    GenericAudioMixer::setPullMode(bool pull)
+    {
+        if(m_started || m_pulling) {
+            DLog("GenericAudioMixer: pull mode cannot change once the mixer has started\n");
+            return;
+        }
+        m_pullMode = pull;
+    }
+    size_t
+    GenericAudioMixer::pull(int16_t* buffer,
+                            size_t frameCount,
+                            AudioBufferMetadata& metadata)
+    {
+        if(!m_pulling) {
+            return 0;
+        }
+        std::unique_lock<std::mutex> l(m_mixMutex);
+        
+        const size_t windowFrames = m_currentWindow->size / m_outChannelCount;
+        
+        std::shared_ptr<videocore::ISource> blank;
+        metadata.mediaTime = MediaTime(int64_t(m_pulledFrames), m_outFrequencyInHz);
+        metadata.pts = metadata.dts = metadata.mediaTime.seconds() * 1000.;
+        metadata.setData(m_outFrequencyInHz,
+                         m_outBitsPerChannel,
+                         m_outChannelCount,
+                         0,
+                         0,
+                         (int)frameCount,
+                         false,
+                         false,
+                         blank,
+                         m_outLayout);
+        
+        size_t done = 0;
+        while(done < frameCount) {
+            // Drained again for each window, so that a long pull does not run past the windows set up to take it.
+            mixSources();
+            
+            const size_t offset = size_t(m_pulledFrames % windowFrames);
+            const size_t frames = std::min(windowFrames - offset, frameCount - done);
+            
+            renderWindow(*m_currentWindow, offset, frames, buffer + done * m_outChannelCount, m_pulledFrames);
+            
+            done += frames;
+            m_pulledFrames += frames;
+            
+            if(offset + frames == windowFrames) {
+                if(!m_currentWindow->silent) {
+                    m_currentWindow->clear();
+                }
+                // Window starts follow the frame count exactly, so the source timelines line up with what is pulled.
+                const double start = double(m_pulledFrames) / m_outFrequencyInHz;
+                m_currentWindow = m_currentWindow->next;
+                m_currentWindow->start = m_epoch + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(start));
+            }
+        }
+        return frameCount;
     }
     void
     GenericAudioMixer::setMinimumBufferDuration(const double duration)
@@ -156,22 +381,68 @@ namespace videocore {
         auto hash = std::hash<std::shared_ptr< ISource> >()(source);
         // stereo: 4 * 44100 * m_bufferDuration * 4 ?
         size_t bufferSize = (inBufferSize ? inBufferSize : (m_bytesPerSample * m_outFrequencyInHz * m_bufferDuration * 4));
-        std::unique_ptr<RingBuffer> buffer(new RingBuffer(bufferSize));
         
-        m_inGain[hash] = 1.f;
+        const size_t samples = std::max(bufferSize / sizeof(int16_t), size_t(m_outFrequencyInHz * m_frameDuration * kMixSourceWindows) * m_outChannelCount);
+        auto mixSource = std::make_shared<MixSource>(samples);
+        mixSource->floatScratch.reserve(samples);
+        mixSource->samples.reserve(samples);
+        mixSource->remixed.reserve(samples);
+        mixSource->meter.setFormat(m_outFrequencyInHz, m_outLayout);
+        mixSource->meter.setInterval(m_meteringInterval);
+        
+        std::unique_lock<std::mutex> l(m_sourceMutex);
+        auto sources = std::make_shared<SourceTable>(*std::atomic_load(&m_sources));
+        
+        // Registering a source again gives it fresh state in the slot it already has.
+        auto it = sources->index.find(hash);
+        size_t slot;
+        if(it != sources->index.end()) {
+            slot = it->second;
+        } else {
+            slot = std::find(sources->slots.begin(), sources->slots.end(), nullptr) - sources->slots.begin();
+            if(slot >= kMaxMixSources) {
+                DLog("GenericAudioMixer: cannot mix more than %zu sources\n", kMaxMixSources);
+                return;
+            }
+            if(slot == sources->slots.size()) {
+                sources->slots.emplace_back();
+            }
+            sources->index[hash] = slot;
+        }
+        mixSource->slot = slot;
+        m_slots[slot].gain = 1.f;
+        sources->slots[slot] = mixSource;
+        
+        std::atomic_store(&m_sources, std::shared_ptr<const SourceTable>(sources));
     }
     void
     GenericAudioMixer::unregisterSource(std::shared_ptr<ISource> source)
     {
         auto hash = std::hash<std::shared_ptr< ISource> >()(source);
 
-        m_mixQueue.enqueue([=]() {
-            auto iit = m_inGain.find(hash);
-            if(iit != m_inGain.end()) {
-                m_inGain.erase(iit);
-            }
-        });
-
+        // A producer or the mix thread still using the previous map keeps the MixSource alive until it is done.
+        std::unique_lock<std::mutex> l(m_sourceMutex);
+        auto sources = std::make_shared<SourceTable>(*std::atomic_load(&m_sources));
+        auto it = sources->index.find(hash);
+        if(it == sources->index.end()) {
+            return;
+        }
+        sources->slots[it->second].reset();
+        sources->index.erase(it);
+        while(!sources->slots.empty() && !sources->slots.back()) {
+            sources->slots.pop_back();
+        }
+        std::atomic_store(&m_sources, std::shared_ptr<const SourceTable>(sources));
+    }
+    std::shared_ptr<MixSource>
+    GenericAudioMixer::findSource(const std::shared_ptr<ISource>& source) const
+    {
+        if(!source) {
+            return nullptr;
+        }
+        const auto sources = std::atomic_load(&m_sources);
+        auto it = sources->index.find(std::hash<std::shared_ptr<ISource>>()(source));
+        return it != sources->index.end() ? sources->slots[it->second] : nullptr;
     }
     void
     GenericAudioMixer::pushBuffer(const uint8_t* const data,
@@ -183,191 +454,352 @@ namespace videocore {
         if(inMeta.size() >= 5) {
             const auto inSource = inMeta.getData<kAudioMetadataSource>() ;
             const auto cMixTime = std::chrono::steady_clock::now();
-            MixWindow* currentWindow = m_currentWindow;
-            auto lSource = inSource.lock();
-            if(lSource) {
+            auto mixSource = findSource(inSource.lock());
+            if(mixSource) {
+                MixSource& source = *mixSource;
                 
-                auto ret = resample(data, size, inMeta);
-            
-                if(ret->size() == 0) {
-                    ret->resize(size);
-                    ret->put((uint8_t*)data, size);
-                }
+                trackDrift(source, cMixTime, inMeta.getData<kAudioMetadataNumberFrames>(), inMeta.getData<kAudioMetadataFrequencyInHz>());
                 
+                // A source that is muted, or sending digital silence, has nothing to add to the mix.  The first such
+                // buffer still goes through so that the resampler rings out what came before; after that, buffers
+                // only move the timeline of the source on until it has something to say again.
+                const bool quiet = m_slots[source.slot].gain.load() == 0.f
+                                || (!inMeta.getData<kAudioMetadataUsesOSStruct>() && isSilent(data, size));
+                size_t skipped = 0;
+                const bool skip = quiet && source.quiet && skipResample(size, inMeta, source, skipped);
+                source.quiet = quiet;
                 
-                m_mixQueue.enqueue([=]() {
-                    auto mixTime = cMixTime;
-                    
-                    const float g = 0.70710678118f; // 1 / sqrt(2)
-                    
-                    const auto lSource = inSource.lock();
-                    if(!lSource) return ;
-                    
-                    const auto hash = std::hash<std::shared_ptr<ISource>>()(lSource);
+                const float* samples = nullptr;
+                size_t count = skipped * m_outChannelCount;
+                
+                if(!skip) {
+                    resample(data, size, inMeta, source, source.samples);
                     
-                    auto it = m_lastSampleTime.find(hash);
+                    const int inChannelCount = std::max(inMeta.getData<kAudioMetadataChannelCount>(), 1);
+                    samples = source.samples.data();
+                    count = source.samples.size();
                     
-                    if(it != m_lastSampleTime.end() && (mixTime - it->second) < std::chrono::microseconds(int64_t(m_frameDuration * 0.25e6f))) {
-                        mixTime = it->second;
+                    const ChannelMatrix& matrix = channelMatrix(source, inMeta.getData<kAudioMetadataChannelLayout>(), inChannelCount);
+                    if(!matrix.isIdentity()) {
+                        const size_t frames = count / inChannelCount;
+                        source.remixed.resize(frames * m_outChannelCount);
+                        matrix.apply(samples, source.remixed.data(), frames);
+                        samples = source.remixed.data();
+                        count = source.remixed.size();
                     }
-                    
-                    size_t startOffset = 0;
+                }
+                if(!count) {
+                    return;
+                }
+                meter(source.meter, samples, count / m_outChannelCount);
                 
-                    MixWindow* window = currentWindow;
+                if(!skip && source.ring.writable() < count) {
+                    // The mix thread has fallen behind.  Drop the buffer and restart the timeline with the next one.
+                    source.producerSynced = false;
+                    return;
+                }
                 
-                    auto diff = std::chrono::duration_cast<std::chrono::microseconds>(mixTime - window->start).count();
-
-                    if(diff > 0) {
-                        startOffset = size_t((float(diff) / 1.0e6f) * m_outFrequencyInHz * m_bytesPerSample) & ~(m_bytesPerSample-1);
-                        
-                        while ( startOffset >= window->size ) {
-                            startOffset = (startOffset - window->size);
-                            window = window->next;
-                            
-                        }
-                        
-                    } else {
-                        startOffset = 0;
+                // Buffers that arrive no later than a quarter frame after the end of the previous one continue it.
+                // Once the clock of the source is tracked, the filtered arrival time is used so that a late wakeup
+                // of the capture thread is not mistaken for a gap; a real gap restarts the estimator.
+                const auto arrival = source.drift.locked() ? source.drift.time() : cMixTime;
+                
+                if(!source.producerSynced || (arrival - timelineEnd(source)) >= std::chrono::microseconds(int64_t(m_frameDuration * 0.25e6f))) {
+                    source.producerBase = arrival;
+                    source.producerSamples = 0;
+                    source.producerSynced = true;
+                    source.markerPending = true;
+                }
+                if(skip) {
+                    // Nothing goes into the ring, so whatever is written next needs a marker to find its place.
+                    source.producerSamples += count;
+                    source.markerPending = true;
+                    return;
+                }
+                if(source.markerPending) {
+                    MixSource::Marker marker = { source.ring.writePosition(), timelineEnd(source) };
+                    if(!source.markers.push(marker)) {
+                        source.producerSynced = false;
+                        return;
                     }
-                    
-                    auto sampleDuration = double(ret->size()) / double(m_bytesPerSample * m_outFrequencyInHz);
-
-                    const float mult = m_inGain[hash] * g;
-                    
-                    uint8_t* p ;
-                    ret->read(&p, ret->size());
-                    size_t bytesLeft = ret->size();
-
-                    size_t so = startOffset;
-                    
-                    while(bytesLeft > 0) {
-                        size_t toCopy = std::min(window->size - so, bytesLeft);
-
-                        short* mix = (short*)p;
-                        short* winMix = (short*)(window->buffer+so);
-                        size_t count = toCopy / sizeof(short);
-                        
-                        for ( size_t i = 0 ; i < count  ; i++ ) {
-                            winMix[i] = TPMixSamples(winMix[i], mix[i]*mult);
-                        }
-                        
-                        p += toCopy;
-                        bytesLeft -= toCopy;
-                        
-                        if(bytesLeft) {
-                            window = window->next;
-                            so = 0;
+                    source.markerPending = false;
+                }
+                source.ring.write(samples, count);
+                source.producerSamples += count;
+            }
+        }
+    }
+    size_t
+    GenericAudioMixer::inputFrames(size_t size, AudioBufferMetadata& metadata) const
+    {
+        const auto inChannelCount = std::max(metadata.getData<kAudioMetadataChannelCount>(), 1);
+        const SampleFormat_t format = sampleFormat(metadata.getData<kAudioMetadataBitsPerChannel>(),
+                                                   metadata.getData<kAudioMetadataFlags>() & kAudioFlagIsFloat);
+        
+        return std::min(size_t(metadata.getData<kAudioMetadataNumberFrames>()), size / (bytesPerSample(format) * inChannelCount));
+    }
+    bool
+    GenericAudioMixer::skipResample(size_t size,
+                                    AudioBufferMetadata& metadata,
+                                    MixSource& source,
+                                    size_t& frames)
+    {
+        const auto inFrequencyInHz = metadata.getData<kAudioMetadataFrequencyInHz>();
+        const auto inChannelCount = std::max(metadata.getData<kAudioMetadataChannelCount>(), 1);
+        const size_t inFrames = inputFrames(size, metadata);
+        
+        if(inFrequencyInHz == m_outFrequencyInHz && !m_driftCompensation) {
+            frames = inFrames;
+            return true;
+        }
+        // The resampler has to be running already, in the format of this buffer, for its position to carry on.
+        auto & resampler = source.resampler;
+        if(!resampler || resampler->inFrequencyInHz() != inFrequencyInHz || resampler->channelCount() != inChannelCount
+           || resampler->outFrequencyInHz() != m_outFrequencyInHz || resampler->quality() != m_resamplerQuality) {
+            return false;
+        }
+        resampler->setRatioAdjust(source.ratioAdjust);
+        frames = resampler->skip(inFrames);
+        return true;
+    }
+    void
+    GenericAudioMixer::meter(LoudnessMeter& meter, const float* samples, size_t frameCount)
+    {
+        const double interval = m_meteringInterval;
+        if(interval <= 0.) {
+            return;
+        }
+        if(interval != meter.interval()) {
+            meter.setInterval(interval);
+        }
+        if(samples) {
+            meter.process(samples, frameCount);
+        } else {
+            meter.processSilence(frameCount);
+        }
+    }
+    std::chrono::steady_clock::time_point
+    GenericAudioMixer::timelineEnd(const MixSource& source) const
+    {
+        const double written = double(source.producerSamples) / double(m_outChannelCount * m_outFrequencyInHz);
+        return source.producerBase + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(written));
+    }
+    void
+    GenericAudioMixer::trackDrift(MixSource& source,
+                                  std::chrono::steady_clock::time_point time,
+                                  size_t frames,
+                                  int frequencyInHz)
+    {
+        if(!m_driftCompensation) {
+            source.drift.reset();
+            source.ratioAdjust = 0.;
+            return;
+        }
+        source.drift.update(time, frames, frequencyInHz);
+        
+        if(!source.drift.locked() || !source.producerSynced) {
+            return;
+        }
+        
+        // Follow the measured rate, and pull the timeline of the source back towards its filtered arrival times
+        // so that estimation error does not add up to a gap or an overlap.
+        const double phase = std::chrono::duration<double>(source.drift.time() - timelineEnd(source)).count();
+        const double adjust = source.drift.rateError() - phase / kDriftPhaseTime;
+        
+        source.ratioAdjust = std::max(-kMaxDriftAdjust, std::min(kMaxDriftAdjust, adjust));
+    }
+    const ChannelMatrix&
+    GenericAudioMixer::channelMatrix(MixSource& source, const ChannelLayout& layout, int inChannelCount)
+    {
+        // Held by the source so that it outlives this buffer even if setSourceChannelMatrix replaces it meanwhile.
+        source.userMatrixInUse = std::atomic_load(&source.userMatrix);
+        
+        const auto & user = source.userMatrixInUse;
+        if(user && user->inChannelCount() == inChannelCount && user->outChannelCount() == m_outChannelCount) {
+            return *user;
+        }
+        const ChannelLayout inLayout = layout.channelCount == inChannelCount ? layout : ChannelLayout::defaultForChannelCount(inChannelCount);
+        
+        // Only rebuilt when the format of the source changes.
+        if(source.matrix.empty() || source.inLayout != inLayout) {
+            source.matrix = ChannelMatrix::remix(inLayout, m_outLayout);
+            source.inLayout = inLayout;
+        }
+        return source.matrix;
+    }
+    void
+    GenericAudioMixer::mixSources()
+    {
+        const float g = 0.70710678118f; // 1 / sqrt(2)
+        
+        const MixWindow* first = m_outgoingWindow ? m_outgoingWindow : m_currentWindow;
+        
+        const auto sources = std::atomic_load(&m_sources);
+        
+        // Gain changes are spread over kGainRampDuration per unit of gain so that they do not click.
+        const float slew = 1.f / (kGainRampDuration * m_outFrequencyInHz);
+        const size_t channelCount = m_outChannelCount;
+        
+        for ( auto & mixSource : sources->slots ) {
+            if(!mixSource) {
+                continue;
+            }
+            MixSource& source = *mixSource;
+            MixSlot& slot = m_slots[source.slot];
+            const float target = slot.gain.load(std::memory_order_relaxed);
+            
+            if(slot.owner != &source) {
+                slot.owner = &source;
+                slot.gainInUse = target;
+            }
+            
+            for(;;) {
+                // Read the ring before the markers: a marker is always published before the samples that follow it.
+                size_t available = source.ring.readable();
+                
+                if(!source.hasMarker) {
+                    source.hasMarker = source.markers.pop(source.marker);
+                }
+                if(source.hasMarker) {
+                    const uint64_t position = source.ring.readPosition();
+                    if(source.marker.position == position) {
+                        source.cursorBase = source.marker.time;
+                        source.cursorSamples = 0;
+                        source.hasCursor = true;
+                        source.hasMarker = false;
+                        continue;
+                    }
+                    available = std::min(available, size_t(source.marker.position - position));
+                }
+                if(!available) {
+                    break;
+                }
+                
+                const double since = std::chrono::duration<double>(source.cursorBase - first->start).count();
+                const int64_t offset = int64_t(std::floor(since * m_outFrequencyInHz + 0.5)) * m_outChannelCount + int64_t(source.cursorSamples);
+                
+                const float* samples;
+                const size_t count = source.ring.peek(&samples, available);
+                
+                for ( size_t done = 0 ; source.hasCursor && done < count ; ) {
+                    // The ramp, if any, then the rest at the target gain.
+                    size_t frames = (count - done) / channelCount;
+                    float step = 0.f;
+                    bool reached = true;
+                    const float diff = target - slot.gainInUse;
+                    if(diff != 0.f) {
+                        const size_t ramp = size_t(std::ceil(std::fabs(diff) / slew));
+                        reached = ramp <= frames;
+                        if(reached) {
+                            frames = ramp;
+                            step = diff / float(ramp);
+                        } else {
+                            step = diff > 0.f ? slew : -slew;
                         }
                     }
-                    m_lastSampleTime[hash] = mixTime + std::chrono::microseconds(int64_t(sampleDuration*1.0e6));
-                    
-                });
-
+                    mixIntoWindows(offset + int64_t(done), samples + done, frames * channelCount, slot.gainInUse * g, step * g);
+                    slot.gainInUse = reached ? target : slot.gainInUse + step * float(frames);
+                    done += frames * channelCount;
+                }
+                source.cursorSamples += count;
+                source.ring.consume(count);
+            }
+        }
+    }
+    void
+    GenericAudioMixer::mixIntoWindows(int64_t offset,
+                                      const float* samples,
+                                      size_t count,
+                                      float gain,
+                                      float step)
+    {
+        MixWindow* window = m_outgoingWindow ? m_outgoingWindow : m_currentWindow;
+        
+        if(offset < 0) {
+            const size_t late = size_t(std::min(int64_t(count), -offset));
+            gain += step * float(late / m_outChannelCount);
+            samples += late;
+            count -= late;
+            offset = 0;
+        }
+        
+        // Keep clear of the windows that wrap around to the one being emitted.
+        const int64_t horizon = int64_t(window->size) * (kMixWindowCount - 2);
+        if(offset + int64_t(count) > horizon) {
+            count = size_t(std::max(int64_t(0), horizon - offset));
+        }
+        
+        size_t so = size_t(offset);
+        while ( so >= window->size ) {
+            so -= window->size;
+            window = window->next;
+        }
+        
+        while(count > 0) {
+            const size_t toMix = std::min(window->size - so, count);
+            
+            if(step == 0.f) {
+                accumulateSamples(window->buffer + so, samples, toMix, gain);
+            } else {
+                gain = accumulateRamp(window->buffer + so, samples, toMix / m_outChannelCount, m_outChannelCount, gain, step);
             }
+            window->silent = false;
+            
+            samples += toMix;
+            count -= toMix;
+            window = window->next;
+            so = 0;
         }
     }
-    std::shared_ptr<Buffer>
+    void
     GenericAudioMixer::resample(const uint8_t* const buffer,
                                 size_t size,
-                                AudioBufferMetadata &metadata)
+                                AudioBufferMetadata &metadata,
+                                MixSource& source,
+                                std::vector<float>& out)
     {
         const auto inFrequncyInHz = metadata.getData<kAudioMetadataFrequencyInHz>();
-        auto inBitsPerChannel = metadata.getData<kAudioMetadataBitsPerChannel>();
-        const auto inChannelCount = metadata.getData<kAudioMetadataChannelCount>();
+        const auto inChannelCount = std::max(metadata.getData<kAudioMetadataChannelCount>(), 1);
         const auto inFlags = metadata.getData<kAudioMetadataFlags>();
-        const auto inNumberFrames = metadata.getData<kAudioMetadataNumberFrames>();
-
-        // frequencyInHz and BitsPerChannel, and outChannelCount the same, do nothing
-        if(m_outFrequencyInHz == inFrequncyInHz && m_outBitsPerChannel == inBitsPerChannel && m_outChannelCount == inChannelCount)
-        {
-            // No resampling necessary
-            return std::make_shared<Buffer>();
-        }
-
-        int16_t (*bitconvert)(void* val) = NULL;
-
-        //
+        const SampleFormat_t format = sampleFormat(metadata.getData<kAudioMetadataBitsPerChannel>(), inFlags & kAudioFlagIsFloat);
+        const size_t sampleCount = inputFrames(size, metadata);
         
-        uint8_t* intBuffer = nullptr;
-        uint8_t * pOutBuffer = NULL;
-        uint8_t * pInBuffer = const_cast<uint8_t*>(buffer);
+        // With drift compensation, sources at the output rate go through the resampler too, from the start, so
+        // that the ratio can be trimmed later without a jump in latency.
+        const bool resampling = inFrequncyInHz != m_outFrequencyInHz || m_driftCompensation;
+        std::vector<float>& decoded = resampling ? source.floatScratch : out;
+        decoded.resize(sampleCount * inChannelCount);
         
-        if(inFlags & 1) {
-            // Floating point lpcm
-            inBitsPerChannel = m_outBitsPerChannel;
-            
-            intBuffer = (uint8_t*) malloc(inNumberFrames * 4);
-
-            deinterleaveDefloat((float*)buffer, (short*)intBuffer,(int) inNumberFrames, inChannelCount);
-            pInBuffer = intBuffer;
-            
+        if((inFlags & kAudioFlagIsNonInterleaved) && inChannelCount > 1) {
+            // One plane after another, each a channel.
+            if(inChannelCount > kMaxPlanes) {
+                out.clear();
+                return;
+            }
+            const void* planes[kMaxPlanes];
+            for ( int c = 0 ; c < inChannelCount ; ++c ) {
+                planes[c] = buffer + c * (size / inChannelCount);
+            }
+            convertToFloat(decoded.data(), planes, format, sampleCount, inChannelCount);
+        } else {
+            convertToFloat(decoded.data(), buffer, format, sampleCount * inChannelCount);
         }
-
-        switch(inBitsPerChannel)
-        {
-            case 8:
-                bitconvert = b8_to_b16;
-                break;
-            case 16:
-                bitconvert = b16_to_b16;
-                break;
-            case 24:
-                bitconvert = b24_to_b16;
-                break;
-            case 32:
-                bitconvert = b32_to_b16;
-                break;
-            default:
-                bitconvert = b16_to_b16;
-                break;
+        if(!resampling) {
+            return;
         }
-
-
-        const size_t bytesPerChannel = inBitsPerChannel / 8;
-        const size_t bytesPerSample = inChannelCount * bytesPerChannel;
-
-        const double ratio = static_cast<double>(inFrequncyInHz) / static_cast<double>(m_outFrequencyInHz);
-
-        const size_t sampleCount = inNumberFrames;
-        const size_t outSampleCount = sampleCount / ratio;
-        const size_t outBufferSize = outSampleCount * m_bytesPerSample;
-
-        const auto outBuffer = std::make_shared<Buffer>(outBufferSize);
-
-    
-        outBuffer->read(&pOutBuffer, outBufferSize);
-
-        int16_t* currSample = (int16_t*)(&pOutBuffer[0]);
-
-        float currentInByteOffset = 0.;
-        const float sampleStride = ratio * static_cast<float>(bytesPerSample);
-
-        const size_t channelStride = (inChannelCount > 1) * bytesPerChannel;
-
-        const uint8_t* pInStart = pInBuffer;
         
-        for( size_t i = 0 ; i < outSampleCount ; ++i )
-        {
-            size_t iSample = (static_cast<size_t>(std::floor(currentInByteOffset))) & ~(bytesPerSample-1); // get an aligned sample.
-
-
-            currentInByteOffset += sampleStride;
-
-            pInBuffer = (const_cast<uint8_t*>(pInStart)+iSample);
-
-            int16_t sampleL = bitconvert(pInBuffer);
-            int16_t sampleR = bitconvert(pInBuffer + channelStride);
-
-            *currSample++ = sampleL;
-            *currSample++ = sampleR;
-
-
-        }
-        if(intBuffer) {
-            free(intBuffer);
+        // A new resampler is only needed when the format of the source changes.
+        auto & resampler = source.resampler;
+        const ResamplerQuality_t quality = m_resamplerQuality;
+        if(!resampler || resampler->inFrequencyInHz() != inFrequncyInHz || resampler->channelCount() != inChannelCount
+           || resampler->outFrequencyInHz() != m_outFrequencyInHz || resampler->quality() != quality) {
+            resampler = std::make_shared<Resampler>(inFrequncyInHz, m_outFrequencyInHz, inChannelCount, quality);
         }
-        outBuffer->setSize(outBufferSize);
-        return outBuffer;
+        resampler->setRatioAdjust(source.ratioAdjust);
+        
+        out.resize(resampler->maxOutputFrames(sampleCount) * inChannelCount);
+        const size_t frames = resampler->process(decoded.data(), sampleCount, out.data(), out.size() / inChannelCount);
+        out.resize(frames * inChannelCount);
     }
     void
     GenericAudioMixer::setOutput(std::shared_ptr<IOutput> output)
@@ -378,20 +810,48 @@ namespace videocore {
     GenericAudioMixer::setSourceGain(std::weak_ptr<ISource> source,
                                      float gain)
     {
-        auto s = source.lock();
-        if(s) {
-            auto hash = std::hash<std::shared_ptr<ISource>>()(s);
-            
+        auto mixSource = findSource(source.lock());
+        if(mixSource) {
             gain = std::max(0.f, std::min(1.f, gain));
             gain = powf(gain, kE);
-            m_inGain[hash] = gain;
-
+            
+            // The mix thread ramps to it from wherever it is.
+            m_slots[mixSource->slot].gain = gain;
         }
     }
     void
     GenericAudioMixer::setChannelCount(int channelCount)
     {
-        m_outChannelCount = channelCount;
+        setChannelLayout(ChannelLayout::defaultForChannelCount(channelCount));
+    }
+    void
+    GenericAudioMixer::setChannelLayout(const ChannelLayout& layout)
+    {
+        if(!layout.isSpecified() || layout == m_outLayout) {
+            return;
+        }
+        if(m_started || m_pulling) {
+            DLog("GenericAudioMixer: the channel layout cannot change once the mixer has started\n");
+            return;
+        }
+        m_outLayout = layout;
+        if(layout.channelCount != m_outChannelCount) {
+            m_outChannelCount = layout.channelCount;
+            setupWindows();
+        }
+    }
+    void
+    GenericAudioMixer::setSourceChannelMatrix(std::weak_ptr<ISource> source,
+                                              const ChannelMatrix& matrix)
+    {
+        auto mixSource = findSource(source.lock());
+        if(mixSource) {
+            std::shared_ptr<const ChannelMatrix> m;
+            if(!matrix.empty()) {
+                m = std::make_shared<ChannelMatrix>(matrix);
+            }
+            std::atomic_store(&mixSource->userMatrix, m);
+        }
     }
     void
     GenericAudioMixer::setFrequencyInHz(float frequencyInHz)
@@ -400,84 +860,95 @@ namespace videocore {
     }
 
     void
-    GenericAudioMixer::mixThread()
+    GenericAudioMixer::renderWindow(MixWindow& window,
+                                    size_t offset,
+                                    size_t frameCount,
+                                    int16_t* out,
+                                    uint64_t busFrame)
     {
-        const auto us = std::chrono::microseconds(static_cast<long long>(m_frameDuration * 1000000.)) ;
-
-        const auto start = m_epoch;
+        float* samples = window.buffer + offset * m_outChannelCount;
         
-        m_nextMixTime = start;
-        m_currentWindow->start = start;
-        m_currentWindow->next->start = start + us;
-        
-        while(!m_exiting.load()) {
+        if(window.silent) {
+            // Every source was quiet: the window is still clear and the limiter has nothing to do.
+            std::fill(out, out + frameCount * m_outChannelCount, 0);
+            m_limiter.reset();
+            meter(m_programMeter, nullptr, frameCount);
+        } else {
+            m_limiter.process(samples, out, frameCount, m_outChannelCount);
+            meter(m_programMeter, samples, frameCount);
+        }
+        for ( auto & output : m_extraOutputs ) {
+            feedOutput(*output, window.silent ? nullptr : samples, frameCount, busFrame);
+        }
+    }
+    std::chrono::steady_clock::time_point
+    GenericAudioMixer::windowStart(uint64_t index) const
+    {
+        const uint64_t windowFrames = m_currentWindow->size / m_outChannelCount;
+        return m_mixStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(double(index * windowFrames) / m_outFrequencyInHz));
+    }
+    void
+    GenericAudioMixer::mixTick()
+    {
+        if(m_exiting.load()) {
+            return;
+        }
+        std::chrono::steady_clock::time_point next;
+        {
             std::unique_lock<std::mutex> l(m_mixMutex);
-
-            auto now = std::chrono::steady_clock::now();
             
-            if( now >= m_currentWindow->next->start ) {
-                
-                auto currentTime = m_nextMixTime;
-                
+            if( std::chrono::steady_clock::now() >= m_currentWindow->next->start ) {
                 
                 MixWindow* currentWindow = m_currentWindow;
                 MixWindow* nextWindow = currentWindow->next;
                 
-                nextWindow->start = currentWindow->start + us;
-                nextWindow->next->start = nextWindow->start + us;
+                ++m_mixWindowIndex;
+                nextWindow->start = windowStart(m_mixWindowIndex);
+                nextWindow->next->start = windowStart(m_mixWindowIndex + 1);
                 
-                m_nextMixTime = currentWindow->start;
+                mixSources();
                 
-                AudioBufferMetadata md ( std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - m_epoch).count() );
-                std::shared_ptr<videocore::ISource> blank;
+                if(m_outgoingWindow) {
+                    const size_t frames = m_outgoingWindow->size / m_outChannelCount;
                     
-                md.setData(m_outFrequencyInHz,
-                           m_outBitsPerChannel,
-                           m_outChannelCount,
-                           0,
-                           0,
-                           (int)currentWindow->size,
-                           false,
-                           false,
-                           blank);
-                auto out = m_output.lock();
-                
-                if(out && m_outgoingWindow) {
-                    out->pushBuffer(m_outgoingWindow->buffer, m_outgoingWindow->size, md);
-                    m_outgoingWindow->clear();
+                    std::shared_ptr<videocore::ISource> blank;
+                    const MediaTime time(int64_t(m_emittedFrames), m_outFrequencyInHz);
+                    AudioBufferMetadata md ( time.seconds() * 1000. );
+                    md.mediaTime = time;
+                    md.setData(m_outFrequencyInHz,
+                               m_outBitsPerChannel,
+                               m_outChannelCount,
+                               0,
+                               0,
+                               (int)frames,
+                               false,
+                               false,
+                               blank,
+                               m_outLayout);
+                    
+                    renderWindow(*m_outgoingWindow, 0, frames, &m_outputBuffer[0], m_emittedFrames);
+                    
+                    auto out = m_output.lock();
+                    if(out) {
+                        out->pushBuffer((const uint8_t*)&m_outputBuffer[0], m_outputBuffer.size() * sizeof(int16_t), md);
+                    }
+                    if(!m_outgoingWindow->silent) {
+                        m_outgoingWindow->clear();
+                    }
+                    m_emittedFrames += frames;
                 }
                 m_outgoingWindow = currentWindow;
                
                 m_currentWindow = nextWindow;
                 
             }
-            if(!m_exiting.load()) {
-                m_mixThreadCond.wait_until(l, m_currentWindow->next->start);
-            }
+            next = m_currentWindow->next->start;
         }
-        DLog("Exiting audio mixer...\n");
-    }
-    void
-    GenericAudioMixer::deinterleaveDefloat(float *inBuff,
-                                           short *outBuff,
-                                           unsigned sampleCount,
-                                           unsigned channelCount)
-    {
-        unsigned offset = sampleCount;
-
-
-        const float mult = float(0x7FFF);
-        
-        if(channelCount == 2) {
-            for ( int i = 0 ; i < sampleCount ; i+=2 ) {
-                outBuff[i] = short(inBuff[i] * mult);
-                outBuff[i+1] = short(inBuff[i+offset] * mult);
-            }
+        if(next <= std::chrono::steady_clock::now()) {
+            // Behind: catch up straight away, a window at a time.
+            m_mixQueue.enqueue([this]() { mixTick(); });
         } else {
-            for (int i = 0 ; i < sampleCount ; i++ ) {
-                outBuff[i] = short(std::min(1.f,std::max(-1.f,inBuff[i])) * mult);
-            }
+            m_mixTimer = m_mixQueue.enqueue_at(next, [this]() { mixTick(); });
         }
-
     }
 }
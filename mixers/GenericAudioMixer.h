@@ -29,42 +29,173 @@
 #include <iostream>
 #include <VideoCore/mixers/IAudioMixer.hpp>
 #include <VideoCore/system/Buffer.hpp>
+#include <VideoCore/system/BoundedQueue.hpp>
 #include <VideoCore/system/JobQueue.hpp>
+#include <VideoCore/system/audio/DriftEstimator.h>
+#include <VideoCore/system/audio/OutputLimiter.h>
+#include <VideoCore/system/audio/Resampler.h>
+#include <VideoCore/system/audio/SampleRing.hpp>
 
-#include <map>
-#include <thread>
+#include <atomic>
+#include <unordered_map>
 #include <mutex>
 
 namespace videocore {
 
+    /*!
+     *  One frame duration of the float mix bus.  Sources are summed into buffer as they arrive and the window is
+     *  limited and converted to int16 once, when it is emitted.
+     */
     struct MixWindow {
-        MixWindow(size_t size) : start(std::chrono::steady_clock::now()) {
-            buffer = new uint8_t[size]();
+        MixWindow(size_t size) : start(std::chrono::steady_clock::now()), silent(true) {
+            buffer = new float[size]();
             this->size = size;
         }
         ~MixWindow() {
             delete [] buffer;
         }
         void clear() {
-            memset(buffer, 0, size);
+            memset(buffer, 0, size * sizeof(float));
+            silent = true;
         }
         
         std::chrono::steady_clock::time_point start;
-        size_t     size;
+        size_t     size;    /*!< In samples: frames * channels */
         MixWindow* next;
         MixWindow* prev;
         
-        uint8_t*   buffer;
+        float*     buffer;  /*!< Interleaved, full scale is [-1, 1) */
+        bool       silent;  /*!< Nothing has been mixed into buffer since it was cleared */
 
     };
     /*!
-     *  Basic, cross-platform mixer that uses a very simple nearest neighbour resampling method
-     *  and the sum of the samples to mix.  The mixer takes LPCM data from multiple sources, resamples (if needed), and
+     *  Per-source state, created when the source is registered so that the capture thread never allocates.
+     *
+     *  The thread delivering the source's buffers is the only writer of ring and markers and the only user of the
+     *  producer state and scratch buffers; the mix thread is the only reader and the only user of the cursor.
+     */
+    struct MixSource {
+        /*! The ring position at which the source's samples stop being contiguous with what came before. */
+        struct Marker {
+            uint64_t position;
+            std::chrono::steady_clock::time_point time;
+        };
+        
+        MixSource(size_t ringCapacity) : slot(0), ring(ringCapacity), markers(16), producerSamples(0), producerSynced(false), markerPending(false), quiet(false), ratioAdjust(0.), hasMarker(false), cursorSamples(0), hasCursor(false) {};
+        
+        size_t               slot;      /*!< Index of the source in the table and in the mixer's MixSlot array */
+        
+        SampleRing           ring;      /*!< Interleaved float at the output format of the mixer */
+        BoundedQueue<Marker> markers;
+        
+        // Producer
+        std::chrono::steady_clock::time_point producerBase;
+        uint64_t producerSamples;           /*!< Written since producerBase */
+        bool     producerSynced;
+        bool     markerPending;             /*!< The next samples written need a marker at timelineEnd */
+        bool     quiet;                     /*!< The last buffer was muted or silent */
+        
+        LoudnessMeter  meter;               /*!< Before gain, at the output rate and channels */
+        
+        DriftEstimator drift;
+        double   ratioAdjust;               /*!< For resampler->setRatioAdjust */
+        
+        std::shared_ptr<Resampler> resampler;
+        std::vector<float>   floatScratch;  /*!< Decoded input, before resampling */
+        std::vector<float>   samples;       /*!< Output of resample, at the channel count of the input */
+        std::vector<float>   remixed;       /*!< samples remixed to the output channels */
+        
+        ChannelLayout        inLayout;      /*!< The input layout matrix was built for */
+        ChannelMatrix        matrix;        /*!< Default remix from inLayout to the output layout */
+        std::shared_ptr<const ChannelMatrix> userMatrix;    /*!< Set by setSourceChannelMatrix; use std::atomic_load/store */
+        std::shared_ptr<const ChannelMatrix> userMatrixInUse;
+        
+        // Mix thread
+        Marker   marker;
+        bool     hasMarker;
+        std::chrono::steady_clock::time_point cursorBase;
+        uint64_t cursorSamples;             /*!< Mixed since cursorBase */
+        bool     hasCursor;
+    };
+    
+    /*!
+     *  The parameters of a source slot that change while it plays, and the mix thread's progress towards them.  The
+     *  mixer keeps one per slot in a flat array, a cache line each, so the mix thread reads every source's gain in
+     *  one pass and a change to one source never invalidates the line of another.
+     */
+    struct alignas(64) MixSlot {
+        MixSlot() : gain(1.f), gainInUse(1.f), owner(nullptr) {};
+        
+        std::atomic<float> gain;            /*!< Target gain, tapered; set by setSourceGain on any thread */
+        
+        // Mix thread
+        float            gainInUse;         /*!< Where the ramp towards gain has got to */
+        const MixSource* owner;             /*!< The source gainInUse belongs to; a new one starts at its target */
+    };
+    
+    /*!
+     *  An output added with addOutput.  Only the mix thread uses it once it is attached.
+     */
+    struct MixOutput {
+        MixOutput() : frameCount(0), pendingFrames(0), startFrame(0), framesEmitted(0), started(false), quiet(true) {};
+        
+        std::weak_ptr<IOutput> output;
+        int            frequencyInHz;
+        ChannelLayout  layout;
+        size_t         frameCount;          /*!< Frames in each buffer given to output */
+        
+        ChannelLayout  busLayout;           /*!< The bus layout matrix was built for */
+        ChannelMatrix  matrix;              /*!< From the bus to layout */
+        std::shared_ptr<Resampler> resampler;   /*!< From the bus rate, or null if it is the same */
+        
+        std::vector<float>   remixed;       /*!< A bus window in layout */
+        std::vector<float>   pending;       /*!< Converted frames that do not fill a buffer yet */
+        size_t               pendingFrames;
+        std::vector<int16_t> buffer;
+        
+        int64_t  startFrame;                /*!< At frequencyInHz, of the first bus window fed in */
+        uint64_t framesEmitted;
+        bool     started;
+        bool     quiet;                     /*!< The last bus window was silent */
+    };
+    
+    /*!
+     *  Basic, cross-platform mixer.  The mixer takes LPCM data from multiple sources, resamples (if needed), and
      *  mixes them to output a single LPCM stream.
      *
-     *  Note that this mixer uses an extremely simple sample rate conversion algorithm that will produce undesirable
-     *  noise in most cases, but it will be much less CPU intensive than more sophisticated methods.  If you are using an Apple
-     *  operating system and can dedicate more CPU resources to sample rate conversion, look at videocore::Apple::AudioMixer.
+     *  The output can have any number of channels, described by a ChannelLayout.  Each source is remixed into it
+     *  by a ChannelMatrix: by default the standard up- or down-mix between the layout of its buffers and the output
+     *  layout, or a matrix given with setSourceChannelMatrix to route, say, individual microphones into stereo and
+     *  a program feed into separate discrete channels.
+     *
+     *  Each source gets its own polyphase windowed-sinc Resampler, so filter state carries over between the buffers
+     *  of a source.  A DriftEstimator measures each source's clock against the steady clock from buffer arrival
+     *  times, and the resampler ratio is trimmed to match, so a device running at 48003 Hz neither gaps nor
+     *  overlaps over a long session.  Sources are summed in floating point and the sum goes through a single soft limiter, with
+     *  optional dither, when it is converted to the output format.  videocore::Apple::AudioMixer uses CoreAudio
+     *  for the sample rate conversion instead.
+     *
+     *  Besides the main output, which takes the bus as it is, outputs in other formats can be attached with
+     *  addOutput.  Each gets the limited bus remixed, resampled and cut into buffers of its own frame duration;
+     *  everything upstream of the bus is shared between them.
+     *
+     *  Each source, and the output after the limiter, has a LoudnessMeter that measures the samples as they pass
+     *  through the mixer and publishes peak, rms and EBU R128 loudness readings every metering interval.
+     *
+     *  Sources that are muted or send digital silence skip resampling, remixing and the ring altogether after
+     *  their first quiet buffer; they keep their place on the timeline, so they pick up exactly where they would
+     *  have been once they have something to mix.  Windows that nothing was mixed into are emitted as silence
+     *  without going through the limiter.
+     *
+     *  In pull mode there is no mix thread: the consumer calls pull() when it wants the next frames, and they are
+     *  drained from the rings, mixed and limited then and there.  A window is then emitted as soon as it is asked
+     *  for rather than a frame duration after it ends.
+     *
+     *  Each source owns a single producer, single consumer SampleRing.  pushBuffer converts on the calling thread
+     *  into scratch space owned by the source and appends the result to the ring, so capture threads never wait on
+     *  each other or on the mix thread, and do not allocate once a source has delivered its first buffer.  Each
+     *  time a window finishes, the mix thread drains every ring into the windows with one accumulate per source
+     *  per window touched.
      */
     class GenericAudioMixer : public IAudioMixer
     {
@@ -107,70 +238,214 @@ namespace videocore {
         void setSourceGain(std::weak_ptr<ISource> source,
                            float gain);
 
-        /*! IAudioMixer::setChannelCount */
+        /*! IAudioMixer::setChannelCount.  Must be called before start(). */
         void setChannelCount(int channelCount);
+        
+        /*! IAudioMixer::setChannelLayout.  Must be called before start(). */
+        void setChannelLayout(const ChannelLayout& layout);
+        
+        /*! IAudioMixer::setSourceChannelMatrix */
+        void setSourceChannelMatrix(std::weak_ptr<ISource> source,
+                                    const ChannelMatrix& matrix);
 
         /*! IAudioMixer::setFrequencyInHz */
         void setFrequencyInHz(float frequencyInHz);
 
+        /*! IAudioMixer::setMeteringInterval */
+        void setMeteringInterval(double interval);
+        
+        /*! IAudioMixer::programLevels */
+        bool programLevels(AudioLevels& levels) const;
+        
+        /*! IAudioMixer::sourceLevels */
+        bool sourceLevels(std::weak_ptr<ISource> source,
+                          AudioLevels& levels) const;
+        
+        /*! IAudioMixer::addOutput */
+        void addOutput(std::shared_ptr<IOutput> output,
+                       int frequencyInHz,
+                       const ChannelLayout& layout,
+                       double frameDuration);
+        
+        /*! IAudioMixer::removeOutput */
+        void removeOutput(std::shared_ptr<IOutput> output);
+        
+        /*! IAudioMixer::setPullMode */
+        void setPullMode(bool pull);
+        
+        /*! IAudioMixer::pull */
+        size_t pull(int16_t* buffer,
+                    size_t frameCount,
+                    AudioBufferMetadata& metadata);
+        
         /*! IAudioMixer::setMinimumBufferDuration */
         virtual void setMinimumBufferDuration(const double duration) ;
 
         /*! ITransform::setEpoch */
         void setEpoch(const std::chrono::steady_clock::time_point epoch) {
             m_epoch = epoch;
-            m_nextMixTime = epoch;
         };
 
         void start();
         
+        /*! Add TPDF dither when the float mix bus is converted to int16.  Off by default. */
+        void setOutputDither(bool dither);
+        
+        /*! Filter length used for sample rate conversion.  Existing sources restart their filters. */
+        void setResamplerQuality(ResamplerQuality_t quality);
+        
+        /*!
+         *  Track the clock of each source and trim its resampling ratio to it.  On by default; sources at the output
+         *  rate then go through the resampler as well.
+         */
+        void setDriftCompensation(bool compensate);
+        
     protected:
 
         /*!
          *  Called to resample a buffer of audio samples.
          *
-         * \param buffer    The input samples
+         * \param buffer    The input samples, interleaved or one plane per channel, in any SampleFormat_t
          * \param size      The buffer size in bytes
          * \param metadata  The associated AudioBufferMetadata that specifies the properties of this buffer.
+         * \param source    State of the source that sent the buffer.
+         * \param out       Receives the samples as interleaved float, full scale [-1, 1), at the output sampling
+         *                  rate of the mixer and the channel count of the buffer; pushBuffer remixes them to the
+         *                  output channels.  Its capacity is reserved up front; keep within it to stay allocation
+         *                  free.
+         */
+        virtual void resample(const uint8_t* const buffer,
+                              size_t size,
+                              AudioBufferMetadata& metadata,
+                              MixSource& source,
+                              std::vector<float>& out);
+        
+        /*! Frames in a buffer of size bytes described by metadata. */
+        size_t inputFrames(size_t size, AudioBufferMetadata& metadata) const;
+        
+        /*!
+         *  Account for a buffer of silence without converting it: move the resampler of source on as resample would
+         *  have, and set frames to the number of frames at the output rate it stands for.
          *
-         * \return An audio buffer that has been resampled to match the output properties of the mixer.
+         *  \return false if the buffer has to be converted after all, for instance because its format changed.
          */
-        virtual std::shared_ptr<Buffer> resample(const uint8_t* const buffer,
-                                                 size_t size,
-                                                 AudioBufferMetadata& metadata);
-
+        virtual bool skipResample(size_t size,
+                                  AudioBufferMetadata& metadata,
+                                  MixSource& source,
+                                  size_t& frames);
+        
+        /*!
+         *  Drain the ring of every source into the mix windows.  Called on the mix thread.
+         */
+        void mixSources();
+        
+        /*!
+         *  Add count samples, scaled by gain, to the windows starting offset samples after the start of the oldest
+         *  window that has not been emitted.  The gain moves by step every frame.  Samples before it are late and
+         *  dropped, as are any beyond the windows.
+         */
+        void mixIntoWindows(int64_t offset, const float* samples, size_t count, float gain, float step);
+        
+        /*! The state of source, or null if it is not registered.  Never blocks. */
+        std::shared_ptr<MixSource> findSource(const std::shared_ptr<ISource>& source) const;
+        
+        /*!
+         *  Measure frameCount frames with meter, if metering is on; null samples are silence.  Called on the thread
+         *  that owns meter.
+         */
+        void meter(LoudnessMeter& meter, const float* samples, size_t frameCount);
+        
+        /*! Where the next sample written to the ring of source belongs on the steady clock. */
+        std::chrono::steady_clock::time_point timelineEnd(const MixSource& source) const;
+        
+        /*!
+         *  Feed the arrival of a buffer to the drift estimator of source and update its ratio adjustment.  Called
+         *  on the thread delivering the source's buffers, before resample.
+         */
+        void trackDrift(MixSource& source, std::chrono::steady_clock::time_point time, size_t frames, int frequencyInHz);
+        
         /*!
-         *  Start the mixer thread.
+         *  The matrix that remixes the buffers of source, whose layout is layout, to the output channels.  Called on
+         *  the thread delivering the source's buffers.
          */
-        void mixThread();
+        const ChannelMatrix& channelMatrix(MixSource& source, const ChannelLayout& layout, int inChannelCount);
 
+        /*!
+         *  Convert frameCount frames of the limited bus, or silence if samples is null, for an output added with
+         *  addOutput and give it every buffer that fills up.  busFrame is the index of the first frame on the bus
+         *  timeline.  Called on the mix thread.
+         */
+        void feedOutput(MixOutput& output, const float* samples, size_t frameCount, uint64_t busFrame);
         
-        void deinterleaveDefloat(float* inBuff, short* outBuff, unsigned sampleCount, unsigned channelCount);
+        /*! (Re)build the conversion of output from the bus format and size its buffers. */
+        void prepareOutput(MixOutput& output);
+        
+        /*!
+         *  Limit and meter frameCount frames of window, starting offset frames in, into out, and feed them to the
+         *  outputs added with addOutput.  busFrame is the index of the first frame on the bus timeline.  Called
+         *  with m_mixMutex held.
+         */
+        void renderWindow(MixWindow& window, size_t offset, size_t frameCount, int16_t* out, uint64_t busFrame);
+        
+        /*!
+         *  Emit the window that has ended, if one has, and set the timer for the end of the next.  Runs on
+         *  m_mixQueue.
+         */
+        void mixTick();
+        
+        /*!
+         *  When the index'th window after start() begins.  Window starts are computed from the frames in each window
+         *  rather than by adding a rounded frame duration, so that source timelines, which are counted in samples,
+         *  do not drift against them and the output timeline is exactly the number of frames emitted.
+         */
+        std::chrono::steady_clock::time_point windowStart(uint64_t index) const;
+        
+        /*!
+         *  (Re)create the mix windows and output buffer for the output format.
+         */
+        void setupWindows();
+
     protected:
         
         std::vector<std::shared_ptr<MixWindow>>                m_windows;
         MixWindow*                            m_currentWindow;
         MixWindow*                            m_outgoingWindow;
         
-        JobQueue                              m_mixQueue;
+        OutputLimiter                         m_limiter;
+        LoudnessMeter                         m_programMeter;
+        std::atomic<double>                   m_meteringInterval;
+        std::vector<int16_t>                  m_outputBuffer;
         
         std::chrono::steady_clock::time_point m_epoch;
-        std::chrono::steady_clock::time_point m_nextMixTime;
-        std::chrono::steady_clock::time_point m_lastMixTime;
         
         double m_frameDuration;
         double m_bufferDuration;
 
         
-        std::thread m_mixThread;
         std::mutex  m_mixMutex;
-        std::condition_variable m_mixThreadCond;
+        JobQueue    m_mixQueue;                         /*!< Mixes each window as its timer fires, in push mode */
+        TimerId     m_mixTimer;                         /*!< m_mixQueue only */
+        uint64_t    m_mixWindowIndex;                   /*!< Windows begun since start(); guarded by m_mixMutex */
+        uint64_t    m_emittedFrames;                    /*!< Pushed to the output since start(); guarded by m_mixMutex */
+        std::chrono::steady_clock::time_point m_mixStart;
 
         std::weak_ptr<IOutput> m_output;
+        std::vector<std::shared_ptr<MixOutput>> m_extraOutputs;    /*!< Guarded by m_mixMutex */
 
-        std::map < std::size_t, float > m_inGain;
-        std::map < std::size_t, std::chrono::steady_clock::time_point > m_lastSampleTime;
+        /*! The registered sources, by slot.  Slots are handed out lowest first and reused once free. */
+        struct SourceTable {
+            std::vector<std::shared_ptr<MixSource>> slots;     /*!< Null where free */
+            std::unordered_map<std::size_t, std::size_t> index; /*!< Hash of the ISource to its slot */
+        };
+        
+        std::shared_ptr<const SourceTable> m_sources;   /*!< Replaced, never modified; use std::atomic_load/store */
+        std::unique_ptr<uint8_t[]> m_slotStorage;
+        MixSlot*   m_slots;                             /*!< Fixed, in m_slotStorage; indexed by MixSource::slot */
+        std::mutex m_sourceMutex;                       /*!< Serialises registerSource and unregisterSource */
+        std::atomic<ResamplerQuality_t> m_resamplerQuality;
+        std::atomic<bool> m_driftCompensation;
         
+        ChannelLayout m_outLayout;
         int m_outChannelCount;
         int m_outFrequencyInHz;
         int m_outBitsPerChannel;
@@ -178,7 +453,10 @@ namespace videocore {
 
         std::atomic<bool> m_exiting;
         
-        bool m_catchingUp;
+        std::atomic<bool> m_started;                    /*!< Started in push mode */
+        bool              m_pullMode;
+        std::atomic<bool> m_pulling;                    /*!< Started in pull mode */
+        uint64_t          m_pulledFrames;               /*!< Rendered by pull since the epoch; guarded by m_mixMutex */
 
     };
 }
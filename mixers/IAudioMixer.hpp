@@ -28,6 +28,9 @@
 #include <VideoCore/system/Buffer.hpp>
 #include <VideoCore/mixers/IMixer.hpp>
 #include <VideoCore/transforms/IMetadata.hpp>
+#include <VideoCore/system/audio/ChannelLayout.hpp>
+#include <VideoCore/system/audio/ChannelMatrix.h>
+#include <VideoCore/system/audio/LoudnessMeter.h>
 
 namespace videocore {
 
@@ -42,7 +45,8 @@ namespace videocore {
         kAudioMetadataNumberFrames,     /*!< Number of sample frames in the buffer. */
         kAudioMetadataUsesOSStruct,     /*!< Indicates that the audio is not raw but instead uses a platform-specific struct */
         kAudioMetadataLoops,            /*!< Indicates whether or not the buffer should loop. Currently ignored. */
-        kAudioMetadataSource            /*!< A smart pointer to the source. */
+        kAudioMetadataSource,           /*!< A smart pointer to the source. */
+        kAudioMetadataChannelLayout     /*!< The ChannelLayout of the buffer.  Unspecified means the default for the channel count. */
     };
 
     /*!
@@ -57,8 +61,9 @@ namespace videocore {
      * AudioMetadataUsesOSStruct
      * AudioMetadataLoops
      * AudioMetadataSource
+     * AudioMetadataChannelLayout
      */
-    typedef MetaData<'soun', int, int, int, int, int, int, bool, bool, std::weak_ptr<ISource> > AudioBufferMetadata;
+    typedef MetaData<'soun', int, int, int, int, int, int, bool, bool, std::weak_ptr<ISource>, ChannelLayout > AudioBufferMetadata;
 
     class ISource;
 
@@ -80,11 +85,29 @@ namespace videocore {
                                    float gain) = 0;
 
         /*!
-         *  Set the channel count.
+         *  Set the channel count.  The output gets the default layout for the count.
          *
          *  \param channelCount  The number of audio channels.
          */
         virtual void setChannelCount(int channelCount) = 0;
+        
+        /*!
+         *  Set the channel count and the meaning of each output channel.
+         *
+         *  \param layout  The output layout.  Discrete channels after the positioned ones can carry separate buses.
+         */
+        virtual void setChannelLayout(const ChannelLayout& layout) = 0;
+        
+        /*!
+         *  Route the channels of a source into the output channels with an explicit matrix instead of the default
+         *  remix between the source and output layouts.
+         *
+         *  \param source  A smart pointer to the source to be modified
+         *  \param matrix  Gains from each source channel to each output channel.  It is used while its channel counts
+         *                 match the source buffers and the output; an empty matrix restores the default.
+         */
+        virtual void setSourceChannelMatrix(std::weak_ptr<ISource> source,
+                                            const ChannelMatrix& matrix) = 0;
 
         /*!
          *  Set the channel count.
@@ -93,6 +116,71 @@ namespace videocore {
          */
         virtual void setFrequencyInHz(float frequencyInHz) = 0;
 
+        /*!
+         *  Set how often levels are measured and published.
+         *
+         *  \param interval  Seconds between readings, which is also the window of the peak and rms.  0 turns
+         *                   metering off.
+         */
+        virtual void setMeteringInterval(double interval) = 0;
+        
+        /*!
+         *  The latest levels of the mixed output.  Never blocks.
+         *
+         *  \return false if there is no reading yet.
+         */
+        virtual bool programLevels(AudioLevels& levels) const = 0;
+        
+        /*!
+         *  The latest levels of a source, before its gain is applied.  Never blocks.
+         *
+         *  \param source  A smart pointer to the source
+         *
+         *  \return false if the source is not registered or there is no reading yet.
+         */
+        virtual bool sourceLevels(std::weak_ptr<ISource> source,
+                                  AudioLevels& levels) const = 0;
+        
+        /*!
+         *  Attach another output in a format of its own.  It is fed from the same mix as the main output, after the
+         *  limiter, so each source is still converted only once however many outputs there are.
+         *
+         *  \param output         The output
+         *  \param frequencyInHz  Its sampling rate
+         *  \param layout         Its channels; the mix is remixed into them
+         *  \param frameDuration  Seconds of audio in each buffer it is given
+         */
+        virtual void addOutput(std::shared_ptr<IOutput> output,
+                               int frequencyInHz,
+                               const ChannelLayout& layout,
+                               double frameDuration) = 0;
+        
+        /*! Detach an output added with addOutput. */
+        virtual void removeOutput(std::shared_ptr<IOutput> output) = 0;
+
+        /*!
+         *  Have the consumer of the mix ask for samples with pull() instead of the mixer pushing a buffer to its
+         *  output every frame duration.  The mixer then runs no thread of its own.  Must be called before start().
+         */
+        virtual void setPullMode(bool pull) = 0;
+
+        /*!
+         *  In pull mode, render the next frameCount frames of the mix as interleaved int16 in the output format.
+         *  Each call continues where the previous one ended, starting at the epoch.  Call it no earlier than the
+         *  end of the frames it asks for on the steady clock, plus a millisecond or two for the capture threads of
+         *  the sources to deliver them; samples that arrive after their frames were rendered are dropped.  Outputs
+         *  added with addOutput are fed as the frames are rendered.
+         *
+         *  \param buffer      Receives frameCount * channel count samples
+         *  \param frameCount  The number of frames to render
+         *  \param metadata    Receives the format and timestamp of the frames
+         *
+         *  \return frameCount, or 0 if the mixer is not started in pull mode.
+         */
+        virtual size_t pull(int16_t* buffer,
+                            size_t frameCount,
+                            AudioBufferMetadata& metadata) = 0;
+
         /*!
          *  Set the amount of time to buffer before emitting mixed samples.
          *
@@ -43,7 +43,12 @@ namespace videocore
     static const size_t kMaxSendbufferSize = 10 * 1024 * 1024; // 10 MB
     
     RTMPSession::RTMPSession(std::string uri, RTMPSessionStateCallback callback)
-    : m_streamOutRemainder(65536)
+    : m_networkQueue("com.videocore.rtmp.network")
+    , m_jobQueue("com.videocore.rtmp")
+    , m_writeBlocked(false)
+    , m_writeRetry(0)
+    , m_streamOutRemainder(65536)
+    , m_previousTs(0)
     , m_streamInBuffer(new PreallocBuffer(4096))
     , m_callback(callback)
     , m_bandwidthCallback(nullptr)
@@ -53,18 +58,14 @@ namespace videocore
     , m_streamId(0)
     , m_numberOfInvokes(0)
     , m_state(kClientStateNone)
-    , m_ending(false)
-    , m_jobQueue("com.videocore.rtmp")
-    , m_networkQueue("com.videocore.rtmp.network")
-    , m_previousTs(0)
     , m_clearing(false)
+    , m_ending(false)
     {
         m_previousChunk.msg_length.data = 0;
         m_previousChunk.msg_stream_id = 0;
         m_previousChunk.msg_type_id = 0;
 #ifdef __APPLE__
         m_streamSession.reset(new Apple::StreamSession());
-        m_networkWaitSemaphore = dispatch_semaphore_create(0);
 #endif
         boost::char_separator<char> sep("/");
         boost::tokenizer<boost::char_separator<char>> uri_tokens(uri, sep);
@@ -103,10 +104,12 @@ namespace videocore
         m_jobQueue.mark_exiting();
         m_jobQueue.enqueue_sync([]() {});
         m_networkQueue.mark_exiting();
-        m_networkQueue.enqueue_sync([]() {});
-#ifdef __APPLE__
-        dispatch_release(m_networkWaitSemaphore);
-#endif
+        m_networkQueue.enqueue_sync([this]() {
+            if(m_writeRetry) {
+                m_networkQueue.cancel(m_writeRetry);
+                m_writeRetry = 0;
+            }
+        });
     }
     void
     RTMPSession::connectServer() {
@@ -137,6 +140,26 @@ namespace videocore
         m_throughputSession.setThroughputCallback(callback);
     }
     void
+    RTMPSession::setBandwidthProbeCallback(BandwidthProbeCallback callback)
+    {
+        m_throughputSession.setProbeCallback(callback);
+    }
+    void
+    RTMPSession::setBandwidthResultCallback(ThroughputResultCallback callback)
+    {
+        m_throughputSession.setThroughputResultCallback(callback);
+    }
+    void
+    RTMPSession::setBandwidthEstimator(BandwidthEstimator_t estimator)
+    {
+        m_throughputSession.setEstimator(estimator);
+    }
+    void
+    RTMPSession::setBandwidthFastReaction(const FastReactionConfig& config)
+    {
+        m_throughputSession.setFastReactionConfig(config);
+    }
+    void
     RTMPSession::pushBuffer(const uint8_t* const data, size_t size, IMetadata& metadata)
     {
         if(m_ending) {
@@ -232,33 +255,52 @@ namespace videocore
                 m_clearing = true;
             }
             m_networkQueue.enqueue([=]() {
-                size_t tosend = size;
-                uint8_t* p ;
-                buf->read(&p, size);
-                
-                while(tosend > 0 && !this->m_ending && (!this->m_clearing || this->m_sentKeyframe == packetTime)) {
-                    this->m_clearing = false;
-                    size_t sent = m_streamSession->write(p, tosend);
-                    p += sent;
-                    tosend -= sent;
-                    this->m_throughputSession.addSentBytesSample(sent);
-                    if( sent == 0 ) {
-#ifdef __APPLE__
-                        dispatch_semaphore_wait(m_networkWaitSemaphore, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(1 * NSEC_PER_SEC)));
-#else
-                        std::unique_lock<std::mutex> l(m_networkMutex);
-                        m_networkCond.wait_until(l, std::chrono::steady_clock::now() + std::chrono::milliseconds(1000));
-                        
-                        l.unlock();
-#endif
-                    }
-                }
-                this->increaseBuffer(-int64_t(size));
+                const PendingWrite write = { buf, size, 0, packetTime };
+                m_outgoing.push_back(write);
+                flush();
             });
         }
         
     }
     void
+    RTMPSession::flush()
+    {
+        while(!m_outgoing.empty()) {
+            PendingWrite& w = m_outgoing.front();
+            uint8_t* p ;
+            w.buf->read(&p, w.size);
+            
+            while(w.sent < w.size && !m_ending && (!m_clearing || m_sentKeyframe == w.packetTime)) {
+                m_clearing = false;
+                size_t sent = m_streamSession->write(p + w.sent, w.size - w.sent);
+                if( sent == 0 ) {
+                    // Raise the flag and try once more, so that space reported in between is not missed.
+                    m_writeBlocked = true;
+                    sent = m_streamSession->write(p + w.sent, w.size - w.sent);
+                }
+                if( sent == 0 ) {
+                    // streamStatusChanged resumes us when there is space; the timer covers a report that never comes.
+                    if(m_writeRetry) {
+                        m_networkQueue.cancel(m_writeRetry);
+                    }
+                    m_writeRetry = m_networkQueue.enqueue_after(std::chrono::seconds(1), [this]() {
+                        m_writeRetry = 0;
+                        flush();
+                    });
+                    return;
+                }
+                w.sent += sent;
+                m_throughputSession.addSentBytesSample(sent);
+            }
+            if(w.sent == w.size) {
+                const auto queued = std::chrono::steady_clock::now() - w.packetTime;
+                m_throughputSession.addBufferDurationSample(std::chrono::duration_cast<std::chrono::milliseconds>(queued).count());
+            }
+            increaseBuffer(-int64_t(w.size));
+            m_outgoing.pop_front();
+        }
+    }
+    void
     RTMPSession::dataReceived()
     {
         bool stop1 = false;
@@ -360,12 +402,9 @@ namespace videocore
                 handshake();
             } else {
                 
-#ifdef __APPLE__
-                dispatch_semaphore_signal(m_networkWaitSemaphore);
-#else
-                m_networkMutex.unlock();
-                m_networkCond.notify_one();
-#endif
+                if(m_writeBlocked.exchange(false)) {
+                    m_networkQueue.enqueue([this]() { flush(); });
+                }
             }
         }
         if(status & kStreamStatusEndStream) {
@@ -36,6 +36,7 @@
 #include <queue>
 #include <map>
 #include <chrono>
+#include <atomic>
 
 #include <VideoCore/system/JobQueue.hpp>
 #include <cstdlib>
@@ -87,6 +88,10 @@ namespace videocore
         
         void setSessionParameters(IMetadata& parameters);
         void setBandwidthCallback(BandwidthCallback callback);
+        void setBandwidthProbeCallback(BandwidthProbeCallback callback);
+        void setBandwidthResultCallback(ThroughputResultCallback callback);
+        void setBandwidthEstimator(BandwidthEstimator_t estimator);
+        void setBandwidthFastReaction(const FastReactionConfig& config);
         
     private:
         
@@ -97,6 +102,9 @@ namespace videocore
         
         void streamStatusChanged(StreamStatus_T status);
         void write(uint8_t* data, size_t size, std::chrono::steady_clock::time_point packetTime = std::chrono::steady_clock::now(), bool isKeyframe = false);
+        
+        /*! Send what the socket will take from m_outgoing, in order.  Runs on m_networkQueue. */
+        void flush();
         void dataReceived();
         void setClientState(ClientState_t state);
         void handshake();
@@ -131,12 +139,16 @@ namespace videocore
         JobQueue            m_jobQueue;
         std::chrono::steady_clock::time_point m_sentKeyframe;
         
-#ifdef __APPLE__
-        dispatch_semaphore_t    m_networkWaitSemaphore;
-#else
-        std::condition_variable m_networkCond;
-        std::mutex              m_networkMutex;
-#endif
+        /*! A write on its way to the socket. */
+        struct PendingWrite {
+            std::shared_ptr<Buffer>                 buf;
+            size_t                                  size;
+            size_t                                  sent;
+            std::chrono::steady_clock::time_point   packetTime;
+        };
+        std::deque<PendingWrite> m_outgoing;    /*!< m_networkQueue only */
+        std::atomic<bool>       m_writeBlocked; /*!< flush() is waiting for space in the socket */
+        TimerId                 m_writeRetry;   /*!< m_networkQueue only */
         
         RingBuffer          m_streamOutRemainder;
         Buffer              m_s1, m_c1;
@@ -199,7 +199,8 @@ namespace videocore { namespace iOS {
                        inNumberFrames,
                        false,
                        false,
-                       shared_from_this());
+                       shared_from_this(),
+                       ChannelLayout::defaultForChannelCount(m_channelCount));
             
             output->pushBuffer(data, data_size, md);
         }
@@ -0,0 +1,170 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+
+#include <VideoCore/stream/BitrateController.h>
+
+#include <algorithm>
+
+namespace videocore {
+    
+    static const BitrateLadderStep kFallbackStep = { 0, 32000 };
+    
+    BitrateController::BitrateController(const BitrateControllerConfig& config)
+    : m_config(config)
+    {
+        reset(config.maxBitrate);
+    }
+    void
+    BitrateController::setConfig(const BitrateControllerConfig& config)
+    {
+        m_config = config;
+        m_videoBitrate = clamp(m_videoBitrate);
+        m_audioBitrate = audioFor(m_videoBitrate);
+    }
+    void
+    BitrateController::reset(int videoBitrate)
+    {
+        m_videoBitrate = clamp(videoBitrate);
+        m_audioBitrate = audioFor(m_videoBitrate);
+        m_direction = 0;
+        m_confirmations = 0;
+        m_consecutiveIncreases = 0;
+        m_hasDecreased = false;
+        m_lastDecrease = std::chrono::steady_clock::time_point();
+    }
+    void
+    BitrateController::applied(int videoBitrate)
+    {
+        m_videoBitrate = videoBitrate;
+        m_audioBitrate = audioFor(videoBitrate);
+    }
+    BitrateDecision
+    BitrateController::probe(float measuredBytesPerSecond, bool linkLimited)
+    {
+        int videoBitrate = m_config.maxBitrate;
+        if(linkLimited) {
+            // The probe measures everything that was sent, so audio comes out of the same budget.
+            const float budget = measuredBytesPerSecond * 8.f * m_config.probeHeadroom;
+            videoBitrate = int(budget * (1.f - std::max(0.f, std::min(m_config.audioShare, 1.f))));
+        }
+        m_direction = 0;
+        m_confirmations = 0;
+        m_consecutiveIncreases = 0;
+        
+        return decide(clamp(videoBitrate));
+    }
+    BitrateDecision
+    BitrateController::update(const ThroughputResult& result, std::chrono::steady_clock::time_point now)
+    {
+        if(result.vector == 0.f) {
+            // A neutral result breaks any run of confirmations.
+            m_direction = 0;
+            m_confirmations = 0;
+            return { m_videoBitrate, m_audioBitrate, false };
+        }
+        
+        const int direction = result.vector < 0 ? -1 : 1;
+        if(direction != m_direction) {
+            m_direction = direction;
+            m_confirmations = 0;
+        }
+        m_confirmations++;
+        
+        int videoBitrate = m_videoBitrate;
+        
+        if(direction < 0) {
+            if(m_confirmations < m_config.decreaseConfirmations) {
+                return { m_videoBitrate, m_audioBitrate, false };
+            }
+            const BitrateLadderStep& b = band(videoBitrate);
+            videoBitrate = (videoBitrate / b.step - 1) * b.step;
+            
+            if(m_config.decreaseToTarget && result.targetBytesPerSecond > 0.f) {
+                const int target = int(result.targetBytesPerSecond * 8.f * m_config.targetHeadroom) - m_audioBitrate;
+                videoBitrate = std::min(videoBitrate, target);
+            }
+            m_lastDecrease = now;
+            m_hasDecreased = true;
+            m_consecutiveIncreases = 0;
+        } else {
+            if(m_confirmations < m_config.increaseConfirmations) {
+                return { m_videoBitrate, m_audioBitrate, false };
+            }
+            if(m_hasDecreased && now - m_lastDecrease < std::chrono::milliseconds(m_config.increaseHoldoff)) {
+                return { m_videoBitrate, m_audioBitrate, false };
+            }
+            int rungs = 1;
+            if(m_config.rampUp == kRampUpExponential) {
+                rungs = std::min(1 << std::min(m_consecutiveIncreases, 16), std::max(m_config.maxRampRungs, 1));
+            }
+            for ( int i = 0 ; i < rungs ; ++i ) {
+                const BitrateLadderStep& b = band(videoBitrate);
+                videoBitrate = (videoBitrate / b.step + 1) * b.step;
+            }
+            m_consecutiveIncreases++;
+        }
+        m_confirmations = 0;
+        
+        return decide(clamp(videoBitrate));
+    }
+    const BitrateLadderStep&
+    BitrateController::band(int videoBitrate) const
+    {
+        for ( auto & b : m_config.ladder ) {
+            if(videoBitrate > b.above && b.step > 0) {
+                return b;
+            }
+        }
+        return m_config.ladder.empty() || m_config.ladder.back().step <= 0 ? kFallbackStep : m_config.ladder.back();
+    }
+    int
+    BitrateController::clamp(int videoBitrate) const
+    {
+        return std::max(std::min(videoBitrate, m_config.maxBitrate), m_config.minBitrate);
+    }
+    int
+    BitrateController::audioFor(int videoBitrate) const
+    {
+        if(m_config.audioShare <= 0.f || m_config.audioShare >= 1.f) {
+            return 0;
+        }
+        int audioBitrate = int(videoBitrate * m_config.audioShare / (1.f - m_config.audioShare));
+        if(m_config.audioStep > 0) {
+            audioBitrate -= audioBitrate % m_config.audioStep;
+        }
+        return std::max(std::min(audioBitrate, m_config.maxAudioBitrate), m_config.minAudioBitrate);
+    }
+    BitrateDecision
+    BitrateController::decide(int videoBitrate)
+    {
+        const int audioBitrate = audioFor(videoBitrate);
+        const bool changed = videoBitrate != m_videoBitrate || audioBitrate != m_audioBitrate;
+        
+        m_videoBitrate = videoBitrate;
+        m_audioBitrate = audioBitrate;
+        
+        return { videoBitrate, audioBitrate, changed };
+    }
+}
@@ -0,0 +1,143 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+#ifndef __videocore__BitrateController__
+#define __videocore__BitrateController__
+
+#include <VideoCore/stream/IThroughputAdaptation.h>
+
+#include <chrono>
+#include <vector>
+
+namespace videocore {
+    
+    /*!
+     *  One band of the bitrate ladder.  While the video bitrate is above `above` it moves in multiples of `step`.
+     */
+    struct BitrateLadderStep {
+        int above;  /*!< Lower bound of the band, exclusive [bits per second] */
+        int step;   /*!< Rung size inside the band [bits per second] */
+    };
+    
+    typedef enum {
+        kRampUpLinear,          /*!< One rung per increase */
+        kRampUpExponential      /*!< Rungs per increase double with each consecutive increase, up to maxRampRungs */
+    } RampUp_t;
+    
+    /*!
+     *  Rate control settings.  The defaults reproduce the ladder VCSimpleSession has always used: 384 kbps rungs
+     *  above 1152 kbps, 128 kbps above 512 kbps, 64 kbps above 128 kbps and 32 kbps below, one rung per decision.
+     */
+    struct BitrateControllerConfig {
+        BitrateControllerConfig()
+        : ladder({ { 1152000, 384000 }, { 512000, 128000 }, { 128000, 64000 }, { 0, 32000 } }),
+          minBitrate(32000), maxBitrate(1000000),
+          decreaseConfirmations(1), increaseConfirmations(1), increaseHoldoff(0),
+          rampUp(kRampUpLinear), maxRampRungs(4),
+          decreaseToTarget(false), targetHeadroom(0.85f), probeHeadroom(0.75f),
+          audioShare(0.f), minAudioBitrate(32000), maxAudioBitrate(128000), audioStep(16000)
+        {};
+        
+        std::vector<BitrateLadderStep> ladder;  /*!< Sorted from the highest band to the lowest */
+        
+        int     minBitrate;             /*!< Video bitrate floor [bits per second] */
+        int     maxBitrate;             /*!< Video bitrate ceiling [bits per second] */
+        
+        int     decreaseConfirmations;  /*!< Consecutive decrease results needed before stepping down */
+        int     increaseConfirmations;  /*!< Consecutive increase results needed before stepping up */
+        int64_t increaseHoldoff;        /*!< Milliseconds after a decrease during which increases are ignored */
+        
+        RampUp_t rampUp;
+        int      maxRampRungs;          /*!< Largest number of rungs climbed by one increase */
+        
+        bool    decreaseToTarget;       /*!< Step down straight to targetHeadroom of the estimator target when it is lower than one rung */
+        float   targetHeadroom;         /*!< Fraction of the estimator target usable by the encoders */
+        float   probeHeadroom;          /*!< Fraction of a link-limited probe result used as the starting bitrate */
+        
+        float   audioShare;             /*!< Share of the total bitrate given to audio.  0 leaves the audio bitrate alone. */
+        int     minAudioBitrate;
+        int     maxAudioBitrate;
+        int     audioStep;              /*!< Audio bitrates are rounded down to a multiple of this */
+    };
+    
+    struct BitrateDecision {
+        int  videoBitrate;
+        int  audioBitrate;      /*!< 0 when the controller does not manage audio */
+        bool changed;           /*!< true if either bitrate differs from the previous decision */
+    };
+    
+    /*!
+     *  Turns throughput adaptation results into encoder bitrates.
+     *
+     *  The controller keeps no clocks or threads of its own: every decision depends only on the results and the
+     *  times passed in, so the same sequence of results always yields the same sequence of bitrates.
+     */
+    class BitrateController
+    {
+    public:
+        BitrateController(const BitrateControllerConfig& config = BitrateControllerConfig());
+        
+        /*! Replace the configuration.  The current bitrate is clamped to the new limits. */
+        void setConfig(const BitrateControllerConfig& config);
+        const BitrateControllerConfig& config() const { return m_config; };
+        
+        /*! Forget all history and restart from videoBitrate. */
+        void reset(int videoBitrate);
+        
+        /*! The starting bitrate from the startup bandwidth probe. */
+        BitrateDecision probe(float measuredBytesPerSecond, bool linkLimited);
+        
+        /*! The next bitrate for a throughput result reported at `now`. */
+        BitrateDecision update(const ThroughputResult& result, std::chrono::steady_clock::time_point now);
+        
+        /*!
+         *  The video bitrate the encoder is actually running at.  Encoders may clamp or round a requested bitrate,
+         *  so the next decision steps from this rather than from the last one.  History is kept.
+         */
+        void applied(int videoBitrate);
+        
+        int videoBitrate() const { return m_videoBitrate; };
+        int audioBitrate() const { return m_audioBitrate; };
+        
+    private:
+        const BitrateLadderStep& band(int videoBitrate) const;
+        int  clamp(int videoBitrate) const;
+        int  audioFor(int videoBitrate) const;
+        BitrateDecision decide(int videoBitrate);
+        
+    private:
+        BitrateControllerConfig m_config;
+        
+        std::chrono::steady_clock::time_point m_lastDecrease;
+        
+        int  m_videoBitrate;
+        int  m_audioBitrate;
+        int  m_direction;           /*!< Sign of the pending run of results */
+        int  m_confirmations;       /*!< Length of the pending run of results */
+        int  m_consecutiveIncreases;
+        bool m_hasDecreased;
+    };
+}
+
+#endif
@@ -0,0 +1,151 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+
+#include <VideoCore/stream/BufferGrowthEstimator.h>
+
+namespace videocore {
+    
+    static const int   kPivotSamples = 5;
+    static const int   kMeasurementDelay = 2; // seconds - represents the time between measurements when increasing or decreasing bitrate
+    static const int   kSettlementDelay  = 30; // seconds - represents time to wait after a bitrate decrease before attempting to increase again
+    static const int   kIncreaseDelta    = 10; // seconds - number of seconds to wait between increase vectors (after initial ramp up)
+    static const int   kGrowthSamples    = 3;  // number of buffer size samples that vote on growth
+    
+    BufferGrowthEstimator::BufferGrowthEstimator()
+    : m_bwSampleCount(30), m_previousVector(0.f), m_hasFirstTurndown(false)
+    {
+    }
+    std::chrono::milliseconds
+    BufferGrowthEstimator::interval() const
+    {
+        return std::chrono::seconds(kMeasurementDelay);
+    }
+    void
+    BufferGrowthEstimator::seed(std::chrono::steady_clock::time_point now, float bytesPerSecond)
+    {
+        m_bwSamples.push_front(bytesPerSecond);
+        m_turnSamples.push_front(bytesPerSecond);
+        m_previousIncrease = now;
+    }
+    void
+    BufferGrowthEstimator::congestionEvent(std::chrono::steady_clock::time_point now, float /*targetBytesPerSecond*/)
+    {
+        // Treat it like a turndown so upward probing waits for the settlement delay.
+        m_hasFirstTurndown = true;
+        m_previousTurndown = now;
+        m_previousVector = -1.f;
+    }
+    void
+    BufferGrowthEstimator::reset()
+    {
+        m_bwSamples.clear();
+        m_buffGrowth.clear();
+        m_turnSamples.clear();
+        m_previousVector = 0.f;
+        m_hasFirstTurndown = false;
+    }
+    ThroughputResult
+    BufferGrowthEstimator::estimate(const ThroughputInterval& interval)
+    {
+        const auto now = interval.time;
+        const auto previousTurndownDiff = std::chrono::duration_cast<std::chrono::seconds>(now - m_previousTurndown).count();
+        const auto previousIncreaseDiff = std::chrono::duration_cast<std::chrono::seconds>(now - m_previousIncrease).count();
+        
+        const float detectedBytesPerSec  = float(interval.sentBytes) / interval.duration;
+        float vec = 0.f;
+        float turnAvg = 0.f;
+        ThroughputReason_t reason = kThroughputReasonNoData;
+        
+        m_bwSamples.push_front(detectedBytesPerSec);
+        if(m_bwSamples.size() > m_bwSampleCount) {
+            m_bwSamples.pop_back();
+        }
+        
+        if(interval.bufferSizeCount > 0) {
+            
+            m_buffGrowth.push_front(int(interval.bufferSizeLast));
+            if(m_buffGrowth.size() > kGrowthSamples) {
+                m_buffGrowth.pop_back();
+            }
+            
+            int buffGrowthAvg = 0;
+            int prevValue = 0;
+            for( auto & it : m_buffGrowth) {
+                buffGrowthAvg += (it > prevValue) ? -1 : (it < prevValue ? 1 : 0);
+                prevValue = it;
+            }
+            
+            if( buffGrowthAvg <= 0 && (!m_hasFirstTurndown || (previousTurndownDiff > kSettlementDelay && previousIncreaseDiff > kIncreaseDelta))) {
+                vec = 1.f;
+                reason = kThroughputReasonProbing;
+            } else if( buffGrowthAvg > 0.f ) {
+                vec = -1.f;
+                reason = kThroughputReasonQueueGrowing;
+                m_hasFirstTurndown = true;
+                m_previousTurndown = now;
+            } else {
+                vec = 0.f;
+                reason = kThroughputReasonSettling;
+            }
+            if(m_previousVector < 0 && vec >= 0) {
+                m_turnSamples.push_front(m_bwSamples.front());
+                if(m_turnSamples.size() > kPivotSamples) {
+                    m_turnSamples.pop_back();
+                }
+            }
+            
+            if(m_turnSamples.size() > 0) {
+                
+                for ( int i = 0 ; i < m_turnSamples.size() ; ++i ) {
+                    turnAvg += m_turnSamples[i];
+                }
+                turnAvg /= m_turnSamples.size();
+                
+            }
+            
+            if(detectedBytesPerSec > turnAvg) {
+                m_turnSamples.push_front(detectedBytesPerSec);
+                if(m_turnSamples.size() > kPivotSamples) {
+                    m_turnSamples.pop_back();
+                }
+            }
+            
+            m_previousVector = vec;
+            
+        }
+        
+        if(vec > 0.f) {
+            m_previousIncrease = now;
+        }
+        
+        ThroughputResult result;
+        result.vector = vec;
+        result.targetBytesPerSecond = turnAvg;
+        result.measuredBytesPerSecond = detectedBytesPerSec;
+        result.confidence = float(m_buffGrowth.size()) / float(kGrowthSamples);
+        result.reason = reason;
+        return result;
+    }
+}
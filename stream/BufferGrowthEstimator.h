@@ -0,0 +1,66 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+#ifndef __videocore__BufferGrowthEstimator__
+#define __videocore__BufferGrowthEstimator__
+
+#include <VideoCore/stream/IBandwidthEstimator.hpp>
+#include <deque>
+
+namespace videocore {
+    
+    /*!
+     *  The original VideoCore estimator.  Every two seconds it votes on whether the send buffer grew over the last
+     *  three samples.  A growing buffer asks for a decrease, a stable one for an increase after a settling period.
+     */
+    class BufferGrowthEstimator : public IBandwidthEstimator
+    {
+    public:
+        BufferGrowthEstimator();
+        
+        std::chrono::milliseconds interval() const;
+        
+        void seed(std::chrono::steady_clock::time_point now, float bytesPerSecond);
+        
+        ThroughputResult estimate(const ThroughputInterval& interval);
+        
+        void congestionEvent(std::chrono::steady_clock::time_point now, float targetBytesPerSecond);
+        
+        void reset();
+        
+    private:
+        std::chrono::steady_clock::time_point m_previousTurndown;
+        std::chrono::steady_clock::time_point m_previousIncrease;
+        
+        std::deque<float> m_bwSamples;
+        std::deque<int> m_buffGrowth;
+        std::deque<float> m_turnSamples;
+        
+        int   m_bwSampleCount;
+        float m_previousVector;
+        bool  m_hasFirstTurndown;
+    };
+}
+
+#endif
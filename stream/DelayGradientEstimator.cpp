@@ -0,0 +1,185 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+
+#include <VideoCore/stream/DelayGradientEstimator.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace videocore {
+    
+    static const int   kInterval        = 500;    // milliseconds between estimates
+    static const int   kWindowSize      = 10;     // number of delay points in the trendline
+    static const float kSmoothing       = 0.6f;   // weight of the previous smoothed delay
+    static const float kInitialThreshold = 12.5f; // ms of delay growth per second to be considered overuse
+    static const float kMinThreshold    = 6.f;
+    static const float kMaxThreshold    = 600.f;
+    static const float kThresholdUp     = 0.01f;  // threshold adaptation gain when the slope is above the threshold
+    static const float kThresholdDown   = 0.00018f; // ... and when it is below
+    static const float kDelayFloor      = 30.f;   // ms above the baseline delay before overuse can be signalled
+    static const float kDecreaseFactor  = 0.85f;
+    static const float kIncreaseFactor  = 1.08f;  // per second
+    static const float kMaxTargetRatio  = 1.5f;   // the target never runs further than this ahead of measured goodput
+    static const int   kIncreaseHoldoff = 2000;   // milliseconds between increase vectors, one buffer growth measurement
+    
+    DelayGradientEstimator::DelayGradientEstimator()
+    {
+        reset();
+    }
+    std::chrono::milliseconds
+    DelayGradientEstimator::interval() const
+    {
+        return std::chrono::milliseconds(kInterval);
+    }
+    void
+    DelayGradientEstimator::seed(std::chrono::steady_clock::time_point now, float bytesPerSecond)
+    {
+        m_target = bytesPerSecond;
+        m_previousStep = now;
+        m_hasPreviousStep = true;
+    }
+    void
+    DelayGradientEstimator::congestionEvent(std::chrono::steady_clock::time_point now, float targetBytesPerSecond)
+    {
+        m_target = std::min(m_target, targetBytesPerSecond);
+        m_previousStep = now;
+        m_hasPreviousStep = true;
+    }
+    void
+    DelayGradientEstimator::reset()
+    {
+        m_points.clear();
+        m_smoothedDelay = 0.f;
+        m_minDelay = -1.f;
+        m_threshold = kInitialThreshold;
+        m_target = 0.f;
+        m_hasStart = false;
+        m_hasPreviousStep = false;
+    }
+    ThroughputResult
+    DelayGradientEstimator::estimate(const ThroughputInterval& interval)
+    {
+        ThroughputResult result;
+        result.measuredBytesPerSecond = float(interval.sentBytes) / interval.duration;
+        result.vector = 0.f;
+        result.confidence = 0.f;
+        result.reason = kThroughputReasonNoData;
+        
+        if(!m_hasStart) {
+            m_start = interval.time;
+            m_hasStart = true;
+        }
+        const float t = float(std::chrono::duration_cast<std::chrono::milliseconds>(interval.time - m_start).count()) / 1.0e3f;
+        
+        float delay;
+        if(interval.bufferDurationCount > 0) {
+            delay = float(interval.bufferDurationSum) / float(interval.bufferDurationCount);
+        } else if(interval.bufferSizeMax > 0 && !m_points.empty()) {
+            // Data was queued but nothing made it out: the socket is stalled and delay grows with wall time.
+            delay = m_points.back().delay + interval.duration * 1.0e3f;
+        } else {
+            delay = 0.f;
+        }
+        
+        m_smoothedDelay = kSmoothing * m_smoothedDelay + (1.f - kSmoothing) * delay;
+        if(m_minDelay < 0.f || m_smoothedDelay < m_minDelay) {
+            m_minDelay = m_smoothedDelay;
+        }
+        
+        m_points.push_back({ t, m_smoothedDelay });
+        if(m_points.size() > kWindowSize) {
+            m_points.pop_front();
+        }
+        
+        if(m_target <= 0.f) {
+            m_target = result.measuredBytesPerSecond;
+        }
+        
+        if(m_points.size() < 2) {
+            result.targetBytesPerSecond = m_target;
+            return result;
+        }
+        
+        // Least squares fit of delay against time.
+        float meanT = 0.f, meanD = 0.f;
+        for ( auto & p : m_points ) {
+            meanT += p.time;
+            meanD += p.delay;
+        }
+        meanT /= m_points.size();
+        meanD /= m_points.size();
+        
+        float num = 0.f, denT = 0.f, denD = 0.f;
+        for ( auto & p : m_points ) {
+            num  += (p.time - meanT) * (p.delay - meanD);
+            denT += (p.time - meanT) * (p.time - meanT);
+            denD += (p.delay - meanD) * (p.delay - meanD);
+        }
+        const float slope = denT > 0.f ? num / denT : 0.f; // ms of delay per second
+        const float fit = (denT > 0.f && denD > 0.f) ? (num * num) / (denT * denD) : 0.f;
+        
+        // Adapt the threshold so that it follows the slope slowly from below and quickly from above.
+        const float absSlope = std::abs(slope);
+        if(absSlope < m_threshold + 15.f) {
+            const float k = absSlope < m_threshold ? kThresholdDown : kThresholdUp;
+            m_threshold += k * (absSlope - m_threshold) * interval.duration * 1.0e3f;
+            m_threshold = std::max(kMinThreshold, std::min(kMaxThreshold, m_threshold));
+        }
+        
+        const float windowFill = float(m_points.size()) / float(kWindowSize);
+        
+        if(slope > m_threshold && m_smoothedDelay > m_minDelay + kDelayFloor) {
+            m_target = std::min(m_target, result.measuredBytesPerSecond) * kDecreaseFactor;
+            result.vector = -1.f;
+            result.reason = kThroughputReasonQueueDelay;
+            result.confidence = std::max(fit, 0.5f) * windowFill;
+            m_previousStep = interval.time;
+            m_hasPreviousStep = true;
+        } else if(slope < -m_threshold) {
+            result.reason = kThroughputReasonQueueDraining;
+            result.confidence = fit * windowFill;
+        } else {
+            const float ceiling = std::max(result.measuredBytesPerSecond, 1.f) * kMaxTargetRatio;
+            if(m_target >= ceiling) {
+                // Already as far ahead of goodput as we allow; stepping the encoder up would only overshoot.
+                result.reason = kThroughputReasonDeliveryRate;
+            } else {
+                m_target = std::min(m_target * std::pow(kIncreaseFactor, interval.duration), ceiling);
+                result.reason = kThroughputReasonProbing;
+                
+                // The target grows every interval but the sender is only asked to step up once per holdoff,
+                // so each rung has time to show up in the delay trend before the next.
+                if(!m_hasPreviousStep || interval.time - m_previousStep >= std::chrono::milliseconds(kIncreaseHoldoff)) {
+                    result.vector = 1.f;
+                    m_previousStep = interval.time;
+                    m_hasPreviousStep = true;
+                }
+            }
+            result.confidence = (1.f - fit) * windowFill;
+        }
+        result.targetBytesPerSecond = m_target;
+        return result;
+    }
+}
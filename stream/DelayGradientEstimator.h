@@ -0,0 +1,70 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+#ifndef __videocore__DelayGradientEstimator__
+#define __videocore__DelayGradientEstimator__
+
+#include <VideoCore/stream/IBandwidthEstimator.hpp>
+#include <deque>
+
+namespace videocore {
+    
+    /*!
+     *  Estimates congestion from the trend of the queueing delay, in the spirit of the trendline filter used by
+     *  Google Congestion Control.  The smoothed queueing delay is fitted with a line over a sliding window; a slope
+     *  above an adaptive threshold is treated as overuse and the target drops below the measured goodput, otherwise
+     *  the target grows multiplicatively.
+     */
+    class DelayGradientEstimator : public IBandwidthEstimator
+    {
+    public:
+        DelayGradientEstimator();
+        
+        std::chrono::milliseconds interval() const;
+        
+        void seed(std::chrono::steady_clock::time_point now, float bytesPerSecond);
+        
+        ThroughputResult estimate(const ThroughputInterval& interval);
+        
+        void congestionEvent(std::chrono::steady_clock::time_point now, float targetBytesPerSecond);
+        
+        void reset();
+        
+    private:
+        struct DelayPoint { float time; float delay; };
+        
+        std::chrono::steady_clock::time_point m_start;
+        std::chrono::steady_clock::time_point m_previousStep; /*!< Last increase or decrease asked of the sender */
+        std::deque<DelayPoint> m_points;
+        
+        float m_smoothedDelay;
+        float m_minDelay;
+        float m_threshold;
+        float m_target;
+        bool  m_hasStart;
+        bool  m_hasPreviousStep;
+    };
+}
+
+#endif
@@ -0,0 +1,145 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+
+#include <VideoCore/stream/DeliveryRateEstimator.h>
+
+#include <algorithm>
+
+namespace videocore {
+    
+    static const int    kInterval       = 500;  // milliseconds between estimates, one pacing "round"
+    static const int    kBtlBwWindow    = 10;   // rounds - window of the max delivery rate filter
+    static const int    kMinDelayWindow = 10;   // seconds - window of the min queueing delay filter
+    static const float  kStandingDelay  = 200.f; // ms above the baseline delay that counts as a standing queue
+    static const float  kDrainGain      = 0.75f;
+    static const float  kDeadband       = 0.05f; // relative target change below which the vector is 0
+    static const size_t kAppLimitedQueue = 1024; // bytes - below this the sender, not the link, limited the rate
+    static const float  kPacingGains[]  = { 1.25f, 0.75f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f };
+    static const int    kPacingCycle    = sizeof(kPacingGains) / sizeof(kPacingGains[0]);
+    
+    DeliveryRateEstimator::DeliveryRateEstimator()
+    {
+        reset();
+    }
+    std::chrono::milliseconds
+    DeliveryRateEstimator::interval() const
+    {
+        return std::chrono::milliseconds(kInterval);
+    }
+    void
+    DeliveryRateEstimator::seed(std::chrono::steady_clock::time_point now, float bytesPerSecond)
+    {
+        m_rateSamples.push_back({ now, bytesPerSecond });
+        m_btlBw = std::max(m_btlBw, bytesPerSecond);
+    }
+    void
+    DeliveryRateEstimator::congestionEvent(std::chrono::steady_clock::time_point /*now*/, float targetBytesPerSecond)
+    {
+        // The link can no longer carry what the window remembers; without the cap the next estimate() would
+        // rebuild the old maximum and probe straight back up.
+        for ( auto & s : m_rateSamples ) {
+            s.rate = std::min(s.rate, targetBytesPerSecond);
+        }
+        m_btlBw = std::min(m_btlBw, targetBytesPerSecond);
+        
+        // Skip the rest of the probe cycle and cruise until the next one.
+        m_cycleIndex = 2;
+    }
+    void
+    DeliveryRateEstimator::reset()
+    {
+        m_rateSamples.clear();
+        m_delaySamples.clear();
+        m_btlBw = 0.f;
+        m_cycleIndex = 0;
+    }
+    ThroughputResult
+    DeliveryRateEstimator::estimate(const ThroughputInterval& interval)
+    {
+        const auto now = interval.time;
+        const float deliveryRate = float(interval.sentBytes) / interval.duration;
+        const bool appLimited = interval.bufferSizeMax < kAppLimitedQueue;
+        
+        ThroughputResult result;
+        result.measuredBytesPerSecond = deliveryRate;
+        
+        // An application limited sample only tells us the link can do at least this much.
+        if(!appLimited || deliveryRate > m_btlBw) {
+            m_rateSamples.push_back({ now, deliveryRate });
+        }
+        while(m_rateSamples.size() > kBtlBwWindow) {
+            m_rateSamples.pop_front();
+        }
+        m_btlBw = 0.f;
+        for ( auto & s : m_rateSamples ) {
+            m_btlBw = std::max(m_btlBw, s.rate);
+        }
+        
+        float delay = -1.f;
+        if(interval.bufferDurationCount > 0) {
+            delay = float(interval.bufferDurationSum) / float(interval.bufferDurationCount);
+            m_delaySamples.push_back({ now, float(interval.bufferDurationMin) });
+        }
+        while(!m_delaySamples.empty() && now - m_delaySamples.front().time > std::chrono::seconds(kMinDelayWindow)) {
+            m_delaySamples.pop_front();
+        }
+        float minDelay = -1.f;
+        for ( auto & s : m_delaySamples ) {
+            minDelay = (minDelay < 0.f) ? s.delay : std::min(minDelay, s.delay);
+        }
+        
+        if(m_btlBw <= 0.f) {
+            result.vector = 0.f;
+            result.targetBytesPerSecond = 0.f;
+            result.confidence = 0.f;
+            result.reason = kThroughputReasonNoData;
+            return result;
+        }
+        
+        float target;
+        if(delay >= 0.f && minDelay >= 0.f && delay > minDelay + kStandingDelay) {
+            target = m_btlBw * kDrainGain;
+            result.reason = kThroughputReasonQueueDelay;
+            m_cycleIndex = 0;
+        } else {
+            target = m_btlBw * kPacingGains[m_cycleIndex];
+            result.reason = kThroughputReasonDeliveryRate;
+            m_cycleIndex = (m_cycleIndex + 1) % kPacingCycle;
+        }
+        
+        // The vector tells the sender which side of the target its current rate is on.
+        if(target > deliveryRate * (1.f + kDeadband)) {
+            result.vector = 1.f;
+        } else if(target < deliveryRate * (1.f - kDeadband)) {
+            result.vector = -1.f;
+        } else {
+            result.vector = 0.f;
+        }
+        
+        result.targetBytesPerSecond = target;
+        result.confidence = float(m_rateSamples.size()) / float(kBtlBwWindow);
+        return result;
+    }
+}
@@ -0,0 +1,66 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+#ifndef __videocore__DeliveryRateEstimator__
+#define __videocore__DeliveryRateEstimator__
+
+#include <VideoCore/stream/IBandwidthEstimator.hpp>
+#include <deque>
+
+namespace videocore {
+    
+    /*!
+     *  A BBR-style estimator.  The bottleneck bandwidth is the windowed maximum of the delivery rate over intervals
+     *  in which the sender was not application limited, and the queueing delay baseline (standing in for the minimum
+     *  RTT, which is not visible through the stream session) is the windowed minimum of the queueing delay.  The
+     *  target cycles a pacing gain around the bottleneck bandwidth and drains whenever a standing queue builds.
+     */
+    class DeliveryRateEstimator : public IBandwidthEstimator
+    {
+    public:
+        DeliveryRateEstimator();
+        
+        std::chrono::milliseconds interval() const;
+        
+        void seed(std::chrono::steady_clock::time_point now, float bytesPerSecond);
+        
+        ThroughputResult estimate(const ThroughputInterval& interval);
+        
+        void congestionEvent(std::chrono::steady_clock::time_point now, float targetBytesPerSecond);
+        
+        void reset();
+        
+    private:
+        struct RateSample  { std::chrono::steady_clock::time_point time; float rate; };
+        struct DelaySample { std::chrono::steady_clock::time_point time; float delay; };
+        
+        std::deque<RateSample>  m_rateSamples;
+        std::deque<DelaySample> m_delaySamples;
+        
+        float m_btlBw;
+        int   m_cycleIndex;
+    };
+}
+
+#endif
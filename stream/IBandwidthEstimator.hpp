@@ -0,0 +1,79 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+#ifndef videocore_IBandwidthEstimator_hpp
+#define videocore_IBandwidthEstimator_hpp
+
+#include <VideoCore/stream/IThroughputAdaptation.h>
+#include <chrono>
+
+namespace videocore {
+    
+    /*!
+     *  Samples collected by an IThroughputAdaptation over one measurement interval.
+     */
+    struct ThroughputInterval {
+        std::chrono::steady_clock::time_point time; /*!< End of the interval */
+        float       duration;                       /*!< Length of the interval, in seconds */
+        
+        size_t      sentBytes;                      /*!< Bytes written to the socket */
+        
+        size_t      bufferSizeLast;                 /*!< Bytes waiting to be sent, most recent sample */
+        size_t      bufferSizeMin;
+        size_t      bufferSizeMax;
+        size_t      bufferSizeSum;
+        int         bufferSizeCount;
+        
+        int64_t     bufferDurationLast;             /*!< Queueing delay in milliseconds, most recent sample */
+        int64_t     bufferDurationMin;
+        int64_t     bufferDurationMax;
+        int64_t     bufferDurationSum;
+        int         bufferDurationCount;
+    };
+    
+    /*!
+     *  IBandwidthEstimator interface.  Turns the samples for one measurement interval into a ThroughputResult.
+     *  Estimators are driven from a single thread and do not need to be thread-safe.
+     */
+    class IBandwidthEstimator
+    {
+    public:
+        virtual ~IBandwidthEstimator() {};
+        
+        /*! The time the estimator would like between calls to estimate() */
+        virtual std::chrono::milliseconds interval() const = 0;
+        
+        /*! Seed the estimator with the result of the startup bandwidth probe [Bytes per second] */
+        virtual void seed(std::chrono::steady_clock::time_point now, float bytesPerSecond) = 0;
+        
+        virtual ThroughputResult estimate(const ThroughputInterval& interval) = 0;
+        
+        /*! The fast reaction path asked the sender to drop to targetBytesPerSecond outside of estimate() */
+        virtual void congestionEvent(std::chrono::steady_clock::time_point now, float targetBytesPerSecond) = 0;
+        
+        virtual void reset() = 0;
+    };
+}
+
+#endif
@@ -26,12 +26,69 @@
 #define __videocore__IThroughputAdaptation__
 
 #include <functional>
+#include <chrono>
+#include <stdint.h>
+#include <stddef.h>
 #include <VideoCore/system/util.h>
 
 namespace videocore {
     
     using ThroughputCallback = std::function<void(float bitrateRecommendedVector, float predictedBytesPerSecond, int immediateBytesPerSecond)>;
     
+    /*! The bandwidth estimation algorithm used by an IThroughputAdaptation */
+    typedef enum {
+        kBandwidthEstimatorBufferGrowth,    /*!< Votes on the growth of the send buffer. The original VideoCore estimator. */
+        kBandwidthEstimatorDelayGradient,   /*!< Follows the trend of the queueing delay. */
+        kBandwidthEstimatorDeliveryRate     /*!< BBR-style windowed max delivery rate and min queueing delay. */
+    } BandwidthEstimator_t;
+    
+    /*! Why an estimator produced a ThroughputResult */
+    typedef enum {
+        kThroughputReasonNoData,            /*!< Not enough samples to make a decision. */
+        kThroughputReasonQueueGrowing,      /*!< The send buffer is growing. */
+        kThroughputReasonQueueDelay,        /*!< Queueing delay is rising or above its baseline. */
+        kThroughputReasonQueueDraining,     /*!< Queueing delay is falling, holding while it drains. */
+        kThroughputReasonSettling,          /*!< Waiting after a decrease before probing upwards again. */
+        kThroughputReasonProbing,           /*!< The link looks clear, probing upwards. */
+        kThroughputReasonDeliveryRate,      /*!< The target follows the measured delivery rate. */
+        kThroughputReasonCongestion         /*!< The fast reaction path saw the queue cross a threshold. */
+    } ThroughputReason_t;
+    
+    /*!
+     *  The decision made by an estimator for one measurement interval.
+     */
+    struct ThroughputResult {
+        float               vector;                 /*!< -1 to decrease the bitrate, 0 for no change, 1 to increase. */
+        float               targetBytesPerSecond;   /*!< The rate the estimator would like the sender to use [Bytes per second]. */
+        float               measuredBytesPerSecond; /*!< The goodput measured during the interval [Bytes per second]. */
+        float               confidence;             /*!< 0 to 1, how much the estimator trusts this result. */
+        ThroughputReason_t  reason;
+    };
+    
+    using ThroughputResultCallback = std::function<void(const ThroughputResult& result)>;
+    
+    /*!
+     *  Thresholds for the fast congestion reaction.  When the queueing delay of a packet or the growth of the send
+     *  buffer crosses a threshold, a decrease is reported immediately instead of waiting for the next measurement.
+     */
+    struct FastReactionConfig {
+        FastReactionConfig() : enabled(true), queueDurationThreshold(500), bufferGrowthThreshold(256 * 1024), minInterval(1000) {};
+        
+        bool    enabled;
+        int64_t queueDurationThreshold;     /*!< Queueing delay, in milliseconds, that triggers a decrease. 0 disables. */
+        size_t  bufferGrowthThreshold;      /*!< Send buffer growth, in bytes since the previous decision, that triggers a decrease. 0 disables. */
+        int64_t minInterval;                /*!< Minimum time, in milliseconds, between two fast decreases. */
+    };
+    
+    /*!
+     *  Called once when the startup bandwidth probe completes.
+     *
+     *  \param measuredBytesPerSecond  The goodput measured during the probe [Bytes per second].
+     *  \param linkLimited             true if the socket was the bottleneck during the probe.  If false the
+     *                                 sender never filled the link and the measurement is only a lower bound.
+     */
+    using ProbeCallback = std::function<void(float measuredBytesPerSecond, bool linkLimited)>;
+    
     
     class IThroughputAdaptation {
     public:
@@ -39,16 +96,45 @@ namespace videocore {
         
         virtual void setThroughputCallback(ThroughputCallback callback) = 0;
         
+        virtual void setProbeCallback(ProbeCallback callback) = 0;
+        
+        virtual void setThroughputResultCallback(ThroughputResultCallback callback) = 0;
+        
+        /*! Select the algorithm used to turn samples into a ThroughputResult. */
+        virtual void setEstimator(BandwidthEstimator_t estimator) = 0;
+        
+        virtual void setFastReactionConfig(const FastReactionConfig& config) = 0;
+        
         virtual void addSentBytesSample(size_t bytesSent) = 0;
         
         virtual void addBufferSizeSample(size_t bufferSize) = 0;
         
+        /*! The time, in milliseconds, a packet spent queued before it was written to the socket. */
         virtual void addBufferDurationSample(int64_t bufferDuration) = 0;
         
         virtual void reset() = 0;
         
         virtual void start() = 0;
     };
+    
+    /*!
+     *  An IThroughputAdaptation that can also be driven by a virtual clock, for offline simulation.
+     */
+    class IVirtualTimeAdaptation : public IThroughputAdaptation {
+    public:
+        virtual ~IVirtualTimeAdaptation() {};
+        
+        /*!
+         *  Start without a sampling thread.  Time only moves when advance() is called, so the adaptation can be
+         *  run against a virtual clock faster than realtime.
+         *
+         *  \param now  The virtual start time.
+         */
+        virtual void startVirtual(std::chrono::steady_clock::time_point now) = 0;
+        
+        /*! Run any measurement or fast reaction due at the virtual time now.  Only valid after startVirtual(). */
+        virtual void advance(std::chrono::steady_clock::time_point now) = 0;
+    };
 }
 
 #endif
@@ -0,0 +1,133 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+#ifndef videocore_IntervalAccumulator_hpp
+#define videocore_IntervalAccumulator_hpp
+
+#include <atomic>
+#include <limits>
+#include <thread>
+#include <stdint.h>
+
+namespace videocore {
+    
+    /*!
+     *  Summary of the samples added to an IntervalAccumulator since the previous collect().
+     */
+    template<typename T>
+    struct IntervalSummary {
+        T       sum;
+        T       min;
+        T       max;
+        T       last;
+        int64_t count;
+    };
+    
+    /*!
+     *  Fixed-size accumulator for a stream of samples that is summarised once per measurement interval.
+     *
+     *  add() may be called from any number of threads and never locks or allocates.  collect() must only be called
+     *  from a single thread; it swaps the two banks of counters and waits for writers still using the old bank, so
+     *  every sample lands in exactly one summary and sum, count, min and max always describe the same samples.
+     */
+    template<typename T>
+    class IntervalAccumulator
+    {
+    public:
+        IntervalAccumulator() : m_active(0) {
+            m_banks[0].writers.store(0);
+            m_banks[1].writers.store(0);
+            m_banks[0].clear();
+            m_banks[1].clear();
+        }
+        
+        void add(T value) {
+            for(;;) {
+                const int idx = m_active.load();
+                Bank& bank = m_banks[idx];
+                bank.writers.fetch_add(1);
+                if(m_active.load() != idx) {
+                    // collect() swapped banks under us, use the new one.
+                    bank.writers.fetch_sub(1);
+                    continue;
+                }
+                bank.count.fetch_add(1, std::memory_order_relaxed);
+                bank.sum.fetch_add(value, std::memory_order_relaxed);
+                
+                T prev = bank.min.load(std::memory_order_relaxed);
+                while(value < prev && !bank.min.compare_exchange_weak(prev, value, std::memory_order_relaxed)) {}
+                prev = bank.max.load(std::memory_order_relaxed);
+                while(value > prev && !bank.max.compare_exchange_weak(prev, value, std::memory_order_relaxed)) {}
+                
+                bank.last.store(value, std::memory_order_relaxed);
+                bank.writers.fetch_sub(1, std::memory_order_release);
+                return;
+            }
+        }
+        
+        /*! Summarise and reset the samples added since the previous call. Single consumer only. */
+        IntervalSummary<T> collect() {
+            const int idx = m_active.load();
+            m_active.store(idx ^ 1);
+            
+            Bank& bank = m_banks[idx];
+            while(bank.writers.load(std::memory_order_acquire) != 0) {
+                std::this_thread::yield();
+            }
+            
+            IntervalSummary<T> summary;
+            summary.count = bank.count.load(std::memory_order_relaxed);
+            summary.sum   = bank.sum.load(std::memory_order_relaxed);
+            summary.min   = summary.count ? bank.min.load(std::memory_order_relaxed) : T(0);
+            summary.max   = summary.count ? bank.max.load(std::memory_order_relaxed) : T(0);
+            summary.last  = summary.count ? bank.last.load(std::memory_order_relaxed) : T(0);
+            bank.clear();
+            return summary;
+        }
+        
+    private:
+        struct alignas(64) Bank {
+            std::atomic<int>     writers;
+            std::atomic<int64_t> count;
+            std::atomic<T>       sum;
+            std::atomic<T>       min;
+            std::atomic<T>       max;
+            std::atomic<T>       last;
+            
+            // Leaves writers alone: a late writer may still be backing out of this bank.
+            void clear() {
+                count.store(0, std::memory_order_relaxed);
+                sum.store(T(0), std::memory_order_relaxed);
+                min.store(std::numeric_limits<T>::max(), std::memory_order_relaxed);
+                max.store(std::numeric_limits<T>::lowest(), std::memory_order_relaxed);
+                last.store(T(0), std::memory_order_relaxed);
+            }
+        };
+        
+        Bank             m_banks[2];
+        std::atomic<int> m_active;
+    };
+}
+
+#endif
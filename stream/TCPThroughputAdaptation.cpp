@@ -24,64 +24,51 @@
  */
 
 #include <VideoCore/stream/TCPThroughputAdaptation.h>
+#include <VideoCore/stream/BufferGrowthEstimator.h>
+#include <VideoCore/stream/DelayGradientEstimator.h>
+#include <VideoCore/stream/DeliveryRateEstimator.h>
 
 #include <chrono>
 #include <cmath>
+#include <algorithm>
 #include <stdlib.h>
 
 namespace videocore {
     
-    //static const float kPI_2 = M_PI_2;
-    static const float kWeight = 0.75f;
-    static const int   kPivotSamples = 5;
-    static const int   kMeasurementDelay = 2; // seconds - represents the time between measurements when increasing or decreasing bitrate
-    static const int   kSettlementDelay  = 30; // seconds - represents time to wait after a bitrate decrease before attempting to increase again
-    static const int   kIncreaseDelta    = 10; // seconds - number of seconds to wait between increase vectors (after initial ramp up)
-    //static const int   kNegativeSampleThreshold = 0; // number of negative samples in a row to call for a decrease
+    static const int   kProbeInterval    = 250;  // milliseconds - time between measurements while the startup probe is running
+    static const int   kProbeDuration    = 2000; // milliseconds - maximum length of the startup probe
+    static const size_t kProbeQueueThreshold = 16 * 1024;  // bytes - queued bytes above which an interval is considered link-limited
+    static const size_t kProbeMaxQueue       = 256 * 1024; // bytes - end the probe early once this much data is waiting to be sent
+    static const float kFastDecrease     = 0.85f; // fraction of the recent goodput targeted by a fast reaction
     
-    template<typename T>
-    static inline T mode(std::deque<T>& array) {
-        T number = array[0];
-        T mode = number;
-        int count = 1;
-        int countMode = 1;
-        
-        for (int i=1; i< array.size(); i++)
-        {
-            if (array[i] == number)
-            { // count occurrences of the current number
-                countMode++;
-            }
-            else
-            { // now this is a different number
-                if (count > countMode)
-                {
-                    countMode = count; // mode is the biggest ocurrences
-                    mode = number;
-                }
-                count = 1; // reset count for the new number
-                number = array[i];
-            }
+    static IBandwidthEstimator* createEstimator(BandwidthEstimator_t estimator)
+    {
+        switch(estimator) {
+            case kBandwidthEstimatorDelayGradient:
+                return new DelayGradientEstimator();
+            case kBandwidthEstimatorDeliveryRate:
+                return new DeliveryRateEstimator();
+            case kBandwidthEstimatorBufferGrowth:
+            default:
+                return new BufferGrowthEstimator();
         }
-        return mode;
     }
     
-    TCPThroughputAdaptation::TCPThroughputAdaptation()
-    : m_callback(nullptr), m_exiting(false), m_hasFirstTurndown(false), m_bwSampleCount(30), m_previousVector(0.f), m_started(false), m_negSampleCount(0)
+    TCPThroughputAdaptation::TCPThroughputAdaptation(BandwidthEstimator_t estimator)
+    : m_estimator(createEstimator(estimator)), m_callback(nullptr), m_resultCallback(nullptr), m_probeCallback(nullptr), m_probeSentBytes(0), m_probeLimitedBytes(0), m_probeLimitedTime(0.f), m_fastSentBytes(0), m_latestBufferSize(0), m_growthReference(0), m_fastTriggered(false), m_resetPending(false), m_exiting(false), m_running(false), m_started(false), m_probing(false), m_timer(0), m_queue("com.videocore.tcp.adaptation")
     {
-        float v = (1.f - powf(kWeight, m_bwSampleCount)) / (1.f - kWeight) ;
-        for ( int i = 0 ; i < m_bwSampleCount ; ++i ) {
-            m_bwWeights.push_back(powf(kWeight, i) / v);
-        }
-        
+        setFastReactionConfig(FastReactionConfig());
     }
     TCPThroughputAdaptation::~TCPThroughputAdaptation()
     {
         m_exiting = true;
-        m_cond.notify_all();
-        if(m_started) {
-            m_thread.join();
-        }
+        m_queue.mark_exiting();
+        m_queue.enqueue_sync([this]() {
+            if(m_timer) {
+                m_queue.cancel(m_timer);
+                m_timer = 0;
+            }
+        });
     }
     
     void
@@ -90,174 +77,263 @@ namespace videocore {
         m_callback = callback;
     }
     void
+    TCPThroughputAdaptation::setProbeCallback(ProbeCallback callback)
+    {
+        m_probeCallback = callback;
+    }
+    void
+    TCPThroughputAdaptation::setThroughputResultCallback(ThroughputResultCallback callback)
+    {
+        m_resultCallback = callback;
+    }
+    void
+    TCPThroughputAdaptation::setEstimator(BandwidthEstimator_t estimator)
+    {
+        std::lock_guard<std::mutex> l(m_estimatorMutex);
+        m_estimator.reset(createEstimator(estimator));
+    }
+    void
+    TCPThroughputAdaptation::setFastReactionConfig(const FastReactionConfig& config)
+    {
+        m_fastQueueThreshold = config.queueDurationThreshold;
+        m_fastGrowthThreshold = int64_t(config.bufferGrowthThreshold);
+        m_fastMinInterval = config.minInterval;
+        m_fastEnabled = config.enabled;
+    }
+    void
     TCPThroughputAdaptation::reset()
     {
-        m_bufferSizeSamples.clear();
+        // Only the sampling job may drain the accumulators, so ask it to drop the buffer samples.
+        m_resetPending = true;
     }
     void
     TCPThroughputAdaptation::start() {
         if(!m_started) {
             m_started = true;
-            m_thread = std::thread([&]{
-                this->sampleThread();
-            });
+            begin(std::chrono::steady_clock::now());
+            m_running = true;
+            m_queue.enqueue([this]() { schedule(); });
+        }
+    }
+    void
+    TCPThroughputAdaptation::startVirtual(std::chrono::steady_clock::time_point now)
+    {
+        if(!m_started) {
+            m_started = true;
+            begin(now);
         }
     }
     void
-    TCPThroughputAdaptation::sampleThread()
+    TCPThroughputAdaptation::begin(std::chrono::steady_clock::time_point now)
+    {
+        m_probing = true;
+        m_probeStart = now;
+        m_previousSample = now;
+        m_nextSample = now + std::chrono::milliseconds(kProbeInterval);
+        m_fastMark = now;
+        m_lastFastReaction = now - std::chrono::milliseconds(m_fastMinInterval.load());
+    }
+    void
+    TCPThroughputAdaptation::advance(std::chrono::steady_clock::time_point now)
     {
-        std::mutex m;
-        auto prev = std::chrono::steady_clock::now();
-        //char* home = getenv("HOME");
-        //char* folder = "/Library/Documents";
+        if(fastReactionDue(now)) {
+            fastReaction(now);
+        }
         
-        pthread_setname_np("com.videocore.tcp.adaptation");
-        while(!m_exiting) {
-            std::unique_lock<std::mutex> l(m);
-            
-            
-            if(!m_exiting) {
-                m_cond.wait_until(l, std::chrono::steady_clock::now() + std::chrono::seconds(kMeasurementDelay));
-            }
-            if(m_exiting) {
-                break;
-            }
-            
-            auto now = std::chrono::steady_clock::now();
-            auto diff = now - prev;
-            auto previousTurndownDiff = std::chrono::duration_cast<std::chrono::seconds>(now - m_previousTurndown).count();
-            auto previousIncreaseDiff = std::chrono::duration_cast<std::chrono::seconds>(now - m_previousIncrease).count();
-            prev = now;
-            
-            m_sentMutex.lock();
-            m_buffMutex.lock();
-            
-            size_t totalSent = 0;
-            
-            for ( auto & samp : m_sentSamples )
-            {
-                totalSent += samp;
-            }
-            
-            const float timeDelta            = float(std::chrono::duration_cast<std::chrono::microseconds>(diff).count()) / 1.0e6f;
-            const float detectedBytesPerSec  = float(totalSent) / timeDelta;
-            float vec = 0.f;
-            float turnAvg = 0.f;
+        if(now >= m_nextSample) {
+            sample(now, m_previousSample);
+            m_previousSample = now;
             
-            m_bwSamples.push_front(detectedBytesPerSec);
-            if(m_bwSamples.size() > m_bwSampleCount) {
-                m_bwSamples.pop_back();
+            std::chrono::milliseconds delay(kProbeInterval);
+            if(!m_probing) {
+                std::lock_guard<std::mutex> el(m_estimatorMutex);
+                delay = m_estimator->interval();
             }
-            
-            if(!m_bufferSizeSamples.empty()) {
-                
-
-                /*float frontAvg = 0.f;
-                float backAvg = 0.f;
-                int frontCount = 0;
-                int backCount = 0;
-                
-                for (int i = 0 ; i < m_bufferSizeSamples.size() ; ++i) {
-                    const float s1 = m_bufferSizeSamples[i] / 100.f;
-                    // if(s1>0) noBuffer = false;
-                    
-                    if ( i < m_bufferSizeSamples.size() / 2 ) {
-                        frontAvg += s1;
-                        frontCount++;
-                    } else {
-                        backAvg += s1;
-                        backCount++;
-                    }
-                }
-                frontAvg /= float(frontCount);
-                backAvg /= float(backCount);
-                
-                frontAvg = std::floor(frontAvg);
-                backAvg = std::floor(backAvg);*/
-                
-                m_buffGrowth.push_front(int(m_bufferSizeSamples.back()));
-                if(m_buffGrowth.size() > 3) {
-                    m_buffGrowth.pop_back();
-                }
-                
-                int buffGrowthAvg = 0;
-                int prevValue = 0;
-                for( auto & it : m_buffGrowth) {
-                    buffGrowthAvg += (it > prevValue) ? -1 : (it < prevValue ? 1 : 0);
-                    prevValue = it;
-                }
-                
-                if( buffGrowthAvg <= 0 && (!m_hasFirstTurndown || (previousTurndownDiff > kSettlementDelay && previousIncreaseDiff > kIncreaseDelta))) {
-                    vec = 1.f;
-                } else if( buffGrowthAvg > 0.f ) {
-                    vec = -1.f;
-                    m_hasFirstTurndown = true;
-                    m_previousTurndown = now;
-                } else {
-                    vec = 0.f;
-                }
-                if(m_previousVector < 0 && vec >= 0) {
-                    m_turnSamples.push_front(m_bwSamples.front());
-                    if(m_turnSamples.size() > kPivotSamples) {
-                        m_turnSamples.pop_back();
-                    }
-                }
-                
-                if(m_turnSamples.size() > 0) {
-                    
-                    
-                    for ( int i = 0 ; i < m_turnSamples.size() ; ++i ) {
-                        turnAvg += m_turnSamples[i];
-                    }
-                    turnAvg /= m_turnSamples.size();
-                    
-                }
-                
-                if(detectedBytesPerSec > turnAvg) {
-                    m_turnSamples.push_front(detectedBytesPerSec);
-                    if(m_turnSamples.size() > kPivotSamples) {
-                        m_turnSamples.pop_back();
-                    }
-                }
-                
-                m_previousVector = vec;
-                
+            // From the last deadline rather than now, so that wakeup latency does not stretch every interval.
+            m_nextSample += delay;
+            if(m_nextSample <= now) {
+                m_nextSample = now + delay;
             }
-            m_sentSamples.clear();
-            m_bufferSizeSamples.clear();
-            m_bufferDurationSamples.clear();
-            m_sentMutex.unlock();
-            m_buffMutex.unlock();
-            
-            if(m_callback) {
-                if(vec > 0.f) {
-                    m_previousIncrease = now;
-                }
-                m_callback(vec, turnAvg, detectedBytesPerSec);
+        }
+    }
+    void
+    TCPThroughputAdaptation::schedule()
+    {
+        if(m_exiting) {
+            return;
+        }
+        const auto now = std::chrono::steady_clock::now();
+        advance(now);
+        
+        // A trigger held back by the rate limit brings the timer forward to when the limit expires.  A new trigger
+        // runs this straight away so the time can be recomputed.
+        auto wakeTime = m_nextSample;
+        if(m_fastTriggered && m_fastEnabled && !m_probing) {
+            wakeTime = std::min(wakeTime, m_lastFastReaction + std::chrono::milliseconds(m_fastMinInterval.load()));
+        }
+        if(m_timer) {
+            m_queue.cancel(m_timer);
+        }
+        m_timer = m_queue.enqueue_at(wakeTime, [this]() { schedule(); });
+    }
+    void
+    TCPThroughputAdaptation::sample(std::chrono::steady_clock::time_point now, std::chrono::steady_clock::time_point prev)
+    {
+        ThroughputInterval interval = {};
+        interval.time = now;
+        interval.duration = float(std::chrono::duration_cast<std::chrono::microseconds>(now - prev).count()) / 1.0e6f;
+        
+        const auto sent = m_sentSamples.collect();
+        const auto bufferSize = m_bufferSizeSamples.collect();
+        const auto bufferDuration = m_bufferDurationSamples.collect();
+        
+        interval.sentBytes = size_t(sent.sum);
+        
+        if(!m_resetPending.exchange(false)) {
+            interval.bufferSizeLast = size_t(bufferSize.last);
+            interval.bufferSizeMin = size_t(bufferSize.min);
+            interval.bufferSizeMax = size_t(bufferSize.max);
+            interval.bufferSizeSum = size_t(bufferSize.sum);
+            interval.bufferSizeCount = int(bufferSize.count);
+        }
+        
+        interval.bufferDurationLast = bufferDuration.last;
+        interval.bufferDurationMin = bufferDuration.min;
+        interval.bufferDurationMax = bufferDuration.max;
+        interval.bufferDurationSum = bufferDuration.sum;
+        interval.bufferDurationCount = int(bufferDuration.count);
+        
+        // Growth for the fast path is measured from the last decision.
+        m_growthReference = m_latestBufferSize.load();
+        m_fastSentBytes = 0;
+        m_fastMark = now;
+        
+        if(m_probing) {
+            m_probing = !probeSample(now, interval);
+            if(!m_probing) {
+                // Whatever the initial burst queued has already been accounted for by the probe.
+                m_fastTriggered = false;
             }
-            
+            return;
+        }
+        
+        ThroughputResult result;
+        {
+            std::lock_guard<std::mutex> el(m_estimatorMutex);
+            result = m_estimator->estimate(interval);
         }
+        report(result);
+    }
+    bool
+    TCPThroughputAdaptation::fastReactionDue(std::chrono::steady_clock::time_point now) const
+    {
+        return !m_probing && m_fastTriggered && m_fastEnabled
+            && now >= m_lastFastReaction + std::chrono::milliseconds(m_fastMinInterval.load());
+    }
+    void
+    TCPThroughputAdaptation::fastReaction(std::chrono::steady_clock::time_point now)
+    {
+        const float elapsed = std::max(float(std::chrono::duration_cast<std::chrono::microseconds>(now - m_fastMark).count()) / 1.0e6f, 1.0e-3f);
+        const float measured = float(m_fastSentBytes.exchange(0)) / elapsed;
+        
+        ThroughputResult result;
+        result.vector = -1.f;
+        result.targetBytesPerSecond = measured * kFastDecrease;
+        result.measuredBytesPerSecond = measured;
+        result.confidence = 1.f;
+        result.reason = kThroughputReasonCongestion;
+        
+        {
+            std::lock_guard<std::mutex> el(m_estimatorMutex);
+            m_estimator->congestionEvent(now, result.targetBytesPerSecond);
+        }
+        
+        m_fastMark = now;
+        m_lastFastReaction = now;
+        m_growthReference = m_latestBufferSize.load();
+        m_fastTriggered = false;
+        
+        DLog("Fast congestion reaction: %f bytes/sec\n", measured);
+        report(result);
+    }
+    void
+    TCPThroughputAdaptation::triggerFastReaction()
+    {
+        if(!m_fastTriggered.exchange(true) && m_running) {
+            // Only the first crossing reschedules; the flag stays set until the reaction is made.
+            m_queue.enqueue([this]() { schedule(); });
+        }
+    }
+    void
+    TCPThroughputAdaptation::report(const ThroughputResult& result)
+    {
+        if(m_resultCallback) {
+            m_resultCallback(result);
+        }
+        if(m_callback) {
+            m_callback(result.vector, result.targetBytesPerSecond, int(result.measuredBytesPerSecond));
+        }
+    }
+    bool
+    TCPThroughputAdaptation::probeSample(std::chrono::steady_clock::time_point now, const ThroughputInterval& interval)
+    {
+        m_probeSentBytes += interval.sentBytes;
+        
+        // Only intervals where data was left waiting on the socket tell us what the link can carry.
+        if(interval.bufferSizeMax > kProbeQueueThreshold) {
+            m_probeLimitedBytes += interval.sentBytes;
+            m_probeLimitedTime += interval.duration;
+        }
+        
+        const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_probeStart).count();
+        
+        if(elapsed < kProbeDuration && interval.bufferSizeMax < kProbeMaxQueue) {
+            return false;
+        }
+        
+        const bool linkLimited = m_probeLimitedTime > 0.f;
+        const float probeTime = std::max(float(elapsed) / 1.0e3f, 1.0e-3f);
+        const float measured = linkLimited ? float(m_probeLimitedBytes) / m_probeLimitedTime : float(m_probeSentBytes) / probeTime;
+        
+        DLog("Bandwidth probe: %f bytes/sec (%s)\n", measured, linkLimited ? "link limited" : "lower bound");
+        
+        // Seed the estimator so the first predictions and the next increase are relative to the probe.
+        {
+            std::lock_guard<std::mutex> el(m_estimatorMutex);
+            m_estimator->seed(now, measured);
+        }
+        
+        if(m_probeCallback) {
+            m_probeCallback(measured, linkLimited);
+        }
+        return true;
     }
     void
     TCPThroughputAdaptation::addBufferSizeSample(size_t bufferSize)
     {
-        m_buffMutex.lock();
-        m_bufferSizeSamples.push_back(bufferSize);
-        m_buffMutex.unlock();
+        m_bufferSizeSamples.add(int64_t(bufferSize));
+        m_latestBufferSize.store(int64_t(bufferSize), std::memory_order_relaxed);
+        
+        const int64_t threshold = m_fastGrowthThreshold.load(std::memory_order_relaxed);
+        if(threshold > 0 && m_fastEnabled.load(std::memory_order_relaxed)
+           && int64_t(bufferSize) > m_growthReference.load(std::memory_order_relaxed) + threshold) {
+            triggerFastReaction();
+        }
     }
     void
     TCPThroughputAdaptation::addSentBytesSample(size_t bytesSent)
     {
-        m_sentMutex.lock();
-        m_sentSamples.push_back(bytesSent);
-        m_sentMutex.unlock();
+        m_sentSamples.add(int64_t(bytesSent));
+        m_fastSentBytes.fetch_add(int64_t(bytesSent), std::memory_order_relaxed);
     }
     void
     TCPThroughputAdaptation::addBufferDurationSample(int64_t bufferDuration)
     {
-        m_durMutex.lock();
-        m_bufferDurationSamples.push_back(bufferDuration);
-        m_durMutex.unlock();
+        m_bufferDurationSamples.add(bufferDuration);
         
+        const int64_t threshold = m_fastQueueThreshold.load(std::memory_order_relaxed);
+        if(threshold > 0 && m_fastEnabled.load(std::memory_order_relaxed) && bufferDuration > threshold) {
+            triggerFastReaction();
+        }
     }
 }
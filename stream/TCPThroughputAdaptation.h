@@ -26,23 +26,34 @@
 #define __videocore__TCPThroughputAdaptation__
 
 #include <VideoCore/stream/IThroughputAdaptation.h>
+#include <VideoCore/stream/IBandwidthEstimator.hpp>
+#include <VideoCore/stream/IntervalAccumulator.hpp>
 #include <VideoCore/system/JobQueue.hpp>
 #include <vector>
 #include <deque>
 #include <thread>
 #include <condition_variable>
 #include <mutex>
+#include <memory>
 namespace videocore {
-    class TCPThroughputAdaptation : public IThroughputAdaptation
+    class TCPThroughputAdaptation : public IVirtualTimeAdaptation
     {
     public:
-        TCPThroughputAdaptation();
+        TCPThroughputAdaptation(BandwidthEstimator_t estimator = kBandwidthEstimatorBufferGrowth);
         ~TCPThroughputAdaptation();
         
     public:
         
         void setThroughputCallback(ThroughputCallback callback);
         
+        void setProbeCallback(ProbeCallback callback);
+        
+        void setThroughputResultCallback(ThroughputResultCallback callback);
+        
+        void setEstimator(BandwidthEstimator_t estimator);
+        
+        void setFastReactionConfig(const FastReactionConfig& config);
+        
         void addSentBytesSample(size_t bytesSent);
         
         void addBufferSizeSample(size_t bufferSize);
@@ -51,40 +62,81 @@ namespace videocore {
         
         void reset();
         void start();
+        
+        void startVirtual(std::chrono::steady_clock::time_point now);
+        void advance(std::chrono::steady_clock::time_point now);
     private:
-        void sampleThread();
+        /*! Sample if it is time, then set the timer for the next sample or fast reaction.  Runs on m_queue. */
+        void schedule();
+        
+        void begin(std::chrono::steady_clock::time_point now);
+        
+        /*! Collect the samples for the interval ending at now and run the estimator. */
+        void sample(std::chrono::steady_clock::time_point now, std::chrono::steady_clock::time_point prev);
+        
+        /*! true if a fast reaction has been triggered and is not held back by the rate limit */
+        bool fastReactionDue(std::chrono::steady_clock::time_point now) const;
+        
+        /*! Report an immediate decrease from the fast reaction path. */
+        void fastReaction(std::chrono::steady_clock::time_point now);
+        
+        /*! Called from the sample hot paths when a fast reaction threshold is crossed. */
+        void triggerFastReaction();
+        
+        void report(const ThroughputResult& result);
+        
+        /*!
+         *  Called from m_queue while the startup probe is running.
+         *
+         *  \return true once the probe has finished.
+         */
+        bool probeSample(std::chrono::steady_clock::time_point now, const ThroughputInterval& interval);
         
     private:
         
-        std::chrono::steady_clock::time_point m_previousTurndown;
-        std::chrono::steady_clock::time_point m_previousIncrease;
+        std::chrono::steady_clock::time_point m_probeStart;
+        std::chrono::steady_clock::time_point m_previousSample;
+        std::chrono::steady_clock::time_point m_nextSample;
+        
+        std::chrono::steady_clock::time_point m_lastFastReaction;
+        std::chrono::steady_clock::time_point m_fastMark;
+        
+        std::mutex              m_estimatorMutex;
         
-        std::thread             m_thread;
-        std::condition_variable m_cond;
-        std::mutex              m_sentMutex;
-        std::mutex              m_buffMutex;
-        std::mutex              m_durMutex;
+        // Written from the network and RTMP threads without locking, drained once per interval by schedule().
+        IntervalAccumulator<int64_t> m_sentSamples;
+        IntervalAccumulator<int64_t> m_bufferSizeSamples;
+        IntervalAccumulator<int64_t> m_bufferDurationSamples;
         
-        std::vector<size_t> m_sentSamples;
-        std::vector<size_t> m_bufferSizeSamples;
-        std::vector<int64_t> m_bufferDurationSamples;
+        std::unique_ptr<IBandwidthEstimator> m_estimator;
         
-        std::deque<float> m_bwSamples;
-        std::deque<int> m_buffGrowth;
-        std::deque<float> m_turnSamples;
-        std::vector<float> m_bwWeights;
+        ThroughputCallback       m_callback;
+        ThroughputResultCallback m_resultCallback;
+        ProbeCallback            m_probeCallback;
         
-        ThroughputCallback m_callback;
+        size_t m_probeSentBytes;
+        size_t m_probeLimitedBytes;
+        float  m_probeLimitedTime;
         
-        int  m_bwSampleCount;
-        int  m_negSampleCount;
+        // Fast reaction state shared with the sample hot paths.
+        std::atomic<bool>    m_fastEnabled;
+        std::atomic<int64_t> m_fastQueueThreshold;
+        std::atomic<int64_t> m_fastGrowthThreshold;
+        std::atomic<int64_t> m_fastMinInterval;
+        std::atomic<int64_t> m_fastSentBytes;
+        std::atomic<int64_t> m_latestBufferSize;
+        std::atomic<int64_t> m_growthReference;
+        std::atomic<bool>    m_fastTriggered;
         
-        float m_previousVector;
+        std::atomic<bool> m_resetPending;
+        std::atomic<bool> m_exiting;
+        std::atomic<bool> m_running;    /*!< Sampling on its own timer, rather than advanced by hand */
         
         bool m_started;
-        bool m_exiting;
-        bool m_hasFirstTurndown;
+        bool m_probing;
         
+        TimerId  m_timer;       /*!< m_queue only */
+        JobQueue m_queue;       /*!< Last, so that it is gone before anything its jobs use */
     };
 }
 
@@ -0,0 +1,393 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+
+#include <VideoCore/stream/ThroughputSimulator.h>
+#include <VideoCore/stream/TCPThroughputAdaptation.h>
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <random>
+#include <sstream>
+
+namespace videocore {
+    
+    static const double kAudioFrameDuration = 1024. / 44100.; // seconds - one AAC frame
+    static const double kMahimahiBucket     = 0.1;  // seconds - bucket size used to turn delivery opportunities into a rate
+    static const double kMahimahiPacketBits = 1500. * 8.;
+    
+#pragma mark - BandwidthTrace
+    
+    float
+    BandwidthTrace::capacityAt(double time) const
+    {
+        float capacity = points.empty() ? 0.f : points.front().bitsPerSecond;
+        for ( auto & p : points ) {
+            if(p.time > time) {
+                break;
+            }
+            capacity = p.bitsPerSecond;
+        }
+        return capacity;
+    }
+    BandwidthTrace
+    BandwidthTrace::stepDrop(float high, float low, double dropTime, double recoverTime, double duration)
+    {
+        BandwidthTrace trace;
+        std::stringstream ss;
+        ss << "step " << int(high / 1000) << "k->" << int(low / 1000) << "k";
+        trace.name = ss.str();
+        trace.duration = duration;
+        trace.points.push_back({ 0., high });
+        trace.points.push_back({ dropTime, low });
+        if(recoverTime < duration) {
+            trace.points.push_back({ recoverTime, high });
+        }
+        return trace;
+    }
+    BandwidthTrace
+    BandwidthTrace::lteFluctuation(float mean, float deviation, unsigned seed, double duration)
+    {
+        static const double kStep = 0.5;         // seconds between capacity changes
+        static const double kCorrelation = 0.8;  // AR(1) coefficient of the log capacity
+        static const double kOutageChance = 0.005;
+        static const double kOutageLength = 1.;  // seconds
+        
+        BandwidthTrace trace;
+        std::stringstream ss;
+        ss << "lte " << int(mean / 1000) << "k seed " << seed;
+        trace.name = ss.str();
+        trace.duration = duration;
+        
+        std::mt19937 rng(seed);
+        // Choose the innovation so the stationary deviation of the log capacity matches deviation / mean.
+        const double sigma = std::sqrt(std::log(1. + double(deviation * deviation) / double(mean * mean)));
+        std::normal_distribution<double> innovation(0., sigma * std::sqrt(1. - kCorrelation * kCorrelation));
+        std::uniform_real_distribution<double> uniform(0., 1.);
+        
+        double x = 0.;
+        double outageUntil = -1.;
+        for ( double t = 0. ; t < duration ; t += kStep ) {
+            x = kCorrelation * x + innovation(rng);
+            float capacity = float(mean * std::exp(x - sigma * sigma / 2.));
+            if(t >= outageUntil && uniform(rng) < kOutageChance) {
+                outageUntil = t + kOutageLength;
+            }
+            if(t < outageUntil) {
+                capacity = mean * 0.05f;
+            }
+            trace.points.push_back({ t, std::max(capacity, mean * 0.05f) });
+        }
+        return trace;
+    }
+    BandwidthTrace
+    BandwidthTrace::crossTraffic(float capacity, float share, double onTime, double offTime, double duration)
+    {
+        BandwidthTrace trace;
+        std::stringstream ss;
+        ss << "cross " << int(capacity / 1000) << "k " << int(share * 100) << "%";
+        trace.name = ss.str();
+        trace.duration = duration;
+        
+        for ( double t = 0. ; t < duration ; t += onTime + offTime ) {
+            trace.points.push_back({ t, capacity * (1.f - share) });
+            trace.points.push_back({ t + onTime, capacity });
+        }
+        return trace;
+    }
+    BandwidthTrace
+    BandwidthTrace::load(std::istream& in, const std::string& name)
+    {
+        BandwidthTrace trace;
+        trace.name = name;
+        trace.duration = 0.;
+        
+        std::string line;
+        while(std::getline(in, line)) {
+            std::istringstream ls(line);
+            double t;
+            float bps;
+            if(line.empty() || line[0] == '#' || !(ls >> t >> bps)) {
+                continue;
+            }
+            trace.points.push_back({ t, bps });
+            trace.duration = std::max(trace.duration, t);
+        }
+        return trace;
+    }
+    BandwidthTrace
+    BandwidthTrace::loadMahimahi(std::istream& in, const std::string& name)
+    {
+        BandwidthTrace trace;
+        trace.name = name;
+        trace.duration = 0.;
+        
+        std::vector<int> buckets;
+        std::string line;
+        while(std::getline(in, line)) {
+            std::istringstream ls(line);
+            double ms;
+            if(!(ls >> ms)) {
+                continue;
+            }
+            const size_t bucket = size_t(ms / 1000. / kMahimahiBucket);
+            if(bucket >= buckets.size()) {
+                buckets.resize(bucket + 1, 0);
+            }
+            buckets[bucket]++;
+        }
+        for ( size_t i = 0 ; i < buckets.size() ; ++i ) {
+            trace.points.push_back({ i * kMahimahiBucket, float(buckets[i] * kMahimahiPacketBits / kMahimahiBucket) });
+        }
+        trace.duration = buckets.size() * kMahimahiBucket;
+        return trace;
+    }
+    
+#pragma mark - SimulationReport
+    
+    std::string
+    SimulationReport::describe() const
+    {
+        std::stringstream ss;
+        ss << trace << ": converge " << convergenceTime << "s (max " << maxConvergenceTime << "s, " << unconvergedEvents << " unconverged)"
+           << ", queue delay " << averageQueueDelay << "ms (max " << maxQueueDelay << "ms)"
+           << ", utilisation " << int(utilisation * 100.) << "%"
+           << ", " << oscillations << " oscillations in " << bitrateChanges << " changes";
+        return ss.str();
+    }
+    
+#pragma mark - ThroughputSimulator
+    
+    ThroughputSimulator::Config::Config()
+    : step(0.01), fps(30.), audioBitrate(128000), significantChange(0.25), convergenceBand(0.3), settleTime(3.), policy(nullptr)
+    {
+        controller.maxBitrate = 4000000;
+    }
+    ThroughputSimulator::ThroughputSimulator(const Config& config)
+    : m_config(config)
+    {
+    }
+    SimulationReport
+    ThroughputSimulator::run(BandwidthEstimator_t estimator, const BandwidthTrace& trace)
+    {
+        TCPThroughputAdaptation adaptation(estimator);
+        return run(adaptation, trace);
+    }
+    std::vector<SimulationReport>
+    ThroughputSimulator::runSuite(const std::vector<BandwidthTrace>& traces,
+                                  const std::vector<BandwidthEstimator_t>& estimators)
+    {
+        static const char* kEstimatorNames[] = { "buffer growth", "delay gradient", "delivery rate" };
+        
+        std::vector<SimulationReport> reports;
+        for ( auto & trace : traces ) {
+            for ( auto & estimator : estimators ) {
+                auto report = run(estimator, trace);
+                report.trace = trace.name + " / " + kEstimatorNames[estimator];
+                reports.push_back(report);
+            }
+        }
+        return reports;
+    }
+    SimulationReport
+    ThroughputSimulator::run(IVirtualTimeAdaptation& adaptation, const BandwidthTrace& trace)
+    {
+        struct Packet { size_t size; size_t remaining; double enqueued; };
+        
+        const Config& cfg = m_config;
+        const auto epoch = std::chrono::steady_clock::time_point();
+        
+        const double maxRate = cfg.controller.maxBitrate +
+                               (cfg.controller.audioShare > 0.f ? cfg.controller.maxAudioBitrate : cfg.audioBitrate);
+        
+        BitrateController controller(cfg.controller);
+        std::chrono::steady_clock::time_point now = epoch;
+        int videoBitrate = controller.videoBitrate();
+        int audioBitrate = controller.audioBitrate() ? controller.audioBitrate() : cfg.audioBitrate;
+        
+        auto apply = [&](const BitrateDecision& decision) {
+            videoBitrate = decision.videoBitrate;
+            if(decision.audioBitrate) {
+                audioBitrate = decision.audioBitrate;
+            }
+        };
+        
+        adaptation.setThroughputResultCallback([&](const ThroughputResult& result) {
+            if(cfg.policy) {
+                videoBitrate = cfg.policy(result, videoBitrate);
+            } else {
+                apply(controller.update(result, now));
+            }
+        });
+        adaptation.setThroughputCallback(nullptr);
+        adaptation.setProbeCallback([&](float measured, bool linkLimited) {
+            apply(controller.probe(measured, linkLimited));
+        });
+        adaptation.startVirtual(epoch);
+        
+        std::deque<Packet> queue;
+        size_t queuedBytes = 0;
+        
+        double nextVideo = 0.;
+        double nextAudio = 0.;
+        double budget = 0.;
+        
+        double delaySum = 0.;
+        double delayMax = 0.;
+        size_t delayCount = 0;
+        double deliveredBits = 0.;
+        double capacityBits = 0.;
+        
+        std::vector<double> sendRates;      // video + audio bits per second at each step
+        int bitrateChanges = 0;
+        int oscillations = 0;
+        int lastDirection = 0;
+        int previousBitrate = videoBitrate + audioBitrate;
+        
+        auto enqueue = [&](size_t size, double enqueued) {
+            // RTMPSession samples the buffer before adding the new packet to it.
+            adaptation.addBufferSizeSample(queuedBytes);
+            queue.push_back({ size, size, enqueued });
+            queuedBytes += size;
+        };
+        
+        const size_t steps = size_t(std::ceil(trace.duration / cfg.step));
+        sendRates.reserve(steps);
+        
+        for ( size_t i = 0 ; i < steps ; ++i ) {
+            const double t = i * cfg.step;
+            
+            while(nextVideo <= t) {
+                enqueue(size_t(videoBitrate / 8. / cfg.fps), t);
+                nextVideo += 1. / cfg.fps;
+            }
+            while(nextAudio <= t) {
+                enqueue(size_t(audioBitrate / 8. * kAudioFrameDuration), t);
+                nextAudio += kAudioFrameDuration;
+            }
+            
+            const double capacity = trace.capacityAt(t);
+            capacityBits += capacity * cfg.step;
+            budget += capacity * cfg.step / 8.;
+            
+            while(budget >= 1. && !queue.empty()) {
+                Packet& p = queue.front();
+                const size_t sent = std::min(p.remaining, size_t(budget));
+                p.remaining -= sent;
+                budget -= sent;
+                queuedBytes -= sent;
+                deliveredBits += sent * 8.;
+                adaptation.addSentBytesSample(sent);
+                
+                if(p.remaining == 0) {
+                    const double delay = (t - p.enqueued) * 1.0e3;
+                    adaptation.addBufferDurationSample(int64_t(delay));
+                    delaySum += delay;
+                    delayMax = std::max(delayMax, delay);
+                    delayCount++;
+                    queue.pop_front();
+                }
+            }
+            if(queue.empty()) {
+                // An idle link does not bank capacity for later.
+                budget = std::min(budget, capacity * cfg.step / 8.);
+            }
+            
+            now = epoch + std::chrono::microseconds(int64_t(t * 1.0e6));
+            adaptation.advance(now);
+            
+            const int bitrate = videoBitrate + audioBitrate;
+            if(bitrate != previousBitrate) {
+                const int direction = bitrate > previousBitrate ? 1 : -1;
+                if(lastDirection != 0 && direction != lastDirection) {
+                    oscillations++;
+                }
+                lastDirection = direction;
+                previousBitrate = bitrate;
+                bitrateChanges++;
+            }
+            sendRates.push_back(double(bitrate));
+        }
+        
+        // Convergence: after the start and after every significant capacity change, how long until the send rate
+        // sits within band below the usable capacity for settleTime.
+        std::vector<double> events;
+        events.push_back(0.);
+        float previousCapacity = trace.points.empty() ? 0.f : trace.points.front().bitsPerSecond;
+        for ( auto & p : trace.points ) {
+            if(previousCapacity > 0.f && std::abs(p.bitsPerSecond - previousCapacity) / previousCapacity > cfg.significantChange) {
+                events.push_back(p.time);
+            }
+            previousCapacity = p.bitsPerSecond;
+        }
+        
+        double convergenceSum = 0.;
+        double convergenceMax = 0.;
+        int converged = 0;
+        int unconverged = 0;
+        for ( size_t e = 0 ; e < events.size() ; ++e ) {
+            const double start = events[e];
+            const double end = (e + 1 < events.size()) ? events[e + 1] : trace.duration;
+            const double target = std::min(double(trace.capacityAt(start)), maxRate);
+            
+            double inBandSince = -1.;
+            double result = -1.;
+            for ( size_t i = size_t(start / cfg.step) ; i < sendRates.size() && i * cfg.step < end ; ++i ) {
+                const double rate = sendRates[i];
+                if(rate <= target && rate >= target * (1. - cfg.convergenceBand)) {
+                    if(inBandSince < 0.) {
+                        inBandSince = i * cfg.step;
+                    }
+                    if(i * cfg.step - inBandSince >= cfg.settleTime || (i + 1) * cfg.step >= end) {
+                        result = inBandSince - start;
+                        break;
+                    }
+                } else {
+                    inBandSince = -1.;
+                }
+            }
+            if(result >= 0.) {
+                convergenceSum += result;
+                convergenceMax = std::max(convergenceMax, result);
+                converged++;
+            } else {
+                unconverged++;
+            }
+        }
+        
+        SimulationReport report;
+        report.trace = trace.name;
+        report.duration = trace.duration;
+        report.convergenceTime = converged ? convergenceSum / converged : 0.;
+        report.maxConvergenceTime = convergenceMax;
+        report.unconvergedEvents = unconverged;
+        report.averageQueueDelay = delayCount ? delaySum / delayCount : 0.;
+        report.maxQueueDelay = delayMax;
+        report.utilisation = capacityBits > 0. ? std::min(1., deliveredBits / capacityBits) : 0.;
+        report.oscillations = oscillations;
+        report.bitrateChanges = bitrateChanges;
+        return report;
+    }
+}
@@ -0,0 +1,134 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+#ifndef __videocore__ThroughputSimulator__
+#define __videocore__ThroughputSimulator__
+
+#include <VideoCore/stream/IThroughputAdaptation.h>
+#include <VideoCore/stream/BitrateController.h>
+
+#include <functional>
+#include <istream>
+#include <string>
+#include <vector>
+
+namespace videocore {
+    
+    /*!
+     *  A piecewise constant uplink capacity over time.
+     */
+    struct BandwidthTrace {
+        struct Point {
+            double time;            /*!< Seconds from the start of the trace */
+            float  bitsPerSecond;   /*!< Capacity from this point until the next one */
+        };
+        
+        std::string        name;
+        std::vector<Point> points;
+        double             duration;
+        
+        float capacityAt(double time) const;
+        
+        /*! Constant high capacity that drops to low at dropTime and recovers at recoverTime. */
+        static BandwidthTrace stepDrop(float high, float low, double dropTime, double recoverTime, double duration);
+        
+        /*! Log-normal random walk around mean with occasional short outages, in the style of a mobile uplink. */
+        static BandwidthTrace lteFluctuation(float mean, float deviation, unsigned seed, double duration);
+        
+        /*! A competing flow takes share of the capacity for onTime seconds, then leaves it for offTime seconds. */
+        static BandwidthTrace crossTraffic(float capacity, float share, double onTime, double offTime, double duration);
+        
+        /*! Two columns per line: time in seconds and capacity in bits per second. */
+        static BandwidthTrace load(std::istream& in, const std::string& name);
+        
+        /*! Mahimahi format: one line per 1500 byte delivery opportunity, in milliseconds. */
+        static BandwidthTrace loadMahimahi(std::istream& in, const std::string& name);
+    };
+    
+    /*!
+     *  What happened when an IThroughputAdaptation was run against one BandwidthTrace.
+     */
+    struct SimulationReport {
+        std::string trace;
+        double duration;            /*!< Seconds of virtual time simulated */
+        double convergenceTime;     /*!< Mean seconds to settle within band of the capacity after a significant change */
+        double maxConvergenceTime;
+        int    unconvergedEvents;   /*!< Capacity changes that were followed by another before the sender settled */
+        double averageQueueDelay;   /*!< Milliseconds packets spent queued before reaching the socket */
+        double maxQueueDelay;
+        double utilisation;         /*!< Bytes delivered / capacity available, 0 to 1 */
+        int    oscillations;        /*!< Reversals in the direction of bitrate changes */
+        int    bitrateChanges;
+        
+        std::string describe() const;
+    };
+    
+    /*!
+     *  Runs throughput adaptation offline against bandwidth traces in virtual time, faster than realtime.
+     *
+     *  The sender is a constant bitrate video encoder plus an audio stream writing into a send queue, the way
+     *  RTMPSession does, drained by a link whose capacity follows the trace.  The adaptation receives the same
+     *  samples it gets from RTMPSession and its decisions are applied to the encoders
+     *  through a BitrateController.
+     */
+    class ThroughputSimulator
+    {
+    public:
+        /*! Turns a result into the next video bitrate, in bits per second. */
+        using BitratePolicy = std::function<int(const ThroughputResult& result, int currentBitrate)>;
+        
+        struct Config {
+            Config();
+            
+            double step;                /*!< Virtual time step, in seconds */
+            double fps;
+            int    audioBitrate;        /*!< Used unless the controller manages the audio share */
+            BitrateControllerConfig controller; /*!< The encoder starts at maxBitrate, as VCSimpleSession does while the probe runs */
+            double significantChange;   /*!< Relative capacity change that starts a convergence measurement */
+            double convergenceBand;     /*!< Converged when the send rate is within this fraction below the target rate */
+            double settleTime;          /*!< Seconds the send rate must stay in band to count as converged */
+            BitratePolicy policy;       /*!< Replaces the BitrateController when set */
+        };
+        
+        ThroughputSimulator(const Config& config = Config());
+        
+        /*!
+         *  Run a fresh, unstarted adaptation against a trace.  The simulator installs its own throughput and probe
+         *  callbacks on the adaptation.
+         */
+        SimulationReport run(IVirtualTimeAdaptation& adaptation, const BandwidthTrace& trace);
+        
+        /*! Run TCPThroughputAdaptation with the given estimator against a trace. */
+        SimulationReport run(BandwidthEstimator_t estimator, const BandwidthTrace& trace);
+        
+        /*! Run every estimator against every trace, for regression comparisons. */
+        std::vector<SimulationReport> runSuite(const std::vector<BandwidthTrace>& traces,
+                                               const std::vector<BandwidthEstimator_t>& estimators);
+        
+    private:
+        Config m_config;
+    };
+}
+
+#endif
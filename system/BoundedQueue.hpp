@@ -0,0 +1,139 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+#ifndef videocore_BoundedQueue_hpp
+#define videocore_BoundedQueue_hpp
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <utility>
+
+namespace videocore {
+    
+    /*!
+     *  Fixed-capacity FIFO that any number of threads may push to and pop from without locking or allocating.
+     *
+     *  Each cell carries a sequence number that tells producers and consumers whose turn it is, after Dmitry
+     *  Vyukov's bounded MPMC queue.  The capacity is rounded up to a power of two and allocated once, up front.
+     */
+    template<typename T>
+    class BoundedQueue
+    {
+    public:
+        BoundedQueue(size_t capacity) : m_enqueuePos(0), m_dequeuePos(0) {
+            size_t size = 2;
+            while(size < capacity) {
+                size <<= 1;
+            }
+            m_mask = size - 1;
+            m_cells.reset(new Cell[size]);
+            for ( size_t i = 0 ; i < size ; ++i ) {
+                m_cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+        
+        size_t capacity() const { return m_mask + 1; };
+        
+        /*!
+         *  Values pushed, or being pushed, and not yet popped.  Only a snapshot; a pop can fail while this is not 0
+         *  if the push it would take has claimed its cell but not yet filled it.
+         */
+        size_t size() const {
+            const size_t dequeuePos = m_dequeuePos.load(std::memory_order_relaxed);
+            const size_t enqueuePos = m_enqueuePos.load(std::memory_order_relaxed);
+            return enqueuePos > dequeuePos ? enqueuePos - dequeuePos : 0;
+        };
+        
+        /*! \return false if the queue is full. */
+        bool push(const T& value) {
+            return emplace(value);
+        }
+        
+        /*! \return false if the queue is full, in which case value is left as it was. */
+        bool push(T&& value) {
+            return emplace(std::move(value));
+        }
+        
+        /*! \return false if the queue is empty. */
+        bool pop(T& value) {
+            Cell* cell;
+            size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+            for(;;) {
+                cell = &m_cells[pos & m_mask];
+                const size_t seq = cell->sequence.load(std::memory_order_acquire);
+                const intptr_t diff = intptr_t(seq) - intptr_t(pos + 1);
+                if(diff == 0) {
+                    if(m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                } else if(diff < 0) {
+                    return false;
+                } else {
+                    pos = m_dequeuePos.load(std::memory_order_relaxed);
+                }
+            }
+            value = std::move(cell->value);
+            cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+            return true;
+        }
+        
+    private:
+        template<typename U>
+        bool emplace(U&& value) {
+            Cell* cell;
+            size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+            for(;;) {
+                cell = &m_cells[pos & m_mask];
+                const size_t seq = cell->sequence.load(std::memory_order_acquire);
+                const intptr_t diff = intptr_t(seq) - intptr_t(pos);
+                if(diff == 0) {
+                    if(m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                } else if(diff < 0) {
+                    return false;
+                } else {
+                    pos = m_enqueuePos.load(std::memory_order_relaxed);
+                }
+            }
+            cell->value = std::forward<U>(value);
+            cell->sequence.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+        
+        struct Cell {
+            std::atomic<size_t> sequence;
+            T value;
+        };
+        
+        std::unique_ptr<Cell[]> m_cells;
+        size_t m_mask;
+        
+        alignas(64) std::atomic<size_t> m_enqueuePos;
+        alignas(64) std::atomic<size_t> m_dequeuePos;
+    };
+}
+
+#endif
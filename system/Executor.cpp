@@ -0,0 +1,356 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+#include <VideoCore/system/Executor.h>
+
+#include <algorithm>
+#include <chrono>
+#include <pthread.h>
+#ifndef __APPLE__
+#include <sys/prctl.h>
+#endif
+
+namespace videocore {
+    
+    static const int kIdleSpins = 8;                            // yields before a worker sleeps
+    static const std::chrono::milliseconds kSpareLinger(50);    // idle time before a spare rechecks if it is needed
+    static const unsigned kInjectionInterval = 32;              // picks between a worker's looks at the shared queues first
+    
+    namespace {
+        struct ThreadState {
+            Executor*           executor;
+            void*               worker;     /*!< The executor's Worker, or nullptr on a spare */
+            Executor::Runnable* current;
+        };
+        
+        pthread_key_t  s_stateKey;
+        pthread_once_t s_stateOnce = PTHREAD_ONCE_INIT;
+        
+        void makeStateKey() {
+            pthread_key_create(&s_stateKey, nullptr);
+        }
+        ThreadState* threadState() {
+            pthread_once(&s_stateOnce, makeStateKey);
+            return static_cast<ThreadState*>(pthread_getspecific(s_stateKey));
+        }
+        void setThreadState(ThreadState* state) {
+            pthread_once(&s_stateOnce, makeStateKey);
+            pthread_setspecific(s_stateKey, state);
+        }
+        void setThreadName(const char* name) {
+#ifdef __APPLE__
+            pthread_setname_np(name);
+#else
+            prctl(PR_SET_NAME, name);
+#endif
+        }
+    }
+    
+    Executor&
+    Executor::shared()
+    {
+        // Leaked on purpose: queues owned by static objects may outlive any destructor it could have.
+        static Executor* s_shared = new Executor(std::max(2u, std::thread::hardware_concurrency()));
+        return *s_shared;
+    }
+    
+    Executor::Runnable*
+    Executor::current()
+    {
+        ThreadState* state = threadState();
+        return state ? state->current : nullptr;
+    }
+    
+    Executor::Executor(size_t threadCount)
+    : m_sleeping(0), m_wakeups(0), m_spareCount(0), m_blocked(0), m_stealSeed(0), m_exiting(false)
+    {
+        for ( size_t i = 0 ; i < kExecutorLaneCount ; ++i ) {
+            m_injection[i].size = 0;
+        }
+        threadCount = std::max(threadCount, size_t(1));
+        for ( size_t i = 0 ; i < threadCount ; ++i ) {
+            m_workers.emplace_back(new Worker());
+        }
+        // Only once every deque exists, as a worker may steal from any of them.
+        for ( auto it = m_workers.begin() ; it != m_workers.end() ; ++it ) {
+            Worker* w = it->get();
+            w->thread = std::thread([this, w]() { worker(w); });
+        }
+    }
+    
+    Executor::~Executor()
+    {
+        m_exiting = true;
+        {
+            std::lock_guard<std::mutex> l(m_idleMutex);
+            m_idleCond.notify_all();
+        }
+        for ( auto it = m_workers.begin() ; it != m_workers.end() ; ++it ) {
+            (*it)->thread.join();
+        }
+        std::lock_guard<std::mutex> l(m_spareMutex);
+        for ( auto it = m_spares.begin() ; it != m_spares.end() ; ++it ) {
+            it->thread.join();
+        }
+    }
+    
+    void
+    Executor::submit(Runnable* r, ExecutorLane lane)
+    {
+        ThreadState* state = threadState();
+        Worker* self = state && state->executor == this ? static_cast<Worker*>(state->worker) : nullptr;
+        if(self) {
+            self->deques[lane].push(r);
+        } else {
+            inject(r, lane);
+        }
+        notify();
+    }
+    
+    void
+    Executor::resubmit(Runnable* r, ExecutorLane lane)
+    {
+        inject(r, lane);
+        notify();
+    }
+    
+    void
+    Executor::inject(Runnable* r, ExecutorLane lane)
+    {
+        Injection& injection = m_injection[lane];
+        std::lock_guard<std::mutex> l(injection.mutex);
+        injection.runnables.push_back(r);
+        injection.size.store(injection.runnables.size(), std::memory_order_relaxed);
+    }
+    
+    void
+    Executor::notify()
+    {
+        // Pairs with the fence in idle(): either the sleeper sees r, or this sees the sleeper.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(m_sleeping.load(std::memory_order_relaxed) > 0) {
+            wakeOne();
+        } else if(m_blocked.load(std::memory_order_relaxed) > m_spareCount.load(std::memory_order_relaxed)) {
+            addSpareIfNeeded();
+        }
+    }
+    
+    void
+    Executor::worker(Worker* self)
+    {
+        ThreadState state = { this, self, nullptr };
+        setThreadState(&state);
+        setThreadName("com.videocore.executor");
+        
+        int spins = 0;
+        while(true) {
+            if(Runnable* r = next(self)) {
+                run(r);
+                spins = 0;
+            } else if(spins < kIdleSpins) {
+                ++spins;
+                std::this_thread::yield();
+            } else if(!idle()) {
+                break;
+            }
+        }
+        setThreadState(nullptr);
+    }
+    
+    void
+    Executor::spare(Spare* self)
+    {
+        ThreadState state = { this, nullptr, nullptr };
+        setThreadState(&state);
+        setThreadName("com.videocore.executor.spare");
+        
+        while(!m_exiting.load()) {
+            if(Runnable* r = next(nullptr)) {
+                run(r);
+                continue;
+            }
+            // Stand down once the workers the spare was covering for are back.
+            int spares = m_spareCount.load();
+            bool retired = false;
+            while(spares > m_blocked.load() && !retired) {
+                retired = m_spareCount.compare_exchange_weak(spares, spares - 1);
+            }
+            if(retired) {
+                break;
+            }
+            std::unique_lock<std::mutex> l(m_idleMutex);
+            m_sleeping.fetch_add(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if(!hasWork()) {
+                m_idleCond.wait_for(l, kSpareLinger, [&]() { return m_wakeups > 0 || m_exiting.load(); });
+            }
+            if(m_wakeups > 0) {
+                --m_wakeups;
+            }
+            m_sleeping.fetch_sub(1);
+        }
+        setThreadState(nullptr);
+        self->finished = true;
+    }
+    
+    Executor::Runnable*
+    Executor::next(Worker* self)
+    {
+        Runnable* r = nullptr;
+        const size_t count = m_workers.size();
+        // Now and then the shared queues go first, so that a worker whose own deque never empties, as when two
+        // queues keep handing work to each other, still gets to what is waiting there.
+        const bool injectionFirst = self && ++self->picks % kInjectionInterval == 0;
+        for ( size_t lane = 0 ; lane < kExecutorLaneCount ; ++lane ) {
+            if(injectionFirst && takeInjected(lane, r)) {
+                return r;
+            }
+            if(self && self->deques[lane].pop(r)) {
+                return r;
+            }
+            if(takeInjected(lane, r)) {
+                return r;
+            }
+            // Start each search somewhere else so that thieves spread over the victims.
+            const size_t start = m_stealSeed.fetch_add(1, std::memory_order_relaxed) % count;
+            for ( size_t i = 0 ; i < count ; ++i ) {
+                Worker* victim = m_workers[(start + i) % count].get();
+                if(victim != self && victim->deques[lane].steal(r)) {
+                    return r;
+                }
+            }
+        }
+        return nullptr;
+    }
+    
+    bool
+    Executor::takeInjected(size_t lane, Runnable*& r)
+    {
+        Injection& injection = m_injection[lane];
+        if(!injection.size.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        std::lock_guard<std::mutex> l(injection.mutex);
+        if(injection.runnables.empty()) {
+            return false;
+        }
+        r = injection.runnables.front();
+        injection.runnables.pop_front();
+        injection.size.store(injection.runnables.size(), std::memory_order_relaxed);
+        return true;
+    }
+    
+    void
+    Executor::run(Runnable* r)
+    {
+        ThreadState* state = threadState();
+        state->current = r;
+        r->run();
+        state->current = nullptr;
+    }
+    
+    bool
+    Executor::hasWork() const
+    {
+        for ( size_t lane = 0 ; lane < kExecutorLaneCount ; ++lane ) {
+            if(m_injection[lane].size.load(std::memory_order_relaxed)) {
+                return true;
+            }
+            for ( auto it = m_workers.begin() ; it != m_workers.end() ; ++it ) {
+                if(!(*it)->deques[lane].empty()) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+    
+    bool
+    Executor::idle()
+    {
+        std::unique_lock<std::mutex> l(m_idleMutex);
+        m_sleeping.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(!hasWork()) {
+            m_idleCond.wait(l, [&]() { return m_wakeups > 0 || m_exiting.load(); });
+        }
+        if(m_wakeups > 0) {
+            --m_wakeups;
+        }
+        m_sleeping.fetch_sub(1);
+        return !m_exiting.load();
+    }
+    
+    void
+    Executor::wakeOne()
+    {
+        std::lock_guard<std::mutex> l(m_idleMutex);
+        if(m_wakeups < m_sleeping.load()) {
+            ++m_wakeups;
+            m_idleCond.notify_one();
+        }
+    }
+    
+    void
+    Executor::addSpareIfNeeded()
+    {
+        // A spare per blocked thread at most, and only while there is work no one is free to take.
+        std::lock_guard<std::mutex> l(m_spareMutex);
+        for ( auto it = m_spares.begin() ; it != m_spares.end() ; ) {
+            if(it->finished.load()) {
+                it->thread.join();
+                it = m_spares.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        const int spares = m_spareCount.load();
+        if(m_exiting.load() || spares >= m_blocked.load() || spares >= int(kMaxSpareThreads)
+           || m_sleeping.load() > 0 || !hasWork()) {
+            return;
+        }
+        m_spareCount.fetch_add(1);
+        m_spares.emplace_back();
+        Spare* s = &m_spares.back();
+        s->finished = false;
+        s->thread = std::thread([this, s]() { spare(s); });
+    }
+    
+    Executor::Blocking::Blocking()
+    {
+        ThreadState* state = threadState();
+        m_executor = state ? state->executor : nullptr;
+        if(m_executor) {
+            m_executor->m_blocked.fetch_add(1);
+            m_executor->addSpareIfNeeded();
+        }
+    }
+    
+    Executor::Blocking::~Blocking()
+    {
+        if(m_executor) {
+            m_executor->m_blocked.fetch_sub(1);
+        }
+    }
+}
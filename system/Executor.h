@@ -0,0 +1,167 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+#ifndef __videocore__Executor__
+#define __videocore__Executor__
+
+#include <VideoCore/system/WorkStealingDeque.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace videocore {
+    
+    typedef enum {
+        kExecutorLaneHigh,
+        kExecutorLaneDefault,
+        kExecutorLaneLow,
+        kExecutorLaneCount
+    } ExecutorLane;
+    
+    /*!
+     *  A pool of worker threads shared by the whole process, so that the number of threads follows the number of
+     *  cores rather than the number of sessions, mixers and queues.
+     *
+     *  What it runs are Runnables, in practice the strands behind JobQueues; a strand is submitted when it gets
+     *  work and runs a batch of its jobs each time it is picked.  A worker keeps what it submits on a deque of its
+     *  own, one per lane, and takes the newest first, which keeps a chain of jobs handed from queue to queue on one
+     *  core.  Submissions from other threads go to a shared queue per lane.  An idle worker takes from its own
+     *  deques, then the shared queues, then steals the oldest Runnable of another worker, trying every source of
+     *  a lane before looking at the next lane down; every few dozen picks it looks at the shared queue first.
+     *  Workers with nothing to do sleep.
+     *
+     *  A Runnable that has had its turn and still has work goes back with resubmit(), to the back of the shared
+     *  queue of its lane, behind everything already waiting there, so that within a lane the pool goes round the
+     *  busy Runnables in turn rather than running the latest one again.  Higher lanes still come first.
+     *
+     *  A job that has to wait, for a socket or for another queue, should do so inside a Blocking scope; while too
+     *  many workers are blocked the pool starts spare threads so that other queues keep running.
+     */
+    class Executor
+    {
+    public:
+        class Runnable
+        {
+        public:
+            virtual ~Runnable() {};
+            
+            /*! Called on a worker each time the Runnable is picked after a submit(). */
+            virtual void run() = 0;
+        };
+        
+        /*! Marks the current thread as waiting for the scope's lifetime.  Does nothing off the pool. */
+        class Blocking
+        {
+        public:
+            Blocking();
+            ~Blocking();
+            Blocking(const Blocking&) = delete;
+            Blocking& operator=(const Blocking&) = delete;
+        private:
+            Executor* m_executor;
+        };
+        
+        static const size_t kMaxSpareThreads = 64;
+        
+        /*! The process-wide pool, with a worker per core and at least two.  It is never destroyed. */
+        static Executor& shared();
+        
+        /*! The Runnable the current thread is running, or nullptr. */
+        static Runnable* current();
+        
+        Executor(size_t threadCount);
+        
+        /*! Stops the workers once they are idle; Runnables still submitted are not run. */
+        ~Executor();
+        
+        /*! Queue r to run once.  It must not be submitted again before its run() has begun. */
+        void submit(Runnable* r, ExecutorLane lane = kExecutorLaneDefault);
+        
+        /*! submit(), for a Runnable that has just run and has more to do: it waits its turn behind the others. */
+        void resubmit(Runnable* r, ExecutorLane lane = kExecutorLaneDefault);
+        
+        size_t threadCount() const { return m_workers.size(); };
+        
+    private:
+        struct Worker {
+            WorkStealingDeque<Runnable*> deques[kExecutorLaneCount];
+            std::thread                  thread;
+            unsigned                     picks;     /*!< The worker's own */
+        };
+        struct Spare {
+            std::thread         thread;
+            std::atomic<bool>   finished;
+        };
+        struct Injection {
+            std::mutex              mutex;
+            std::deque<Runnable*>   runnables;
+            std::atomic<size_t>     size;
+        };
+        
+        void worker(Worker* self);
+        void spare(Spare* self);
+        
+        /*! The next Runnable for self, which is nullptr on a spare. */
+        Runnable* next(Worker* self);
+        bool      takeInjected(size_t lane, Runnable*& r);
+        void      inject(Runnable* r, ExecutorLane lane);
+        
+        /*! Wake a sleeper, or start a spare, for a Runnable just submitted. */
+        void      notify();
+        void      run(Runnable* r);
+        bool      hasWork() const;
+        
+        /*! Sleep until there may be work.  \return false once the pool is stopping. */
+        bool idle();
+        void wakeOne();
+        
+        /*! Start a spare if a thread is blocked, none is idle and there is work waiting. */
+        void addSpareIfNeeded();
+        
+    private:
+        std::vector<std::unique_ptr<Worker>> m_workers;
+        Injection                            m_injection[kExecutorLaneCount];
+        
+        std::mutex                  m_idleMutex;
+        std::condition_variable     m_idleCond;
+        std::atomic<int>            m_sleeping;
+        int                         m_wakeups;      /*!< Guarded by m_idleMutex */
+        
+        std::mutex                  m_spareMutex;
+        std::list<Spare>            m_spares;       /*!< Guarded by m_spareMutex */
+        std::atomic<int>            m_spareCount;
+        std::atomic<int>            m_blocked;
+        
+        std::atomic<unsigned>       m_stealSeed;
+        std::atomic<bool>           m_exiting;
+    };
+}
+
+#endif /* defined(__videocore__Executor__) */
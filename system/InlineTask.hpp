@@ -0,0 +1,130 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+#ifndef videocore_InlineTask_hpp
+#define videocore_InlineTask_hpp
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace videocore {
+    
+    /*!
+     *  A move-only void() callable that keeps callables of up to kInlineSize bytes, such as lambdas with a few
+     *  captures, in place instead of on the heap.  Larger ones are allocated, as std::function would.
+     */
+    class InlineTask
+    {
+    public:
+        static const size_t kInlineSize = 64;
+        
+        InlineTask() : m_ops(nullptr) {};
+        
+        template<typename F, typename Fn = typename std::decay<F>::type,
+                 typename = typename std::enable_if<!std::is_same<Fn, InlineTask>::value>::type>
+        InlineTask(F&& f) : m_ops(&OpsFor<Fn>::ops) {
+            OpsFor<Fn>::construct(&m_storage, std::forward<F>(f));
+        };
+        
+        InlineTask(InlineTask&& other) : m_ops(other.m_ops) {
+            if(m_ops) {
+                m_ops->move(&m_storage, &other.m_storage);
+                other.m_ops = nullptr;
+            }
+        };
+        
+        InlineTask& operator=(InlineTask&& other) {
+            if(this != &other) {
+                reset();
+                m_ops = other.m_ops;
+                if(m_ops) {
+                    m_ops->move(&m_storage, &other.m_storage);
+                    other.m_ops = nullptr;
+                }
+            }
+            return *this;
+        };
+        
+        InlineTask(const InlineTask&) = delete;
+        InlineTask& operator=(const InlineTask&) = delete;
+        
+        ~InlineTask() { reset(); };
+        
+        void operator()() { m_ops->invoke(&m_storage); };
+        
+        explicit operator bool() const { return m_ops != nullptr; };
+        
+        /*! Destroy the callable, releasing what it captured. */
+        void reset() {
+            if(m_ops) {
+                m_ops->destroy(&m_storage);
+                m_ops = nullptr;
+            }
+        };
+        
+    private:
+        typedef typename std::aligned_storage<kInlineSize, alignof(std::max_align_t)>::type Storage;
+        
+        struct Ops {
+            void (*invoke)(void* storage);
+            void (*move)(void* to, void* from);     /*!< Leaves from destroyed */
+            void (*destroy)(void* storage);
+        };
+        
+        template<typename Fn, bool Inline = (sizeof(Fn) <= kInlineSize && alignof(Fn) <= alignof(std::max_align_t)
+                                             && std::is_nothrow_move_constructible<Fn>::value)>
+        struct OpsFor {
+            template<typename F> static void construct(void* s, F&& f) { new (s) Fn(std::forward<F>(f)); }
+            static void invoke(void* s) { (*static_cast<Fn*>(s))(); }
+            static void move(void* to, void* from) {
+                new (to) Fn(std::move(*static_cast<Fn*>(from)));
+                static_cast<Fn*>(from)->~Fn();
+            }
+            static void destroy(void* s) { static_cast<Fn*>(s)->~Fn(); }
+            static const Ops ops;
+        };
+        
+        template<typename Fn>
+        struct OpsFor<Fn, false> {
+            template<typename F> static void construct(void* s, F&& f) { *static_cast<Fn**>(s) = new Fn(std::forward<F>(f)); }
+            static void invoke(void* s) { (**static_cast<Fn**>(s))(); }
+            static void move(void* to, void* from) { *static_cast<Fn**>(to) = *static_cast<Fn**>(from); }
+            static void destroy(void* s) { delete *static_cast<Fn**>(s); }
+            static const Ops ops;
+        };
+        
+        Storage    m_storage;
+        const Ops* m_ops;
+    };
+    
+    template<typename Fn, bool Inline>
+    const InlineTask::Ops InlineTask::OpsFor<Fn, Inline>::ops = { &OpsFor::invoke, &OpsFor::move, &OpsFor::destroy };
+    
+    template<typename Fn>
+    const InlineTask::Ops InlineTask::OpsFor<Fn, false>::ops = { &OpsFor::invoke, &OpsFor::move, &OpsFor::destroy };
+}
+
+#endif
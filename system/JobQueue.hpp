@@ -32,17 +32,31 @@
 #else
 #define _USE_GCD 0
 #include <sys/prctl.h>
-#define pthread_setname_np(thread_name) prctl(PR_SET_NAME, thread_name)
 #endif
 #include <condition_variable>
 #include <atomic>
 #include <mutex>
 #include <thread>
-#include <queue>
 #include <functional>
 #include <chrono>
 #include <iostream>
 #include <pthread.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+#if !_USE_GCD
+// After the system headers, which declare the two-argument Linux pthread_setname_np.
+#define pthread_setname_np(thread_name) prctl(PR_SET_NAME, thread_name)
+#endif
+#include <VideoCore/system/BoundedQueue.hpp>
+#include <VideoCore/system/Executor.h>
+#include <VideoCore/system/InlineTask.hpp>
+#include <VideoCore/system/QueueMetrics.h>
+#include <VideoCore/system/TimerWheel.h>
+#include <deque>
+#include <vector>
 
 namespace videocore {
     
@@ -70,15 +84,57 @@ namespace videocore {
         bool m_done;
 
     };
+    /*!
+     *  A serial queue of jobs run in order; on Apple platforms, a GCD queue.
+     *
+     *  Elsewhere it is a strand on the shared Executor: jobs go into a fixed ring of InlineTasks, and the first job
+     *  enqueued while the queue is idle submits it to the pool in the lane of its priority.  A worker then runs up
+     *  to kBatchSize jobs, one at a time and in order, and puts the queue back in line if there are more, so no
+     *  queue holds a thread it is not using.  Back in line means at the back of the lane's shared queue: a queue
+     *  with jobs waits at most for every other busy queue of its priority, and any of a higher one, to run a batch
+     *  each, however busy they are, so a busy queue cannot starve the rest of its priority.  Enqueuing a lambda with a few
+     *  captures takes neither a lock nor an allocation, and any number of threads may enqueue at once.  A producer
+     *  that finds the ring full waits for room, unless it is running on the queue itself, in which case it runs
+     *  the job there and then rather than wait on itself.
+     *
+     *  After mark_exiting() jobs still queued, or enqueued later, are skipped, but synchronous jobs still run, so
+     *  enqueue_sync() of an empty job waits for the one in progress.  Each synchronous call waits on a latch of its
+     *  own, and one made from the queue's own thread runs the job straight away.
+     *
+     *  Jobs can also be enqueued later or periodically, by the shared TimerWheel; a Job with a dispatch date in the
+     *  future waits for it.  Timers that fire after the queue is gone do nothing, and its periodic ones stop.  A
+     *  timer never waits for room in a full ring, as that would hold up every timer in the process; its job is
+     *  kept aside and run before those in the ring.
+     *
+     *  While QueueMetrics are enabled the queue records its depth and how long each job waits and runs, under its
+     *  name; see metrics().
+     */
     class JobQueue
     {
     public:
-        JobQueue(std::string name = "", JobQueuePriority priority = kJobQueuePriorityDefault) : m_exiting(false)
+        static const size_t kCapacity = 1024;
+        static const size_t kBatchSize = 64;    /*!< Jobs run each time the queue gets a worker */
+        static const int    kFullSpins = 16;    /*!< Yields before a producer sleeps on a full ring */
+        
+        JobQueue(std::string name = "", JobQueuePriority priority = kJobQueuePriorityDefault) :
+        m_metrics(name),
+#if !_USE_GCD
+        m_strand(*this), m_tasks(kCapacity), m_pending(0), m_stopping(false), m_retired(false),
+        m_waitingForRoom(0), m_roomGeneration(0), m_popsSinceRoom(0), m_overflowCount(0),
+#endif
+        m_exiting(false), m_timerTarget(std::make_shared<TimerTarget>(this))
         {
 #if !_USE_GCD
-            m_thread = std::thread([&]() { thread(); });
-            if(name.size() > 0) {
-                enqueue([=]() { pthread_setname_np(name.c_str()); });
+            switch (priority) {
+                case kJobQueuePriorityDefault:
+                    m_lane = kExecutorLaneDefault;
+                    break;
+                case kJobQueuePriorityHigh:
+                    m_lane = kExecutorLaneHigh;
+                    break;
+                case kJobQueuePriorityLow:
+                    m_lane = kExecutorLaneLow;
+                    break;
             }
 #else
             m_queue = dispatch_queue_create(name.c_str(), 0);
@@ -95,14 +151,38 @@ namespace videocore {
                     break;
             }
             dispatch_set_target_queue(m_queue, dispatch_get_global_queue(p, 0 ));
+            dispatch_queue_set_specific(m_queue, this, this, nullptr);
 #endif
         }
         ~JobQueue()
         {
+            std::vector<TimerId> periodic;
+            {
+                // Timers that have the queue in hand are only pushing a job, which never waits.
+                std::unique_lock<std::mutex> l(m_timerTarget->mutex);
+                m_timerTarget->queue = nullptr;
+                periodic.swap(m_timerTarget->periodic);
+                m_timerTarget->idle.wait(l, [&]() { return m_timerTarget->firing == 0; });
+            }
+            for ( auto it = periodic.begin() ; it != periodic.end() ; ++it ) {
+                TimerWheel::shared().cancel(*it);
+            }
             m_exiting = true;
 #if !_USE_GCD
-            m_cond.notify_all();
-            m_thread.join();
+            m_stopping = true;
+            {
+                std::lock_guard<std::mutex> l(m_stateMutex);
+                m_roomCond.notify_all();
+            }
+            if(m_pending.fetch_add(1) == 0) {
+                // Idle: nothing runs the queue but this.
+                drop();
+            } else {
+                // Running or in line to; the run drops what is left and lets go.
+                Executor::Blocking blocking;
+                std::unique_lock<std::mutex> l(m_stateMutex);
+                m_retiredCond.wait(l, [&]() { return m_retired; });
+            }
 #else
             dispatch_sync(m_queue, ^{});
             dispatch_release(m_queue);
@@ -111,77 +191,554 @@ namespace videocore {
         void mark_exiting() {
             m_exiting = true;
         }
-        void enqueue(std::function<void()> job) {
-            enqueue(std::make_shared<Job>(job));
+        template<typename F>
+        void enqueue(F&& job) {
+#if !_USE_GCD
+            push(asyncTask(std::forward<F>(job)));
+#else
+            enqueue(std::make_shared<Job>(std::function<void()>(std::forward<F>(job))));
+#endif
         }
         void enqueue(std::shared_ptr<Job> job) {
+            if(job->dispatchDate() > std::chrono::steady_clock::now()) {
+                enqueue_at(job->dispatchDate(), [job]() { (*job)(); });
+                return;
+            }
 #if !_USE_GCD
-            m_jobMutex.lock();
-            m_jobs.push(job);
-            m_jobMutex.unlock();
-            m_cond.notify_all();
+            enqueue([job]() { (*job)(); });
 #else
+            QueueMetrics::Recorder* recorder = m_metrics.recorder();
+            const uint64_t enqueued = recorder ? recorder->enqueued() : 0;
             dispatch_async(m_queue, ^{
                 if(!this->m_exiting.load()) {
+                    JobTiming timing(recorder, enqueued);
                     (*job)();
+                } else if(recorder) {
+                    recorder->dropped();
                 }
             });
 #endif
         }
-        void enqueue_sync(std::function<void()> job) {
-            enqueue_sync(std::make_shared<Job>(job));
-        }
-        void enqueue_sync(std::shared_ptr<Job> job) {
+        
+        /*!
+         *  Run a job on the queue and wait for it.  Called from the queue itself, the job runs in place.
+         *
+         *  \return false if the queue was destroyed before the job could run.
+         */
+        template<typename F>
+        bool enqueue_sync(F&& job) {
+            if(isCurrent()) {
+                job();
+                return true;
+            }
 #if !_USE_GCD
-            job->m_isSynchronous = true;
-            enqueue(job);
-            std::unique_lock<std::mutex> lk(m_doneMutex);
-            if(!job->done()) {
-                m_jobDoneCond.wait(lk);
+            SyncLatch latch;
+            typedef typename std::decay<F>::type Fn;
+            QueueMetrics::Recorder* recorder = m_metrics.recorder();
+            if(recorder) {
+                push(InlineTask(SyncTask<TimedJob<Fn>, SyncLatch*>(TimedJob<Fn>(std::forward<F>(job), recorder), &latch)));
+            } else {
+                push(InlineTask(SyncTask<Fn, SyncLatch*>(std::forward<F>(job), &latch)));
             }
+            Executor::Blocking blocking;
+            return latch.wait();
 #else
+            const std::function<void()> fn(std::forward<F>(job));
+            QueueMetrics::Recorder* recorder = m_metrics.recorder();
+            const uint64_t enqueued = recorder ? recorder->enqueued() : 0;
             dispatch_sync(m_queue, ^{
-                (*job)();
+                JobTiming timing(recorder, enqueued);
+                fn();
             });
+            return true;
 #endif
         }
-        void set_name(std::string name) {
+        bool enqueue_sync(std::shared_ptr<Job> job) {
+            job->m_isSynchronous = true;
+            return enqueue_sync([job]() { (*job)(); });
+        }
+        
+        /*!
+         *  Run a job on the queue and wait for it until a deadline.  A job that has not started by then is
+         *  cancelled; one that has is waited for, since it may be using whatever the caller is about to release.
+         *
+         *  \return true if the job ran.
+         */
+        template<typename F>
+        bool enqueue_sync_until(F&& job, std::chrono::steady_clock::time_point deadline) {
+            if(isCurrent()) {
+                job();
+                return true;
+            }
+            // Shared, as a cancelled job still holds the latch when it reaches the front of the queue.
+            std::shared_ptr<SyncLatch> latch = std::make_shared<SyncLatch>();
 #if !_USE_GCD
-            enqueue([=]() { pthread_setname_np(name.c_str()); });
+            typedef typename std::decay<F>::type Fn;
+            QueueMetrics::Recorder* recorder = m_metrics.recorder();
+            if(recorder) {
+                push(InlineTask(SyncTask<TimedJob<Fn>, std::shared_ptr<SyncLatch>>(TimedJob<Fn>(std::forward<F>(job), recorder), latch)));
+            } else {
+                push(InlineTask(SyncTask<Fn, std::shared_ptr<SyncLatch>>(std::forward<F>(job), latch)));
+            }
+#else
+            const std::function<void()> fn(std::forward<F>(job));
+            QueueMetrics::Recorder* recorder = m_metrics.recorder();
+            const uint64_t enqueued = recorder ? recorder->enqueued() : 0;
+            dispatch_async(m_queue, ^{
+                if(latch->begin()) {
+                    {
+                        // Recorded before the caller is let go.
+                        JobTiming timing(recorder, enqueued);
+                        fn();
+                    }
+                    latch->finish(SyncLatch::kSyncDone);
+                } else if(recorder) {
+                    recorder->dropped();
+                }
+            });
+#endif
+            Executor::Blocking blocking;
+            return latch->wait_until(deadline);
+        }
+        template<typename F, typename Rep, typename Period>
+        bool enqueue_sync_for(F&& job, const std::chrono::duration<Rep, Period>& timeout) {
+            return enqueue_sync_until(std::forward<F>(job), std::chrono::steady_clock::now() +
+                                      std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout));
+        }
+        
+        /*!
+         *  Enqueue a job once a deadline has passed.
+         *
+         *  \return The timer, for cancel().
+         */
+        template<typename F>
+        TimerId enqueue_at(std::chrono::steady_clock::time_point deadline, F&& job) {
+            return TimerWheel::shared().schedule(deadline, DelayedTask<typename std::decay<F>::type>(m_timerTarget, std::forward<F>(job)));
+        }
+        template<typename F, typename Rep, typename Period>
+        TimerId enqueue_after(const std::chrono::duration<Rep, Period>& delay, F&& job) {
+            return enqueue_at(std::chrono::steady_clock::now() +
+                              std::chrono::duration_cast<std::chrono::steady_clock::duration>(delay), std::forward<F>(job));
+        }
+        
+        /*!
+         *  Enqueue a job at first and then every period, measured from first so that it does not drift, until the
+         *  timer is cancelled or the queue destroyed.
+         *
+         *  \return The timer, for cancel().
+         */
+        template<typename F>
+        TimerId enqueue_periodic(std::chrono::steady_clock::time_point first, std::chrono::steady_clock::duration period, F&& job) {
+            std::shared_ptr<TimerTarget> target = m_timerTarget;
+            std::shared_ptr<typename std::decay<F>::type> fn = std::make_shared<typename std::decay<F>::type>(std::forward<F>(job));
+            const TimerId id = TimerWheel::shared().schedulePeriodic(first, period, [target, fn]() {
+                if(JobQueue* queue = target->acquire()) {
+                    queue->enqueueFromTimer([fn]() { (*fn)(); });
+                    target->release();
+                }
+            });
+            std::lock_guard<std::mutex> l(target->mutex);
+            target->periodic.push_back(id);
+            return id;
+        }
+        
+        /*!
+         *  Cancel a timer from enqueue_at, enqueue_after or enqueue_periodic.  Jobs it has already enqueued still run.
+         *
+         *  \return false if it had already fired, or been cancelled.
+         */
+        bool cancel(TimerId timer) {
+            {
+                std::lock_guard<std::mutex> l(m_timerTarget->mutex);
+                std::vector<TimerId>& periodic = m_timerTarget->periodic;
+                periodic.erase(std::remove(periodic.begin(), periodic.end(), timer), periodic.end());
+            }
+            return TimerWheel::shared().cancel(timer);
+        }
+        
+        /*! Whether the caller is running on this queue. */
+        bool isCurrent() const {
+#if !_USE_GCD
+            return Executor::current() == &m_strand;
+#else
+            return dispatch_get_specific(this) == this;
 #endif
         }
+        
+        /*! The name the queue's metrics are kept under; on Apple platforms, the GCD queue keeps its label. */
+        void set_name(std::string name) {
+            m_metrics.setName(name);
+        }
+        
+        /*! Jobs that run for longer than budget count as over it in the queue's metrics.  10 ms unless set. */
+        void set_job_budget(std::chrono::steady_clock::duration budget) {
+            m_metrics.setBudget(budget);
+        }
+        
+        /*!
+         *  What the queue has recorded while QueueMetrics were enabled.  QueueMetrics::snapshot() has every queue's.
+         *
+         *  \return false if they never have been.
+         */
+        bool metrics(QueueMetrics::Stats& stats) const {
+            return m_metrics.stats(stats);
+        }
     private:
+        /*! Times one job into its queue's Recorder, if it had one when the job was enqueued. */
+        class JobTiming {
+        public:
+            JobTiming(QueueMetrics::Recorder* recorder, uint64_t enqueued)
+            : m_recorder(recorder), m_enqueued(enqueued), m_started(recorder ? QueueMetrics::Recorder::now() : 0) {};
+            ~JobTiming() {
+                if(m_recorder) {
+                    m_recorder->ran(m_enqueued, m_started);
+                }
+            };
+        private:
+            QueueMetrics::Recorder* m_recorder;
+            uint64_t                m_enqueued;
+            uint64_t                m_started;
+        };
+        
+        /*! What timers enqueue onto; outlives the queue so that a late timer can tell it is gone. */
+        struct TimerTarget {
+            TimerTarget(JobQueue* queue) : queue(queue), firing(0) {};
+            
+            /*! The queue, kept alive until release(); nullptr once it is being destroyed. */
+            JobQueue* acquire() {
+                std::lock_guard<std::mutex> l(mutex);
+                if(queue) {
+                    ++firing;
+                }
+                return queue;
+            };
+            void release() {
+                std::lock_guard<std::mutex> l(mutex);
+                if(--firing == 0) {
+                    idle.notify_all();
+                }
+            };
+            
+            std::mutex              mutex;
+            std::condition_variable idle;
+            JobQueue*               queue;      /*!< nullptr once the queue is being destroyed */
+            int                     firing;     /*!< Timers between acquire() and release() */
+            std::vector<TimerId>    periodic;
+        };
+        
+        /*! A job waiting on a timer. */
+        template<typename F>
+        class DelayedTask {
+        public:
+            template<typename G>
+            DelayedTask(const std::shared_ptr<TimerTarget>& target, G&& job) : m_target(target), m_job(std::forward<G>(job)) {};
+            
+            void operator()() {
+                if(JobQueue* queue = m_target->acquire()) {
+                    queue->enqueueFromTimer(std::move(m_job));
+                    m_target->release();
+                }
+            };
+        private:
+            std::shared_ptr<TimerTarget> m_target;
+            F                            m_job;
+        };
+        
+        /*!
+         *  enqueue() for the timer thread, which runs every timer in the process and so must never wait: a job that
+         *  finds the ring full goes on an overflow list instead, which the queue takes from before the ring.
+         */
+        template<typename F>
+        void enqueueFromTimer(F&& job) {
 #if !_USE_GCD
-        void thread() {
-            do {
+            InlineTask task(asyncTask(std::forward<F>(job)));
+            if(!m_tasks.push(std::move(task))) {
+                if(m_stopping.load()) {
+                    return;
+                }
+                std::lock_guard<std::mutex> l(m_overflowMutex);
+                m_overflow.push_back(std::move(task));
+                m_overflowCount.store(m_overflow.size(), std::memory_order_release);
+            }
+            pushed();
+#else
+            enqueue(std::forward<F>(job));
+#endif
+        }
+        
+        /*! Completion of one synchronous job, for the one caller waiting on it. */
+        class SyncLatch {
+        public:
+            typedef enum {
+                kSyncPending,
+                kSyncRunning,
+                kSyncDone,
+                kSyncDropped,   /*!< The queue was destroyed first */
+                kSyncAbandoned  /*!< The caller gave up waiting first */
+            } State;
+            
+            SyncLatch() : m_state(kSyncPending) {};
+            
+            /*! Claim the job to run or drop it.  False if the caller has abandoned it. */
+            bool begin() {
+                int expected = kSyncPending;
+                return m_state.compare_exchange_strong(expected, kSyncRunning);
+            };
+            /*! The latch may be destroyed as soon as this returns. */
+            void finish(State state) {
+                std::lock_guard<std::mutex> l(m_mutex);
+                m_state.store(state);
+                m_cond.notify_all();
+            };
+            bool wait() {
+                std::unique_lock<std::mutex> l(m_mutex);
+                m_cond.wait(l, [&]() { return finished(); });
+                return m_state.load() == kSyncDone;
+            };
+            bool wait_until(std::chrono::steady_clock::time_point deadline) {
                 std::unique_lock<std::mutex> l(m_mutex);
-                
-                m_jobMutex.lock();
-                if(m_jobs.size() > 0) {
-                    auto j = m_jobs.front();
-                    m_jobs.pop();
-                    m_jobMutex.unlock();
-                    (*j)();
-                    if(j->m_isSynchronous) {
-                        m_jobDoneCond.notify_one();
+                if(!m_cond.wait_until(l, deadline, [&]() { return finished(); })) {
+                    int expected = kSyncPending;
+                    if(m_state.compare_exchange_strong(expected, kSyncAbandoned)) {
+                        return false;
                     }
-                } else {
-                    m_jobMutex.unlock();
-                    m_cond.wait(l);
+                    m_cond.wait(l, [&]() { return finished(); });
+                }
+                return m_state.load() == kSyncDone;
+            };
+            
+        private:
+            bool finished() const { return m_state.load() >= kSyncDone; };
+            
+            std::mutex              m_mutex;
+            std::condition_variable m_cond;
+            std::atomic<int>        m_state;
+        };
+        
+#if !_USE_GCD
+        /*! An asynchronous job, skipped once the queue is exiting. */
+        template<typename F>
+        class AsyncTask {
+        public:
+            template<typename G>
+            AsyncTask(JobQueue* queue, G&& job) : m_queue(queue), m_job(std::forward<G>(job)) {};
+            
+            void operator()() {
+                if(!m_queue->m_exiting.load(std::memory_order_relaxed)) {
+                    m_job();
+                }
+            };
+        private:
+            JobQueue* m_queue;
+            F         m_job;
+        };
+        
+        /*! A synchronous job; it signals its latch whether it runs or is dropped with the queue. */
+        template<typename F, typename Latch>
+        class SyncTask {
+        public:
+            template<typename G>
+            SyncTask(G&& job, Latch latch) : m_job(std::forward<G>(job)), m_latch(std::move(latch)) {};
+            
+            SyncTask(SyncTask&& other) noexcept(std::is_nothrow_move_constructible<F>::value)
+            : m_job(std::move(other.m_job)), m_latch(std::move(other.m_latch)) {
+                other.m_latch = Latch();
+            };
+            
+            ~SyncTask() {
+                if(m_latch && m_latch->begin()) {
+                    m_latch->finish(SyncLatch::kSyncDropped);
+                }
+            };
+            
+            void operator()() {
+                Latch latch(std::move(m_latch));
+                m_latch = Latch();
+                if(latch->begin()) {
+                    m_job();
+                    latch->finish(SyncLatch::kSyncDone);
                 }
-            } while(!(m_exiting.load()));
+            };
+        private:
+            F     m_job;
+            Latch m_latch;
+        };
+        
+        /*!
+         *  A job enqueued while metrics were on.  It goes inside the AsyncTask or SyncTask, so that a job that is
+         *  skipped or dropped is not timed, and a synchronous one is recorded before its caller is let go.
+         */
+        template<typename F>
+        class TimedJob {
+        public:
+            template<typename G>
+            TimedJob(G&& job, QueueMetrics::Recorder* recorder)
+            : m_job(std::forward<G>(job)), m_recorder(recorder), m_enqueued(recorder->enqueued()) {};
+            
+            TimedJob(TimedJob&& other) noexcept(std::is_nothrow_move_constructible<F>::value)
+            : m_job(std::move(other.m_job)), m_recorder(other.m_recorder), m_enqueued(other.m_enqueued) {
+                other.m_recorder = nullptr;
+            };
+            
+            ~TimedJob() {
+                if(m_recorder) {
+                    m_recorder->dropped();
+                }
+            };
+            
+            void operator()() {
+                JobTiming timing(m_recorder, m_enqueued);
+                m_recorder = nullptr;
+                m_job();
+            };
+        private:
+            F                       m_job;
+            QueueMetrics::Recorder* m_recorder;     /*!< nullptr once run */
+            uint64_t                m_enqueued;
+        };
+        
+        /*! An asynchronous job, timed while metrics are on. */
+        template<typename F>
+        InlineTask asyncTask(F&& job) {
+            typedef typename std::decay<F>::type Fn;
+            QueueMetrics::Recorder* recorder = m_metrics.recorder();
+            if(recorder) {
+                return InlineTask(AsyncTask<TimedJob<Fn>>(this, TimedJob<Fn>(std::forward<F>(job), recorder)));
+            }
+            return InlineTask(AsyncTask<Fn>(this, std::forward<F>(job)));
+        }
+        
+        /*! Runs the queue's jobs on a worker of the Executor. */
+        class Strand : public Executor::Runnable {
+        public:
+            Strand(JobQueue& queue) : m_queue(queue) {};
+            void run() { m_queue.run(); };
+        private:
+            JobQueue& m_queue;
+        };
+        
+        void push(InlineTask&& task) {
+            for ( int attempt = 0 ; !m_tasks.push(std::move(task)) ; ++attempt ) {
+                if(m_stopping.load()) {
+                    // Nothing will run it; dropping it releases a synchronous caller.
+                    return;
+                }
+                if(isCurrent()) {
+                    task();
+                    return;
+                }
+                if(attempt < kFullSpins) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                // Full for a while: sleep until the queue takes a job.  Registering, then trying once more, pairs
+                // with the fence in popped() so that the last pop before a wait cannot go unnoticed.
+                Executor::Blocking blocking;
+                std::unique_lock<std::mutex> l(m_stateMutex);
+                m_waitingForRoom.fetch_add(1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                const uint64_t generation = m_roomGeneration;
+                if(!m_tasks.push(std::move(task))) {
+                    m_roomCond.wait(l, [&]() { return m_roomGeneration != generation || m_stopping.load(); });
+                    m_waitingForRoom.fetch_sub(1, std::memory_order_relaxed);
+                    continue;
+                }
+                m_waitingForRoom.fetch_sub(1, std::memory_order_relaxed);
+                break;
+            }
+            pushed();
+        }
+        void pushed() {
+            // Only counted once it is in the ring or the overflow, so a run never expects more jobs than it can
+            // take.  Whoever takes the count off zero puts the queue in line.
+            if(m_pending.fetch_add(1, std::memory_order_acq_rel) == 0) {
+                Executor::shared().submit(&m_strand, m_lane);
+            }
+        }
+        /*! The oldest job left over from a full ring, if any; a load while there are none. */
+        bool popOverflow(InlineTask& task) {
+            if(!m_overflowCount.load(std::memory_order_acquire)) {
+                return false;
+            }
+            std::lock_guard<std::mutex> l(m_overflowMutex);
+            if(m_overflow.empty()) {
+                return false;
+            }
+            task = std::move(m_overflow.front());
+            m_overflow.pop_front();
+            m_overflowCount.store(m_overflow.size(), std::memory_order_release);
+            return true;
+        }
+        void popped() {
+            // A producer only sleeps on a full ring, so at least kCapacity pops follow; waking it once a quarter of
+            // the ring is free saves waking every producer for every job.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if(m_waitingForRoom.load(std::memory_order_relaxed) && ++m_popsSinceRoom >= kCapacity / 4) {
+                m_popsSinceRoom = 0;
+                {
+                    std::lock_guard<std::mutex> l(m_stateMutex);
+                    ++m_roomGeneration;
+                }
+                m_roomCond.notify_all();
+            }
+        }
+        void run() {
+            InlineTask task;
+            const size_t budget = std::min(m_pending.load(std::memory_order_acquire), size_t(kBatchSize));
+            size_t ran = 0;
+            while(ran < budget && !m_stopping.load() && (popOverflow(task) || m_tasks.pop(task))) {
+                ++ran;
+                popped();
+                task();
+                task.reset();
+            }
+            if(m_stopping.load()) {
+                drop();
+                std::lock_guard<std::mutex> l(m_stateMutex);
+                m_retired = true;
+                m_retiredCond.notify_all();
+                return;
+            }
+            if(!ran) {
+                // The next job is still being written by a producer that was preempted; let it finish.
+                std::this_thread::yield();
+            }
+            // Once the count reaches zero the queue may be destroyed; nothing here may touch it after that.
+            if(m_pending.fetch_sub(ran, std::memory_order_acq_rel) != ran) {
+                // Behind the other queues of the lane, not back onto this worker's deque to be picked again at once.
+                Executor::shared().resubmit(&m_strand, m_lane);
+            }
+        }
+        /*! Jobs left behind are dropped, as before, which releases anyone waiting on one synchronously. */
+        void drop() {
+            InlineTask task;
+            while(m_tasks.pop(task) || popOverflow(task)) {
+                task.reset();
+            }
         }
 #endif
     private:
+        QueueMetrics                m_metrics;          /*!< First, so that it outlives the jobs that record into it */
 #if !_USE_GCD
-        std::thread                 m_thread;
-        std::mutex                  m_mutex, m_jobMutex, m_doneMutex;
-        std::condition_variable     m_cond, m_jobDoneCond;
-        std::queue<std::shared_ptr<Job>>             m_jobs;
+        Strand                      m_strand;
+        BoundedQueue<InlineTask>    m_tasks;
+        ExecutorLane                m_lane;
+        std::atomic<size_t>         m_pending;          /*!< Jobs in the ring and the overflow; not zero while the queue is in line or running */
+        std::atomic<bool>           m_stopping;         /*!< The queue is being destroyed */
+        bool                        m_retired;          /*!< The last run has let go; guarded by m_stateMutex */
+        std::atomic<int>            m_waitingForRoom;   /*!< Producers asleep, or about to be, on m_roomCond */
+        uint64_t                    m_roomGeneration;   /*!< Wakeups of waiting producers; guarded by m_stateMutex */
+        size_t                      m_popsSinceRoom;    /*!< Runs only */
+        std::deque<InlineTask>      m_overflow;         /*!< Timer jobs that found the ring full; guarded by m_overflowMutex */
+        std::atomic<size_t>         m_overflowCount;
+        std::mutex                  m_overflowMutex;
+        std::mutex                  m_stateMutex;
+        std::condition_variable     m_roomCond, m_retiredCond;
 #else
         dispatch_queue_t            m_queue;
 #endif
         std::atomic<bool>           m_exiting;
+        std::shared_ptr<TimerTarget> m_timerTarget;
         
     };
 }
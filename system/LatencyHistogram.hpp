@@ -0,0 +1,151 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+#ifndef videocore_LatencyHistogram_hpp
+#define videocore_LatencyHistogram_hpp
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <stdint.h>
+
+namespace videocore {
+    
+    /*!
+     *  A histogram of durations in nanoseconds that any number of threads can record into without a lock.
+     *
+     *  Buckets are log-linear, as in HdrHistogram: each power of two is split into kSubBuckets, so every value is
+     *  kept to within 1 / kSubBuckets of itself, about 6%, from a nanosecond up to the 2^kMaxBits ns (some 18
+     *  minutes) that anything longer is counted as.  Recording is a count of leading zeros and a few relaxed atomics.
+     */
+    class LatencyHistogram
+    {
+    public:
+        static const int kSubBucketBits = 4;
+        static const int kSubBuckets = 1 << kSubBucketBits;
+        static const int kMaxBits = 40;
+        static const int kBuckets = (kMaxBits - kSubBucketBits + 1) * kSubBuckets;
+        
+        /*! A copy of the counts, to read at leisure. */
+        struct Snapshot {
+            uint64_t counts[kBuckets];
+            uint64_t count;
+            uint64_t total;     /*!< Sum of the values, for the mean */
+            uint64_t max;
+            
+            Snapshot() : count(0), total(0), max(0) { std::fill(counts, counts + kBuckets, uint64_t(0)); };
+            
+            uint64_t mean() const { return count ? total / count : 0; };
+            
+            /*! The value that fraction (0 to 1) of the samples are at or below, to the resolution of its bucket. */
+            uint64_t percentile(double fraction) const {
+                if(!count) {
+                    return 0;
+                }
+                const uint64_t rank = std::max(uint64_t(1), uint64_t(fraction * count + 0.5));
+                uint64_t seen = 0;
+                for ( int i = 0 ; i < kBuckets ; ++i ) {
+                    seen += counts[i];
+                    if(seen >= rank) {
+                        return std::min(upperBound(i), max);
+                    }
+                }
+                return max;
+            };
+            
+            /*! Add another histogram's samples, as when several queues share a name. */
+            void merge(const Snapshot& other) {
+                for ( int i = 0 ; i < kBuckets ; ++i ) {
+                    counts[i] += other.counts[i];
+                }
+                count += other.count;
+                total += other.total;
+                max = std::max(max, other.max);
+            };
+        };
+        
+        LatencyHistogram() : m_total(0), m_max(0) {
+            for ( int i = 0 ; i < kBuckets ; ++i ) {
+                m_counts[i].store(0, std::memory_order_relaxed);
+            }
+        };
+        
+        void record(uint64_t ns) {
+            m_counts[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+            m_total.fetch_add(ns, std::memory_order_relaxed);
+            uint64_t max = m_max.load(std::memory_order_relaxed);
+            while(ns > max && !m_max.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {}
+        };
+        
+        /*! record(), for writers that are already serialised, such as the jobs of one queue: no atomic adds. */
+        void recordSerial(uint64_t ns) {
+            std::atomic<uint64_t>& count = m_counts[bucket(ns)];
+            count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            m_total.store(m_total.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+            if(ns > m_max.load(std::memory_order_relaxed)) {
+                m_max.store(ns, std::memory_order_relaxed);
+            }
+        };
+        
+        /*! Counts recorded meanwhile may or may not be included, and count is their sum, so it always agrees. */
+        Snapshot snapshot() const {
+            Snapshot s;
+            for ( int i = 0 ; i < kBuckets ; ++i ) {
+                s.counts[i] = m_counts[i].load(std::memory_order_relaxed);
+                s.count += s.counts[i];
+            }
+            s.total = m_total.load(std::memory_order_relaxed);
+            s.max = m_max.load(std::memory_order_relaxed);
+            return s;
+        };
+        
+        static int bucket(uint64_t ns) {
+            if(ns < uint64_t(kSubBuckets)) {
+                return int(ns);
+            }
+            if(ns >> kMaxBits) {
+                return kBuckets - 1;
+            }
+            const int msb = 63 - __builtin_clzll(ns);
+            const int shift = msb - kSubBucketBits;
+            return (shift + 1) * kSubBuckets + int(ns >> shift) - kSubBuckets;
+        };
+        
+        /*! The largest value counted in bucket i. */
+        static uint64_t upperBound(int i) {
+            if(i < kSubBuckets) {
+                return uint64_t(i);
+            }
+            const int shift = i / kSubBuckets - 1;
+            return ((uint64_t(kSubBuckets + i % kSubBuckets + 1)) << shift) - 1;
+        };
+        
+    private:
+        std::atomic<uint64_t> m_counts[kBuckets];
+        std::atomic<uint64_t> m_total;
+        std::atomic<uint64_t> m_max;
+    };
+}
+
+#endif
@@ -0,0 +1,71 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+#ifndef videocore_MediaTime_hpp
+#define videocore_MediaTime_hpp
+
+#include <stdint.h>
+
+namespace videocore {
+    
+    /*!
+     *  A point on a media timeline as a count of ticks of a rational timebase: value / timescale seconds, such as a
+     *  sample index over the sampling rate.  It is exact however long a stream runs, so timestamps in coarser units
+     *  are derived from it where they are needed rather than accumulated.  A timescale of 0 means no time.
+     */
+    struct MediaTime {
+        MediaTime() : value(0), timescale(0) {};
+        MediaTime(int64_t value, int32_t timescale) : value(value), timescale(timescale) {};
+        
+        bool isValid() const { return timescale > 0; };
+        
+        double seconds() const { return isValid() ? double(value) / double(timescale) : 0.; };
+        
+        /*!
+         *  The time in ticks of 1/scale of a second, rounded to the nearest tick; halfway rounds up.  The result
+         *  never decreases as value grows, and does not overflow for any time that fits in the result.
+         */
+        int64_t rescale(int32_t scale) const {
+            if(!isValid()) {
+                return 0;
+            }
+            // Split off whole seconds so that only the remainder is multiplied.
+            int64_t q = value / timescale;
+            int64_t r = value % timescale;
+            if(r < 0) {
+                r += timescale;
+                --q;
+            }
+            return q * scale + (r * scale + timescale / 2) / timescale;
+        };
+        
+        /*! Rounded to whole milliseconds, as RTMP wants them. */
+        int64_t milliseconds() const { return rescale(1000); };
+        
+        int64_t value;      /*!< Ticks since the start of the timeline */
+        int32_t timescale;  /*!< Ticks per second */
+    };
+}
+
+#endif
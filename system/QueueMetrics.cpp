@@ -0,0 +1,165 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+#include <VideoCore/system/QueueMetrics.h>
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+namespace videocore {
+    
+    static const std::chrono::milliseconds kDefaultBudget(10);
+    
+    namespace {
+        /*! Every QueueMetrics alive, so that setEnabled() and snapshot() can reach them. */
+        struct Registry {
+            Registry() : enabled(false) {};
+            
+            std::mutex                  mutex;
+            std::vector<QueueMetrics*>  queues;
+            bool                        enabled;
+        };
+        
+        Registry& registry() {
+            // Leaked on purpose, like the Executor: queues owned by static objects may outlive it otherwise.
+            static Registry* s_registry = new Registry();
+            return *s_registry;
+        }
+    }
+    
+    void
+    QueueMetrics::Recorder::stats(Stats& stats) const
+    {
+        stats.queues = 1;
+        stats.depth = m_depth.load(std::memory_order_relaxed);
+        stats.maxDepth = m_maxDepth.load(std::memory_order_relaxed);
+        stats.overBudget = m_overBudget.load(std::memory_order_relaxed);
+        stats.wait = m_wait.snapshot();
+        stats.run = m_run.snapshot();
+    }
+    
+    void
+    QueueMetrics::setEnabled(bool enabled)
+    {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> l(r.mutex);
+        r.enabled = enabled;
+        for ( auto it = r.queues.begin() ; it != r.queues.end() ; ++it ) {
+            if(enabled) {
+                (*it)->attach();
+            } else {
+                (*it)->m_recorder.store(nullptr, std::memory_order_release);
+            }
+        }
+    }
+    
+    bool
+    QueueMetrics::enabled()
+    {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> l(r.mutex);
+        return r.enabled;
+    }
+    
+    std::map<std::string, QueueMetrics::Stats>
+    QueueMetrics::snapshot()
+    {
+        std::map<std::string, Stats> all;
+        Registry& r = registry();
+        std::lock_guard<std::mutex> l(r.mutex);
+        for ( auto it = r.queues.begin() ; it != r.queues.end() ; ++it ) {
+            const QueueMetrics& queue = **it;
+            if(!queue.m_storage) {
+                continue;
+            }
+            Stats stats;
+            queue.m_storage->stats(stats);
+            
+            Stats& named = all[queue.m_name];
+            named.queues += stats.queues;
+            named.depth += stats.depth;
+            named.maxDepth = std::max(named.maxDepth, stats.maxDepth);
+            named.overBudget += stats.overBudget;
+            named.wait.merge(stats.wait);
+            named.run.merge(stats.run);
+        }
+        return all;
+    }
+    
+    QueueMetrics::QueueMetrics(const std::string& name)
+    : m_name(name), m_budget(kDefaultBudget), m_recorder(nullptr)
+    {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> l(r.mutex);
+        r.queues.push_back(this);
+        if(r.enabled) {
+            attach();
+        }
+    }
+    
+    QueueMetrics::~QueueMetrics()
+    {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> l(r.mutex);
+        r.queues.erase(std::remove(r.queues.begin(), r.queues.end(), this), r.queues.end());
+    }
+    
+    void
+    QueueMetrics::setName(const std::string& name)
+    {
+        std::lock_guard<std::mutex> l(registry().mutex);
+        m_name = name;
+    }
+    
+    void
+    QueueMetrics::setBudget(Clock::duration budget)
+    {
+        std::lock_guard<std::mutex> l(registry().mutex);
+        m_budget = budget;
+        if(m_storage) {
+            m_storage->setBudget(budget);
+        }
+    }
+    
+    bool
+    QueueMetrics::stats(Stats& stats) const
+    {
+        std::lock_guard<std::mutex> l(registry().mutex);
+        if(!m_storage) {
+            return false;
+        }
+        m_storage->stats(stats);
+        return true;
+    }
+    
+    void
+    QueueMetrics::attach()
+    {
+        if(!m_storage) {
+            m_storage.reset(new Recorder(m_budget));
+        }
+        m_recorder.store(m_storage.get(), std::memory_order_release);
+    }
+}
@@ -0,0 +1,165 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+#ifndef __videocore__QueueMetrics__
+#define __videocore__QueueMetrics__
+
+#include <VideoCore/system/LatencyHistogram.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#ifdef __APPLE__
+#include <mach/mach_time.h>
+#endif
+
+namespace videocore {
+    
+    /*!
+     *  Optional measurements of one JobQueue: how deep it gets, how long its jobs wait and how long they run.
+     *
+     *  Metrics are off until setEnabled(true), which turns them on for every queue there is or will be.  While
+     *  they are off a queue pays one load per job.  While they are on it reads the clock once when a job is
+     *  enqueued and twice when it runs, and records into a Recorder of its own, without a lock.  What a queue has
+     *  recorded is kept for as long as it lives, including while metrics are off again.
+     */
+    class QueueMetrics
+    {
+    public:
+        typedef std::chrono::steady_clock Clock;
+        
+        /*! What a queue, or all the queues of one name, recorded. */
+        struct Stats {
+            size_t                      queues;     /*!< Queues that share the name */
+            uint64_t                    depth;      /*!< Jobs enqueued and not yet finished */
+            uint64_t                    maxDepth;   /*!< The most there have been at once in any one queue */
+            uint64_t                    overBudget; /*!< Jobs that ran for longer than their queue's budget */
+            LatencyHistogram::Snapshot  wait;       /*!< From enqueue to starting to run, in ns */
+            LatencyHistogram::Snapshot  run;        /*!< Running time, in ns */
+            
+            Stats() : queues(0), depth(0), maxDepth(0), overBudget(0) {};
+        };
+        
+        /*! Where a queue records while metrics are on. */
+        class Recorder {
+        public:
+            Recorder(Clock::duration budget) : m_budget(0), m_depth(0), m_maxDepth(0), m_overBudget(0) { setBudget(budget); };
+            
+            /*! A job was enqueued.  \return Its enqueue time, for ran(). */
+            uint64_t enqueued() {
+                const uint64_t depth = m_depth.fetch_add(1, std::memory_order_relaxed) + 1;
+                uint64_t max = m_maxDepth.load(std::memory_order_relaxed);
+                while(depth > max && !m_maxDepth.compare_exchange_weak(max, depth, std::memory_order_relaxed)) {}
+                return now();
+            };
+            
+            /*! A job enqueued at enqueuedAt ran from startedAt until now.  Called by the queue's jobs, in turn. */
+            void ran(uint64_t enqueuedAt, uint64_t startedAt) {
+                const uint64_t run = now() - startedAt;
+                m_wait.recordSerial(startedAt - enqueuedAt);
+                m_run.recordSerial(run);
+                if(run > m_budget.load(std::memory_order_relaxed)) {
+                    m_overBudget.store(m_overBudget.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                }
+                m_depth.fetch_sub(1, std::memory_order_relaxed);
+            };
+            
+            /*! A job was dropped with the queue instead of running. */
+            void dropped() { m_depth.fetch_sub(1, std::memory_order_relaxed); };
+            
+            void setBudget(Clock::duration budget) {
+                m_budget.store(std::chrono::duration_cast<std::chrono::nanoseconds>(budget).count(), std::memory_order_relaxed);
+            };
+            
+            void stats(Stats& stats) const;
+            
+            /*! Nanoseconds on a monotonic clock, from an arbitrary start; read three times for every job timed. */
+            static uint64_t now() {
+#ifdef __APPLE__
+                // Cheaper than steady_clock, which wraps this in a library call and a conversion of its own.
+                static const mach_timebase_info_data_t timebase = machTimebase();
+                return mach_absolute_time() * timebase.numer / timebase.denom;
+#else
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+#endif
+            };
+            
+        private:
+#ifdef __APPLE__
+            static mach_timebase_info_data_t machTimebase() {
+                mach_timebase_info_data_t timebase;
+                mach_timebase_info(&timebase);
+                return timebase;
+            };
+#endif
+            std::atomic<uint64_t>   m_budget;       /*!< ns */
+            std::atomic<uint64_t>   m_depth;
+            std::atomic<uint64_t>   m_maxDepth;
+            std::atomic<uint64_t>   m_overBudget;
+            LatencyHistogram        m_wait;
+            LatencyHistogram        m_run;
+        };
+        
+        /*! Turn metrics on or off for every queue. */
+        static void setEnabled(bool enabled);
+        static bool enabled();
+        
+        /*!
+         *  What every queue that has had metrics on recorded, by name.  Queues that share a name, such as those of
+         *  two sessions, are added together.
+         */
+        static std::map<std::string, Stats> snapshot();
+        
+        /*! Registers the queue; its Recorder is made the first time metrics are on. */
+        QueueMetrics(const std::string& name);
+        ~QueueMetrics();
+        
+        /*! Where to record the next job, or nullptr while metrics are off. */
+        Recorder* recorder() const { return m_recorder.load(std::memory_order_acquire); };
+        
+        void setName(const std::string& name);
+        
+        /*! Jobs that run longer than budget are counted in Stats::overBudget.  10 ms unless set. */
+        void setBudget(Clock::duration budget);
+        
+        /*! \return false if metrics have never been on for this queue. */
+        bool stats(Stats& stats) const;
+        
+    private:
+        QueueMetrics(const QueueMetrics&);
+        QueueMetrics& operator=(const QueueMetrics&);
+        
+        void attach();
+        
+        std::string                 m_name;     /*!< Guarded by the registry's mutex, as are m_budget and m_storage */
+        Clock::duration             m_budget;
+        std::unique_ptr<Recorder>   m_storage;  /*!< Kept once made, as jobs in the queue may still record into it */
+        std::atomic<Recorder*>      m_recorder;
+    };
+}
+
+#endif /* defined(__videocore__QueueMetrics__) */
@@ -0,0 +1,372 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+#include <VideoCore/system/TimerWheel.h>
+
+#include <algorithm>
+#include <pthread.h>
+#ifndef __APPLE__
+#include <sys/prctl.h>
+#endif
+
+namespace videocore {
+    
+    static const uint64_t kNever = UINT64_MAX;
+    
+    static inline uint64_t rotateRight(uint64_t x, int r) {
+        return r ? (x >> r) | (x << (64 - r)) : x;
+    }
+    static inline int lowestBit(uint64_t x) {
+        return __builtin_ctzll(x);
+    }
+    
+    TimerWheel&
+    TimerWheel::shared()
+    {
+        // Leaked on purpose, like Executor::shared().
+        static TimerWheel* s_shared = new TimerWheel(std::chrono::microseconds(250));
+        return *s_shared;
+    }
+    
+    TimerWheel::TimerWheel(Clock::duration tick)
+    : m_tick(std::max(tick, Clock::duration(1))), m_origin(Clock::now()), m_current(0), m_wakeTick(0),
+      m_generation(0), m_running(0), m_exiting(false)
+    {
+        for ( int level = 0 ; level < kLevels ; ++level ) {
+            std::fill(m_slots[level], m_slots[level] + kSlots, nullptr);
+            m_occupied[level] = 0;
+        }
+        m_stats.fired = 0;
+        m_stats.totalLateness = Clock::duration::zero();
+        m_stats.maxLateness = Clock::duration::zero();
+        m_thread = std::thread([this]() { thread(); });
+    }
+    
+    TimerWheel::~TimerWheel()
+    {
+        {
+            std::lock_guard<std::mutex> l(m_mutex);
+            m_exiting = true;
+        }
+        m_cond.notify_all();
+        m_thread.join();
+    }
+    
+    TimerId
+    TimerWheel::schedule(Clock::time_point deadline, InlineTask callback)
+    {
+        return add(deadline, Clock::duration::zero(), std::move(callback));
+    }
+    
+    TimerId
+    TimerWheel::schedulePeriodic(Clock::time_point first, Clock::duration period, InlineTask callback)
+    {
+        return add(first, std::max(period, Clock::duration(1)), std::move(callback));
+    }
+    
+    TimerId
+    TimerWheel::add(Clock::time_point deadline, Clock::duration period, InlineTask&& callback)
+    {
+        std::unique_lock<std::mutex> l(m_mutex);
+        uint32_t index;
+        if(m_free.empty()) {
+            index = uint32_t(m_timers.size());
+            m_timers.emplace_back();
+        } else {
+            index = m_free.back();
+            m_free.pop_back();
+        }
+        if(++m_generation == 0) {
+            m_generation = 1;
+        }
+        Timer* t = &m_timers[index];
+        t->id = (TimerId(m_generation) << 32) | index;
+        t->deadline = deadline;
+        t->period = period;
+        t->callback = std::move(callback);
+        t->cancelled = false;
+        // The thread may have slept through a few ticks; anything already due goes out on the next one.
+        t->expiry = std::max(tickAfter(deadline), m_current + 1);
+        insert(t);
+        
+        const TimerId id = t->id;
+        if(t->expiry < m_wakeTick) {
+            l.unlock();
+            m_cond.notify_one();
+        }
+        return id;
+    }
+    
+    bool
+    TimerWheel::cancel(TimerId id)
+    {
+        std::unique_lock<std::mutex> l(m_mutex);
+        const bool onTimerThread = std::this_thread::get_id() == m_thread.get_id();
+        Timer* t = find(id);
+        bool pending = false;
+        InlineTask dead;
+        if(t && !t->cancelled) {
+            pending = true;
+            if(t->slot >= 0) {
+                unlink(t);
+                dead = std::move(t->callback);
+                release(t);
+            } else {
+                // Running, or taken out of the wheel to fire; fire() lets it go.
+                t->cancelled = true;
+            }
+        }
+        if(!onTimerThread) {
+            m_firedCond.wait(l, [&]() { return m_running != id; });
+        }
+        l.unlock();
+        return pending;
+    }
+    
+    TimerWheel::Stats
+    TimerWheel::stats() const
+    {
+        std::lock_guard<std::mutex> l(m_mutex);
+        return m_stats;
+    }
+    
+    uint64_t
+    TimerWheel::tickAfter(Clock::time_point time) const
+    {
+        if(time <= m_origin) {
+            return 0;
+        }
+        const Clock::duration d = time - m_origin;
+        return uint64_t((d + m_tick - Clock::duration(1)) / m_tick);
+    }
+    
+    uint64_t
+    TimerWheel::tickBefore(Clock::time_point time) const
+    {
+        return time <= m_origin ? 0 : uint64_t((time - m_origin) / m_tick);
+    }
+    
+    void
+    TimerWheel::insert(Timer* t)
+    {
+        // Levels are chosen by distance and slots by the absolute tick, so a slot comes round exactly when its
+        // timers are due, or due to move down a level.
+        const uint64_t maxDistance = (uint64_t(1) << (kLevels * kSlotBits)) - 1;
+        const uint64_t distance = std::min(t->expiry - m_current, maxDistance);
+        const uint64_t target = m_current + distance;
+        int level = 0;
+        while(level < kLevels - 1 && distance >= (uint64_t(1) << (kSlotBits * (level + 1)))) {
+            ++level;
+        }
+        const int index = int(target >> (kSlotBits * level)) & (kSlots - 1);
+        
+        Timer*& head = m_slots[level][index];
+        t->prev = nullptr;
+        t->next = head;
+        if(head) {
+            head->prev = t;
+        }
+        head = t;
+        t->slot = level * kSlots + index;
+        m_occupied[level] |= uint64_t(1) << index;
+    }
+    
+    void
+    TimerWheel::unlink(Timer* t)
+    {
+        const int level = t->slot / kSlots;
+        const int index = t->slot % kSlots;
+        if(t->prev) {
+            t->prev->next = t->next;
+        } else {
+            m_slots[level][index] = t->next;
+        }
+        if(t->next) {
+            t->next->prev = t->prev;
+        }
+        if(!m_slots[level][index]) {
+            m_occupied[level] &= ~(uint64_t(1) << index);
+        }
+        t->prev = t->next = nullptr;
+        t->slot = -1;
+    }
+    
+    uint64_t
+    TimerWheel::nextEvent() const
+    {
+        uint64_t next = kNever;
+        for ( int level = 0 ; level < kLevels ; ++level ) {
+            if(!m_occupied[level]) {
+                continue;
+            }
+            const int shift = kSlotBits * level;
+            const uint64_t block = m_current >> shift;
+            const int index = int(block) & (kSlots - 1);
+            // Slots after the current one, in the order they come round; the current one itself is a lap away.
+            const uint64_t ahead = rotateRight(m_occupied[level], (index + 1) & (kSlots - 1));
+            const uint64_t event = (block + uint64_t(lowestBit(ahead)) + 1) << shift;
+            next = std::min(next, event);
+        }
+        return next;
+    }
+    
+    void
+    TimerWheel::advance(uint64_t tick, std::unique_lock<std::mutex>& lock)
+    {
+        std::vector<Timer*> due;
+        while(m_current < tick && !m_exiting) {
+            const uint64_t event = nextEvent();
+            if(event > tick) {
+                m_current = tick;
+                break;
+            }
+            m_current = event;
+            
+            // Move timers down from every level whose slot starts on this tick, coarsest first.  A timer due on
+            // this very tick lands in the finest slot, which fires next.
+            for ( int level = kLevels - 1 ; level > 0 ; --level ) {
+                const int shift = kSlotBits * level;
+                if(event & ((uint64_t(1) << shift) - 1)) {
+                    continue;
+                }
+                const int index = int(event >> shift) & (kSlots - 1);
+                Timer* t = m_slots[level][index];
+                m_slots[level][index] = nullptr;
+                m_occupied[level] &= ~(uint64_t(1) << index);
+                while(t) {
+                    Timer* next = t->next;
+                    insert(t);
+                    t = next;
+                }
+            }
+            
+            const int index = int(event) & (kSlots - 1);
+            due.clear();
+            for ( Timer* t = m_slots[0][index] ; t ; t = t->next ) {
+                t->slot = -1;
+                due.push_back(t);
+            }
+            m_slots[0][index] = nullptr;
+            m_occupied[0] &= ~(uint64_t(1) << index);
+            
+            // Earliest deadline first within the tick.
+            std::sort(due.begin(), due.end(), [](const Timer* a, const Timer* b) { return a->deadline < b->deadline; });
+            for ( auto it = due.begin() ; it != due.end() ; ++it ) {
+                fire(*it, lock);
+            }
+        }
+    }
+    
+    void
+    TimerWheel::fire(Timer* t, std::unique_lock<std::mutex>& lock)
+    {
+        if(t->cancelled) {
+            release(t);
+            return;
+        }
+        const Clock::duration lateness = Clock::now() - t->deadline;
+        m_stats.fired++;
+        m_stats.totalLateness += lateness;
+        m_stats.maxLateness = std::max(m_stats.maxLateness, lateness);
+        
+        m_running = t->id;
+        if(t->period == Clock::duration::zero()) {
+            InlineTask callback(std::move(t->callback));
+            release(t);
+            lock.unlock();
+            callback();
+            callback.reset();
+            lock.lock();
+        } else {
+            // The node stays put while unlocked: m_timers is a deque and cancel() only marks a running timer.
+            lock.unlock();
+            t->callback();
+            lock.lock();
+            if(t->cancelled) {
+                release(t);
+            } else {
+                t->deadline += t->period;
+                t->expiry = std::max(tickAfter(t->deadline), m_current + 1);
+                insert(t);
+            }
+        }
+        m_running = 0;
+        m_firedCond.notify_all();
+    }
+    
+    TimerWheel::Timer*
+    TimerWheel::find(TimerId id)
+    {
+        const uint32_t index = uint32_t(id);
+        if(!id || index >= m_timers.size() || m_timers[index].id != id) {
+            return nullptr;
+        }
+        return &m_timers[index];
+    }
+    
+    void
+    TimerWheel::release(Timer* t)
+    {
+        if(t->callback) {
+            m_dead.push_back(std::move(t->callback));
+        }
+        m_free.push_back(uint32_t(t->id));
+        t->id = 0;
+        t->slot = -1;
+    }
+    
+    void
+    TimerWheel::thread()
+    {
+#ifdef __APPLE__
+        pthread_setname_np("com.videocore.timer");
+#else
+        prctl(PR_SET_NAME, "com.videocore.timer");
+#endif
+        std::unique_lock<std::mutex> l(m_mutex);
+        while(!m_exiting) {
+            const uint64_t now = tickBefore(Clock::now());
+            if(now > m_current) {
+                advance(now, l);
+            }
+            if(!m_dead.empty()) {
+                // Whatever the callbacks captured is released without the lock, in case that cancels a timer.
+                std::vector<InlineTask> dead;
+                dead.swap(m_dead);
+                l.unlock();
+                dead.clear();
+                l.lock();
+                continue;
+            }
+            const uint64_t next = nextEvent();
+            m_wakeTick = next;
+            if(next == kNever) {
+                m_cond.wait(l);
+            } else {
+                m_cond.wait_until(l, timeOf(next));
+            }
+            m_wakeTick = 0;
+        }
+    }
+}
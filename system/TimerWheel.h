@@ -0,0 +1,164 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+#ifndef __videocore__TimerWheel__
+#define __videocore__TimerWheel__
+
+#include <VideoCore/system/InlineTask.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+namespace videocore {
+    
+    /*! Identifies a scheduled timer; 0 is never one. */
+    typedef uint64_t TimerId;
+    
+    /*!
+     *  One-shot and periodic timers for the whole process, run from a single thread.
+     *
+     *  Timers live in a hierarchical timing wheel, after Varghese and Lauck: four levels of 64 slots, each level
+     *  64 times coarser than the one below, so starting, cancelling and expiring a timer take constant time
+     *  however many there are.  Timers move down a level as their time draws near and fire from the finest level.
+     *  The thread sleeps until the next occupied slot, not every tick.  A timer never fires before its deadline
+     *  and normally no more than a tick after it.
+     *
+     *  Periodic timers are drift-free: the nth firing is due at first + n * period, whenever the ones before it
+     *  ran, and a firing that falls behind is caught up rather than skipped.
+     *
+     *  Callbacks run on the timer thread, one at a time, and should do no more than hand work on, usually with
+     *  JobQueue::enqueue_at and its relatives, which are built on this.  They must never wait: one that does holds
+     *  up every timer in the process, and deadlocks a cancel() of it made from whatever it is waiting for.
+     */
+    class TimerWheel
+    {
+    public:
+        typedef std::chrono::steady_clock Clock;
+        
+        static const int kLevels = 4;
+        static const int kSlotBits = 6;
+        static const int kSlots = 1 << kSlotBits;
+        
+        /*! How late timers have fired, from when the wheel started. */
+        struct Stats {
+            uint64_t        fired;
+            Clock::duration totalLateness;
+            Clock::duration maxLateness;
+        };
+        
+        /*! The process-wide wheel, with a 250 us tick.  It is never destroyed. */
+        static TimerWheel& shared();
+        
+        /*! \param tick  The resolution; timers up to 64^4 ticks away are held exactly, later ones are re-filed. */
+        TimerWheel(Clock::duration tick);
+        
+        /*! Timers still pending are dropped. */
+        ~TimerWheel();
+        
+        /*! Run callback once, at or after deadline. */
+        TimerId schedule(Clock::time_point deadline, InlineTask callback);
+        
+        /*! Run callback at first and every period after it until cancelled. */
+        TimerId schedulePeriodic(Clock::time_point first, Clock::duration period, InlineTask callback);
+        
+        /*!
+         *  Stop a timer.  Once this returns its callback is not running and will not run again, unless this is
+         *  called from the callback itself, which then finishes.
+         *
+         *  \return true if the timer was still pending; false if it had already fired or been cancelled.
+         */
+        bool cancel(TimerId id);
+        
+        Stats stats() const;
+        
+    private:
+        struct Timer {
+            TimerId             id;
+            uint64_t            expiry;     /*!< The tick it fires on */
+            Clock::time_point   deadline;
+            Clock::duration     period;     /*!< 0 for a one-shot timer */
+            InlineTask          callback;
+            Timer*              prev;
+            Timer*              next;
+            int                 slot;       /*!< level * kSlots + index, or -1 when not in the wheel */
+            bool                cancelled;
+        };
+        
+        TimerId add(Clock::time_point deadline, Clock::duration period, InlineTask&& callback);
+        
+        /*! The first tick at or after time. */
+        uint64_t tickAfter(Clock::time_point time) const;
+        /*! The last tick at or before time. */
+        uint64_t tickBefore(Clock::time_point time) const;
+        Clock::time_point timeOf(uint64_t tick) const { return m_origin + m_tick * int64_t(tick); };
+        
+        /*! File t in the wheel by its expiry, relative to m_current. */
+        void insert(Timer* t);
+        void unlink(Timer* t);
+        
+        /*! The next tick after m_current on which a timer fires or moves down a level; UINT64_MAX if none. */
+        uint64_t nextEvent() const;
+        
+        /*! Process every tick up to and including tick, firing what is due. */
+        void advance(uint64_t tick, std::unique_lock<std::mutex>& lock);
+        void fire(Timer* t, std::unique_lock<std::mutex>& lock);
+        
+        Timer* find(TimerId id);
+        
+        /*! Return t to the free list.  Its callback is kept in m_dead, to be destroyed without the lock held. */
+        void   release(Timer* t);
+        
+        void thread();
+        
+    private:
+        const Clock::duration   m_tick;
+        const Clock::time_point m_origin;
+        
+        mutable std::mutex      m_mutex;
+        std::condition_variable m_cond;         /*!< The thread waits on it for the next event */
+        std::condition_variable m_firedCond;    /*!< cancel() waits on it for a running callback */
+        
+        Timer*                  m_slots[kLevels][kSlots];
+        uint64_t                m_occupied[kLevels];
+        uint64_t                m_current;      /*!< The last tick processed */
+        uint64_t                m_wakeTick;     /*!< The tick the thread is asleep until */
+        
+        std::deque<Timer>       m_timers;       /*!< Stable storage; the low 32 bits of an id index it */
+        std::vector<uint32_t>   m_free;
+        std::vector<InlineTask> m_dead;
+        uint32_t                m_generation;
+        TimerId                 m_running;      /*!< The timer whose callback is running, or 0 */
+        
+        Stats                   m_stats;
+        bool                    m_exiting;
+        std::thread             m_thread;
+    };
+}
+
+#endif /* defined(__videocore__TimerWheel__) */
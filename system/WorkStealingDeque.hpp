@@ -0,0 +1,153 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+#ifndef videocore_WorkStealingDeque_hpp
+#define videocore_WorkStealingDeque_hpp
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace videocore {
+    
+    /*!
+     *  A deque that one thread, its owner, pushes to and pops from at the bottom while any thread may steal from
+     *  the top, none of them taking a lock.
+     *
+     *  This is the Chase-Lev deque, with the memory orders of Lê, Pop, Cohen and Zappa Nardelli, "Correct and
+     *  Efficient Work-Stealing for Weak Memory Models".  T must be a type std::atomic handles without a lock,
+     *  such as a pointer.  The array doubles when full; the arrays it outgrows are kept until the deque is
+     *  destroyed, since a thief may still be reading one.
+     */
+    template<typename T>
+    class WorkStealingDeque
+    {
+    public:
+        WorkStealingDeque(size_t capacity = 64) : m_top(0), m_bottom(0) {
+            size_t size = 2;
+            while(size < capacity) {
+                size <<= 1;
+            }
+            m_array.store(new Array(size), std::memory_order_relaxed);
+        }
+        ~WorkStealingDeque() {
+            delete m_array.load(std::memory_order_relaxed);
+            for ( auto it = m_retired.begin() ; it != m_retired.end() ; ++it ) {
+                delete *it;
+            }
+        }
+        WorkStealingDeque(const WorkStealingDeque&) = delete;
+        WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+        
+        /*! Owner only. */
+        void push(T value) {
+            const int64_t b = m_bottom.load(std::memory_order_relaxed);
+            const int64_t t = m_top.load(std::memory_order_acquire);
+            Array* a = m_array.load(std::memory_order_relaxed);
+            if(b - t > int64_t(a->mask)) {
+                m_retired.push_back(a);
+                a = a->grow(t, b);
+                m_array.store(a, std::memory_order_release);
+            }
+            a->put(b, value);
+            std::atomic_thread_fence(std::memory_order_release);
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        
+        /*! Owner only; takes the value pushed last.  \return false if the deque is empty. */
+        bool pop(T& value) {
+            const int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+            Array* a = m_array.load(std::memory_order_relaxed);
+            m_bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t = m_top.load(std::memory_order_relaxed);
+            if(t > b) {
+                m_bottom.store(b + 1, std::memory_order_relaxed);
+                return false;
+            }
+            value = a->get(b);
+            if(t == b) {
+                // The last one; a thief may be after it too.
+                const bool won = m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                                               std::memory_order_relaxed);
+                m_bottom.store(b + 1, std::memory_order_relaxed);
+                return won;
+            }
+            return true;
+        }
+        
+        /*!
+         *  Any thread; takes the oldest value.
+         *
+         *  \return false if the deque is empty or another thread took the value first.
+         */
+        bool steal(T& value) {
+            int64_t t = m_top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const int64_t b = m_bottom.load(std::memory_order_acquire);
+            if(t >= b) {
+                return false;
+            }
+            Array* a = m_array.load(std::memory_order_acquire);
+            value = a->get(t);
+            return m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        }
+        
+        /*! Only a snapshot. */
+        bool empty() const {
+            return m_bottom.load(std::memory_order_relaxed) <= m_top.load(std::memory_order_relaxed);
+        }
+        
+    private:
+        struct Array {
+            Array(size_t size) : mask(size - 1), slots(new std::atomic<T>[size]) {};
+            ~Array() { delete [] slots; };
+            
+            T get(int64_t i) const { return slots[size_t(i) & mask].load(std::memory_order_relaxed); };
+            void put(int64_t i, T value) { slots[size_t(i) & mask].store(value, std::memory_order_relaxed); };
+            
+            Array* grow(int64_t top, int64_t bottom) const {
+                Array* a = new Array((mask + 1) * 2);
+                for ( int64_t i = top ; i < bottom ; ++i ) {
+                    a->put(i, get(i));
+                }
+                return a;
+            };
+            
+            const size_t    mask;
+            std::atomic<T>* slots;
+        };
+        
+        // Thieves hammer m_top while the owner works at m_bottom; keep them off each other's cache line.  Padded
+        // rather than aligned, as deques are allocated with the plain operator new.
+        std::atomic<int64_t>                m_top;
+        char                                m_pad[64 - sizeof(std::atomic<int64_t>)];
+        std::atomic<int64_t>                m_bottom;
+        std::atomic<Array*>                 m_array;
+        std::vector<Array*>                 m_retired;  /*!< Owner only */
+    };
+}
+
+#endif
@@ -0,0 +1,116 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+#ifndef videocore_ChannelLayout_hpp
+#define videocore_ChannelLayout_hpp
+
+#include <stdint.h>
+
+namespace videocore {
+    
+    /*!
+     *  Speaker positions.  Positioned channels of an interleaved frame appear in the order of these bits, as with
+     *  WAVE_FORMAT_EXTENSIBLE channel masks.
+     */
+    typedef enum {
+        kChannelFrontLeft   = 1 << 0,
+        kChannelFrontRight  = 1 << 1,
+        kChannelFrontCenter = 1 << 2,
+        kChannelLFE         = 1 << 3,
+        kChannelBackLeft    = 1 << 4,
+        kChannelBackRight   = 1 << 5,
+        kChannelSideLeft    = 1 << 6,
+        kChannelSideRight   = 1 << 7
+    } ChannelPosition_t;
+    
+    /*!
+     *  The meaning of each channel of an interleaved frame.  The first popcount(mask) channels carry the positions
+     *  in mask; any channels after them are discrete, with no position, such as separate microphones or a second
+     *  program bus.  A layout with no channels is unspecified and stands for the default layout of the channel
+     *  count it is used with.
+     */
+    struct ChannelLayout {
+        ChannelLayout() : channelCount(0), mask(0) {};
+        ChannelLayout(int channelCount, uint32_t mask) : channelCount(channelCount), mask(mask) {};
+        
+        static ChannelLayout mono()     { return ChannelLayout(1, kChannelFrontCenter); };
+        static ChannelLayout stereo()   { return ChannelLayout(2, kChannelFrontLeft | kChannelFrontRight); };
+        static ChannelLayout quad()     { return ChannelLayout(4, kChannelFrontLeft | kChannelFrontRight | kChannelBackLeft | kChannelBackRight); };
+        static ChannelLayout surround51() {
+            return ChannelLayout(6, kChannelFrontLeft | kChannelFrontRight | kChannelFrontCenter | kChannelLFE | kChannelSideLeft | kChannelSideRight);
+        };
+        static ChannelLayout surround71() {
+            return ChannelLayout(8, surround51().mask | kChannelBackLeft | kChannelBackRight);
+        };
+        /*! channelCount channels with no position. */
+        static ChannelLayout discrete(int channelCount) { return ChannelLayout(channelCount, 0); };
+        
+        /*! Mono, stereo, quad, 5.1 and 7.1 for 1, 2, 4, 6 and 8 channels; discrete otherwise. */
+        static ChannelLayout defaultForChannelCount(int channelCount) {
+            switch(channelCount) {
+                case 1: return mono();
+                case 2: return stereo();
+                case 4: return quad();
+                case 6: return surround51();
+                case 8: return surround71();
+                default: return discrete(channelCount);
+            }
+        }
+        
+        bool isSpecified() const { return channelCount > 0; };
+        
+        /*! This layout, or the default one for channelCount if it is unspecified. */
+        ChannelLayout resolved(int channelCount) const {
+            return isSpecified() ? *this : defaultForChannelCount(channelCount);
+        }
+        
+        int positionedCount() const {
+            int count = 0;
+            for ( uint32_t m = mask ; m ; m &= m - 1 ) {
+                ++count;
+            }
+            return count < channelCount ? count : channelCount;
+        }
+        
+        /*! The channel carrying position, or -1. */
+        int indexOf(ChannelPosition_t position) const {
+            if(!(mask & position)) {
+                return -1;
+            }
+            int index = 0;
+            for ( uint32_t m = mask & (uint32_t(position) - 1) ; m ; m &= m - 1 ) {
+                ++index;
+            }
+            return index < channelCount ? index : -1;
+        }
+        
+        bool operator==(const ChannelLayout& other) const { return channelCount == other.channelCount && mask == other.mask; };
+        bool operator!=(const ChannelLayout& other) const { return !(*this == other); };
+        
+        int      channelCount;
+        uint32_t mask;
+    };
+}
+
+#endif
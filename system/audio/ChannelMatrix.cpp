@@ -0,0 +1,155 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+#include <VideoCore/system/audio/ChannelMatrix.h>
+#include <VideoCore/system/audio/MixKernels.h>
+
+#include <string.h>
+
+namespace videocore {
+    
+    static const float kMinus3dB = 0.70710678118f;
+    static const float kMinus6dB = 0.5f;
+    
+    ChannelMatrix::ChannelMatrix(int inChannelCount, int outChannelCount)
+    : m_coefficients(size_t(inChannelCount) * outChannelCount, 0.f),
+      m_inChannelCount(inChannelCount),
+      m_outChannelCount(outChannelCount),
+      m_identity(false)
+    {
+        updateIdentity();
+    }
+    
+    ChannelMatrix
+    ChannelMatrix::identity(int channelCount)
+    {
+        ChannelMatrix matrix(channelCount, channelCount);
+        for ( int c = 0 ; c < channelCount ; ++c ) {
+            matrix.m_coefficients[c * channelCount + c] = 1.f;
+        }
+        matrix.updateIdentity();
+        return matrix;
+    }
+    
+    /*  Add gain from one input channel to wherever position ends up in out. */
+    static void
+    route(ChannelMatrix& matrix, const ChannelLayout& out, bool monoIn, int in, ChannelPosition_t position, float gain)
+    {
+        const int index = out.indexOf(position);
+        if(index >= 0) {
+            matrix.setCoefficient(index, in, matrix.coefficient(index, in) + gain);
+            return;
+        }
+        const bool hasFront = out.indexOf(kChannelFrontLeft) >= 0 && out.indexOf(kChannelFrontRight) >= 0;
+        switch(position) {
+            case kChannelFrontCenter:
+                if(hasFront) {
+                    // A mono source is meant to be heard at its own level from both speakers.
+                    route(matrix, out, monoIn, in, kChannelFrontLeft,  monoIn ? gain : gain * kMinus3dB);
+                    route(matrix, out, monoIn, in, kChannelFrontRight, monoIn ? gain : gain * kMinus3dB);
+                }
+                break;
+            case kChannelFrontLeft:
+            case kChannelFrontRight:
+                if(out.indexOf(kChannelFrontCenter) >= 0) {
+                    route(matrix, out, monoIn, in, kChannelFrontCenter, gain * kMinus6dB);
+                }
+                break;
+            case kChannelBackLeft:
+                route(matrix, out, monoIn, in, out.indexOf(kChannelSideLeft) >= 0 ? kChannelSideLeft : kChannelFrontLeft, gain * (out.indexOf(kChannelSideLeft) >= 0 ? 1.f : kMinus3dB));
+                break;
+            case kChannelBackRight:
+                route(matrix, out, monoIn, in, out.indexOf(kChannelSideRight) >= 0 ? kChannelSideRight : kChannelFrontRight, gain * (out.indexOf(kChannelSideRight) >= 0 ? 1.f : kMinus3dB));
+                break;
+            case kChannelSideLeft:
+                route(matrix, out, monoIn, in, out.indexOf(kChannelBackLeft) >= 0 ? kChannelBackLeft : kChannelFrontLeft, gain * (out.indexOf(kChannelBackLeft) >= 0 ? 1.f : kMinus3dB));
+                break;
+            case kChannelSideRight:
+                route(matrix, out, monoIn, in, out.indexOf(kChannelBackRight) >= 0 ? kChannelBackRight : kChannelFrontRight, gain * (out.indexOf(kChannelBackRight) >= 0 ? 1.f : kMinus3dB));
+                break;
+            case kChannelLFE:
+                break;
+        }
+    }
+    
+    ChannelMatrix
+    ChannelMatrix::remix(const ChannelLayout& in, const ChannelLayout& out)
+    {
+        ChannelMatrix matrix(in.channelCount, out.channelCount);
+        
+        if(in.channelCount == 1 && !in.mask && !out.mask) {
+            // A single unpositioned channel goes everywhere.
+            for ( int o = 0 ; o < out.channelCount ; ++o ) {
+                matrix.setCoefficient(o, 0, 1.f);
+            }
+            return matrix;
+        }
+        
+        const bool monoIn = in.positionedCount() == 1 && in.indexOf(kChannelFrontCenter) == 0;
+        const int inPositioned = in.positionedCount();
+        const int outPositioned = out.positionedCount();
+        
+        for ( uint32_t bit = 1 ; bit <= kChannelSideRight ; bit <<= 1 ) {
+            const int index = in.indexOf(ChannelPosition_t(bit));
+            if(index >= 0) {
+                route(matrix, out, monoIn, index, ChannelPosition_t(bit), 1.f);
+            }
+        }
+        for ( int d = 0 ; inPositioned + d < in.channelCount && outPositioned + d < out.channelCount ; ++d ) {
+            matrix.setCoefficient(outPositioned + d, inPositioned + d, 1.f);
+        }
+        return matrix;
+    }
+    
+    void
+    ChannelMatrix::setCoefficient(int out, int in, float gain)
+    {
+        m_coefficients[out * m_inChannelCount + in] = gain;
+        updateIdentity();
+    }
+    
+    void
+    ChannelMatrix::updateIdentity()
+    {
+        m_identity = m_inChannelCount == m_outChannelCount && m_inChannelCount > 0;
+        for ( int o = 0 ; m_identity && o < m_outChannelCount ; ++o ) {
+            for ( int i = 0 ; i < m_inChannelCount ; ++i ) {
+                if(m_coefficients[o * m_inChannelCount + i] != (o == i ? 1.f : 0.f)) {
+                    m_identity = false;
+                    break;
+                }
+            }
+        }
+    }
+    
+    void
+    ChannelMatrix::apply(const float* in, float* out, size_t frames) const
+    {
+        if(m_identity) {
+            memcpy(out, in, frames * m_inChannelCount * sizeof(float));
+        } else {
+            remixChannels(out, m_outChannelCount, in, m_inChannelCount, m_coefficients.data(), frames);
+        }
+    }
+}
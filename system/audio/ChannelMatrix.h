@@ -0,0 +1,81 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+#ifndef __videocore__ChannelMatrix__
+#define __videocore__ChannelMatrix__
+
+#include <VideoCore/system/audio/ChannelLayout.hpp>
+
+#include <stddef.h>
+#include <vector>
+
+namespace videocore {
+    
+    /*!
+     *  Gains from each input channel to each output channel, for up- and down-mixing interleaved float frames.
+     *
+     *  remix() builds the usual matrix between two layouts: shared positions pass through, a lone centre channel
+     *  goes to front left and right at unity, other missing positions fold into their neighbours at -3 dB (-6 dB
+     *  for left and right into centre), the LFE is dropped when there is nowhere for it, and discrete channels map
+     *  by index.  Any other routing can be set coefficient by coefficient.
+     */
+    class ChannelMatrix
+    {
+    public:
+        /*! No channels. */
+        ChannelMatrix() : m_inChannelCount(0), m_outChannelCount(0), m_identity(false) {};
+        
+        /*! All coefficients zero. */
+        ChannelMatrix(int inChannelCount, int outChannelCount);
+        
+        static ChannelMatrix identity(int channelCount);
+        static ChannelMatrix remix(const ChannelLayout& in, const ChannelLayout& out);
+        
+        int inChannelCount() const { return m_inChannelCount; };
+        int outChannelCount() const { return m_outChannelCount; };
+        bool empty() const { return m_coefficients.empty(); };
+        
+        /*! True when apply() would copy its input unchanged. */
+        bool isIdentity() const { return m_identity; };
+        
+        float coefficient(int out, int in) const { return m_coefficients[out * m_inChannelCount + in]; };
+        void setCoefficient(int out, int in, float gain);
+        
+        /*! Row-major: outChannelCount rows of inChannelCount gains. */
+        const float* coefficients() const { return m_coefficients.data(); };
+        
+        /*! Remix frames interleaved frames from in to out.  The buffers must not overlap. */
+        void apply(const float* in, float* out, size_t frames) const;
+        
+    private:
+        void updateIdentity();
+        
+        std::vector<float> m_coefficients;
+        int  m_inChannelCount;
+        int  m_outChannelCount;
+        bool m_identity;
+    };
+}
+
+#endif /* defined(__videocore__ChannelMatrix__) */
@@ -0,0 +1,92 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+#include <VideoCore/system/audio/DriftEstimator.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace videocore {
+    
+    static const double kInitialBandwidth = 1.0;    // Hz
+    static const double kMaxError = 0.1;            // seconds off the prediction before the loop restarts
+    
+    DriftEstimator::DriftEstimator(double bandwidth, double lockTime)
+    : m_bandwidth(bandwidth), m_lockTime(lockTime)
+    {
+        reset();
+    }
+    
+    void
+    DriftEstimator::reset()
+    {
+        m_time = 0.;
+        m_period = 0.;
+        m_nominalPeriod = 0.;
+        m_elapsed = 0.;
+        m_running = false;
+    }
+    
+    void
+    DriftEstimator::update(std::chrono::steady_clock::time_point time, size_t frames, double sampleRate)
+    {
+        if(!frames || sampleRate <= 0.) {
+            return;
+        }
+        const double nominalPeriod = 1. / sampleRate;
+        
+        if(m_running && nominalPeriod == m_nominalPeriod) {
+            const double t = std::chrono::duration<double>(time - m_base).count();
+            const double duration = double(frames) * m_period;
+            const double error = t - (m_time + duration);
+            
+            if(std::fabs(error) < kMaxError) {
+                // Narrow exponentially from the initial bandwidth while locking.
+                const double progress = std::min(1., m_elapsed / m_lockTime);
+                const double bandwidth = kInitialBandwidth * std::pow(m_bandwidth / kInitialBandwidth, progress);
+                
+                const double w = 2. * M_PI * bandwidth * duration;
+                const double b = std::sqrt(2.) * w;
+                const double c = w * w;
+                
+                m_time += duration + b * error;
+                m_period += c * error / double(frames);
+                m_elapsed += duration;
+                return;
+            }
+        }
+        m_base = time;
+        m_time = 0.;
+        m_period = nominalPeriod;
+        m_nominalPeriod = nominalPeriod;
+        m_elapsed = 0.;
+        m_running = true;
+    }
+    
+    std::chrono::steady_clock::time_point
+    DriftEstimator::time() const
+    {
+        return m_base + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(m_time));
+    }
+}
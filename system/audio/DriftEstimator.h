@@ -0,0 +1,82 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+#ifndef __videocore__DriftEstimator__
+#define __videocore__DriftEstimator__
+
+#include <chrono>
+#include <stddef.h>
+
+namespace videocore {
+    
+    /*!
+     *  Measures the real sampling rate of a source against the steady clock from the arrival times of its buffers.
+     *
+     *  A second order delay-locked loop, after Fons Adriaensen's "Using a DLL to filter time", predicts when each
+     *  buffer should arrive from the previous one and the estimated period of a frame, then corrects both by the
+     *  prediction error.  The loop starts wide to lock quickly and narrows to bandwidth to average out scheduling
+     *  jitter, which leaves an estimate good to a few ppm.
+     */
+    class DriftEstimator
+    {
+    public:
+        /*!
+         *  \param bandwidth    Loop bandwidth in Hz once locked.
+         *  \param lockTime     Seconds over which the loop narrows from its initial bandwidth to bandwidth.
+         */
+        DriftEstimator(double bandwidth = 0.02, double lockTime = 10.);
+        
+        /*!
+         *  A buffer of frames frames at a nominal sampleRate became available at time.  An arrival far from the
+         *  prediction, or a change of rate, restarts the loop.
+         */
+        void update(std::chrono::steady_clock::time_point time, size_t frames, double sampleRate);
+        
+        /*! Forget everything measured. */
+        void reset();
+        
+        /*! True once the loop has narrowed to its final bandwidth. */
+        bool locked() const { return m_running && m_elapsed >= m_lockTime; };
+        
+        /*! Measured rate / nominal rate - 1: positive when the source clock runs fast. */
+        double rateError() const { return m_running ? m_nominalPeriod / m_period - 1. : 0.; };
+        
+        /*! The filtered arrival time of the last buffer. */
+        std::chrono::steady_clock::time_point time() const;
+        
+    private:
+        std::chrono::steady_clock::time_point m_base;
+        
+        double m_bandwidth;
+        double m_lockTime;
+        
+        double m_time;          /*!< Filtered arrival of the last buffer, seconds after m_base */
+        double m_period;        /*!< Estimated seconds per frame */
+        double m_nominalPeriod;
+        double m_elapsed;       /*!< Seconds since the loop started */
+        bool   m_running;
+    };
+}
+
+#endif /* defined(__videocore__DriftEstimator__) */
@@ -0,0 +1,393 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+#include <VideoCore/system/audio/LoudnessMeter.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#   define VC_METER_X86 1
+#   include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#   define VC_METER_NEON 1
+#   include <arm_neon.h>
+#endif
+
+namespace videocore {
+    
+    static const double kBlockDuration = 0.1;   // seconds
+    static const size_t kMomentaryBlocks = 4;   // 400 ms
+    static const size_t kShortTermBlocks = 30;  // 3 s
+    
+    LoudnessMeter::LoudnessMeter()
+    : m_sampleRate(0), m_channelCount(0), m_laneCount(0), m_interval(0.1), m_blockFrames(0), m_intervalFrames(0),
+      m_blocks(kShortTermBlocks, 0.), m_sequence(0)
+    {
+        memset(&m_shelf, 0, sizeof(m_shelf));
+        memset(&m_highPass, 0, sizeof(m_highPass));
+        memset(&m_published, 0, sizeof(m_published));
+        reset();
+    }
+    
+    void
+    LoudnessMeter::setFormat(int sampleRate, const ChannelLayout& layout)
+    {
+        m_sampleRate = sampleRate;
+        m_channelCount = layout.channelCount;
+        m_laneCount = (m_channelCount + 3) & ~3;
+        
+        // K-weighting, with the BS.1770 filters re-derived for the sampling rate.
+        {
+            const double f0 = 1681.974450955533;
+            const double gain = 3.999843853973347;
+            const double q = 0.7071752369554196;
+            const double k = std::tan(M_PI * f0 / sampleRate);
+            const double vh = std::pow(10., gain / 20.);
+            const double vb = std::pow(vh, 0.4996667741545416);
+            const double a0 = 1. + k / q + k * k;
+            m_shelf.b0 = float((vh + vb * k / q + k * k) / a0);
+            m_shelf.b1 = float(2. * (k * k - vh) / a0);
+            m_shelf.b2 = float((vh - vb * k / q + k * k) / a0);
+            m_shelf.a1 = float(2. * (k * k - 1.) / a0);
+            m_shelf.a2 = float((1. - k / q + k * k) / a0);
+        }
+        {
+            const double f0 = 38.13547087602444;
+            const double q = 0.5003270373238773;
+            const double k = std::tan(M_PI * f0 / sampleRate);
+            const double a0 = 1. + k / q + k * k;
+            m_highPass.b0 = 1.f;
+            m_highPass.b1 = -2.f;
+            m_highPass.b2 = 1.f;
+            m_highPass.a1 = float(2. * (k * k - 1.) / a0);
+            m_highPass.a2 = float((1. - k / q + k * k) / a0);
+        }
+        
+        m_weights.assign(m_laneCount, 0.f);
+        const int positioned = layout.positionedCount();
+        for ( int c = 0 ; c < m_channelCount ; ++c ) {
+            m_weights[c] = 1.f;
+        }
+        const ChannelPosition_t surrounds[] = { kChannelBackLeft, kChannelBackRight, kChannelSideLeft, kChannelSideRight };
+        for ( auto position : surrounds ) {
+            const int index = layout.indexOf(position);
+            if(index >= 0 && index < positioned) {
+                m_weights[index] = 1.41f;
+            }
+        }
+        const int lfe = layout.indexOf(kChannelLFE);
+        if(lfe >= 0) {
+            m_weights[lfe] = 0.f;
+        }
+        
+        m_state.assign(m_laneCount * 4, 0.f);
+        m_peak.assign(m_laneCount, 0.f);
+        m_squares.assign(m_laneCount, 0.f);
+        m_power.assign(m_laneCount, 0.f);
+        
+        setInterval(m_interval);
+        reset();
+    }
+    
+    void
+    LoudnessMeter::setInterval(double seconds)
+    {
+        m_interval = seconds;
+        m_blockFrames = size_t(std::max(1., std::floor(m_sampleRate * kBlockDuration + 0.5)));
+        m_intervalFrames = size_t(std::max(1., std::floor(m_sampleRate * seconds + 0.5)));
+        m_intervalPos = std::min(m_intervalPos, m_intervalFrames - 1);
+    }
+    
+    void
+    LoudnessMeter::reset()
+    {
+        std::fill(m_state.begin(), m_state.end(), 0.f);
+        std::fill(m_peak.begin(), m_peak.end(), 0.f);
+        std::fill(m_squares.begin(), m_squares.end(), 0.f);
+        std::fill(m_power.begin(), m_power.end(), 0.f);
+        std::fill(m_blocks.begin(), m_blocks.end(), 0.);
+        m_blockCount = 0;
+        m_blockPos = 0;
+        m_intervalPos = 0;
+        m_frames = 0;
+    }
+    
+    void
+    LoudnessMeter::process(const float* samples, size_t frameCount)
+    {
+        if(!m_sampleRate || !m_channelCount) {
+            return;
+        }
+        advance(samples, frameCount);
+        
+        // The filters ring down towards zero in silence; stop them before they reach denormals.
+        for ( auto & s : m_state ) {
+            if(std::fabs(s) < 1e-15f) {
+                s = 0.f;
+            }
+        }
+    }
+    
+    void
+    LoudnessMeter::processSilence(size_t frameCount)
+    {
+        if(!m_sampleRate || !m_channelCount) {
+            return;
+        }
+        // Whatever the filters still held has rung out; silence adds nothing to the peak or any sum.
+        std::fill(m_state.begin(), m_state.end(), 0.f);
+        advance(nullptr, frameCount);
+    }
+    
+    /*  Measure samples, or silence if it is null, ending blocks and intervals on the way. */
+    void
+    LoudnessMeter::advance(const float* samples, size_t frameCount)
+    {
+        while(frameCount) {
+            const size_t frames = std::min(frameCount, std::min(m_blockFrames - m_blockPos, m_intervalFrames - m_intervalPos));
+            
+            if(samples) {
+                measure(samples, frames);
+                samples += frames * m_channelCount;
+            }
+            frameCount -= frames;
+            m_frames += frames;
+            
+            if((m_blockPos += frames) == m_blockFrames) {
+                endBlock();
+            }
+            if((m_intervalPos += frames) == m_intervalFrames) {
+                publish();
+            }
+        }
+    }
+    
+#if defined(VC_METER_X86)
+    
+    template<int Lanes>
+    static inline __m128
+    loadLanes(const float* p)
+    {
+        switch(Lanes) {
+            case 1:  return _mm_load_ss(p);
+            case 2:  return _mm_castpd_ps(_mm_load_sd((const double*)p));
+            case 3:  return _mm_movelh_ps(_mm_castpd_ps(_mm_load_sd((const double*)p)), _mm_load_ss(p + 2));
+            default: return _mm_loadu_ps(p);
+        }
+    }
+    
+    template<int Lanes>
+    static void
+    measureLanes(const float* samples, size_t frames, size_t stride, const float* b, float* state, float* peak, float* squares, float* power)
+    {
+        const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+        const __m128 sb0 = _mm_set1_ps(b[0]), sb1 = _mm_set1_ps(b[1]), sb2 = _mm_set1_ps(b[2]), sa1 = _mm_set1_ps(b[3]), sa2 = _mm_set1_ps(b[4]);
+        const __m128 hb0 = _mm_set1_ps(b[5]), hb1 = _mm_set1_ps(b[6]), hb2 = _mm_set1_ps(b[7]), ha1 = _mm_set1_ps(b[8]), ha2 = _mm_set1_ps(b[9]);
+        
+        __m128 s0 = _mm_loadu_ps(state), s1 = _mm_loadu_ps(state + 4), s2 = _mm_loadu_ps(state + 8), s3 = _mm_loadu_ps(state + 12);
+        __m128 pk = _mm_loadu_ps(peak), sq = _mm_loadu_ps(squares), pw = _mm_loadu_ps(power);
+        
+        for ( size_t f = 0 ; f < frames ; ++f ) {
+            const __m128 x = loadLanes<Lanes>(samples + f * stride);
+            pk = _mm_max_ps(pk, _mm_and_ps(x, absMask));
+            sq = _mm_add_ps(sq, _mm_mul_ps(x, x));
+            
+            // Transposed direct form II
+            const __m128 y = _mm_add_ps(_mm_mul_ps(sb0, x), s0);
+            s0 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(sb1, x), _mm_mul_ps(sa1, y)), s1);
+            s1 = _mm_sub_ps(_mm_mul_ps(sb2, x), _mm_mul_ps(sa2, y));
+            
+            const __m128 z = _mm_add_ps(_mm_mul_ps(hb0, y), s2);
+            s2 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(hb1, y), _mm_mul_ps(ha1, z)), s3);
+            s3 = _mm_sub_ps(_mm_mul_ps(hb2, y), _mm_mul_ps(ha2, z));
+            
+            pw = _mm_add_ps(pw, _mm_mul_ps(z, z));
+        }
+        _mm_storeu_ps(state, s0); _mm_storeu_ps(state + 4, s1); _mm_storeu_ps(state + 8, s2); _mm_storeu_ps(state + 12, s3);
+        _mm_storeu_ps(peak, pk); _mm_storeu_ps(squares, sq); _mm_storeu_ps(power, pw);
+    }
+    
+#elif defined(VC_METER_NEON)
+    
+    template<int Lanes>
+    static inline float32x4_t
+    loadLanes(const float* p)
+    {
+        switch(Lanes) {
+            case 1:  return vsetq_lane_f32(p[0], vdupq_n_f32(0.f), 0);
+            case 2:  return vcombine_f32(vld1_f32(p), vdup_n_f32(0.f));
+            case 3:  return vcombine_f32(vld1_f32(p), vset_lane_f32(p[2], vdup_n_f32(0.f), 0));
+            default: return vld1q_f32(p);
+        }
+    }
+    
+    template<int Lanes>
+    static void
+    measureLanes(const float* samples, size_t frames, size_t stride, const float* b, float* state, float* peak, float* squares, float* power)
+    {
+        float32x4_t s0 = vld1q_f32(state), s1 = vld1q_f32(state + 4), s2 = vld1q_f32(state + 8), s3 = vld1q_f32(state + 12);
+        float32x4_t pk = vld1q_f32(peak), sq = vld1q_f32(squares), pw = vld1q_f32(power);
+        
+        for ( size_t f = 0 ; f < frames ; ++f ) {
+            const float32x4_t x = loadLanes<Lanes>(samples + f * stride);
+            pk = vmaxq_f32(pk, vabsq_f32(x));
+            sq = vmlaq_f32(sq, x, x);
+            
+            // Transposed direct form II
+            const float32x4_t y = vmlaq_n_f32(s0, x, b[0]);
+            s0 = vmlsq_n_f32(vmlaq_n_f32(s1, x, b[1]), y, b[3]);
+            s1 = vmlsq_n_f32(vmulq_n_f32(x, b[2]), y, b[4]);
+            
+            const float32x4_t z = vmlaq_n_f32(s2, y, b[5]);
+            s2 = vmlsq_n_f32(vmlaq_n_f32(s3, y, b[6]), z, b[8]);
+            s3 = vmlsq_n_f32(vmulq_n_f32(y, b[7]), z, b[9]);
+            
+            pw = vmlaq_f32(pw, z, z);
+        }
+        vst1q_f32(state, s0); vst1q_f32(state + 4, s1); vst1q_f32(state + 8, s2); vst1q_f32(state + 12, s3);
+        vst1q_f32(peak, pk); vst1q_f32(squares, sq); vst1q_f32(power, pw);
+    }
+    
+#else
+    
+    template<int Lanes>
+    static void
+    measureLanes(const float* samples, size_t frames, size_t stride, const float* b, float* state, float* peak, float* squares, float* power)
+    {
+        for ( int l = 0 ; l < Lanes ; ++l ) {
+            float s0 = state[l], s1 = state[4 + l], s2 = state[8 + l], s3 = state[12 + l];
+            for ( size_t f = 0 ; f < frames ; ++f ) {
+                const float x = samples[f * stride + l];
+                peak[l] = std::max(peak[l], std::fabs(x));
+                squares[l] += x * x;
+                
+                const float y = b[0] * x + s0;
+                s0 = b[1] * x - b[3] * y + s1;
+                s1 = b[2] * x - b[4] * y;
+                
+                const float z = b[5] * y + s2;
+                s2 = b[6] * y - b[8] * z + s3;
+                s3 = b[7] * y - b[9] * z;
+                
+                power[l] += z * z;
+            }
+            state[l] = s0; state[4 + l] = s1; state[8 + l] = s2; state[12 + l] = s3;
+        }
+    }
+    
+#endif
+    
+    void
+    LoudnessMeter::measure(const float* samples, size_t frames)
+    {
+        const float b[10] = {
+            m_shelf.b0, m_shelf.b1, m_shelf.b2, m_shelf.a1, m_shelf.a2,
+            m_highPass.b0, m_highPass.b1, m_highPass.b2, m_highPass.a1, m_highPass.a2
+        };
+        for ( int g = 0 ; g < m_laneCount ; g += 4 ) {
+            float* state = &m_state[g * 4];
+            float* peak = &m_peak[g];
+            float* squares = &m_squares[g];
+            float* power = &m_power[g];
+            
+            switch(std::min(4, m_channelCount - g)) {
+                case 1:  measureLanes<1>(samples + g, frames, m_channelCount, b, state, peak, squares, power); break;
+                case 2:  measureLanes<2>(samples + g, frames, m_channelCount, b, state, peak, squares, power); break;
+                case 3:  measureLanes<3>(samples + g, frames, m_channelCount, b, state, peak, squares, power); break;
+                default: measureLanes<4>(samples + g, frames, m_channelCount, b, state, peak, squares, power); break;
+            }
+        }
+    }
+    
+    void
+    LoudnessMeter::endBlock()
+    {
+        double power = 0.;
+        for ( int c = 0 ; c < m_channelCount ; ++c ) {
+            power += double(m_weights[c]) * double(m_power[c]);
+            m_power[c] = 0.f;
+        }
+        m_blocks[m_blockCount % kShortTermBlocks] = power / double(m_blockFrames);
+        ++m_blockCount;
+        m_blockPos = 0;
+    }
+    
+    /*  Loudness of the mean of the last count blocks; blocks before the first count as silence. */
+    static float
+    loudness(const std::vector<double>& blocks, size_t blockCount, size_t count)
+    {
+        double sum = 0.;
+        for ( size_t i = 0 ; i < std::min(count, blockCount) ; ++i ) {
+            sum += blocks[(blockCount - 1 - i) % blocks.size()];
+        }
+        const double power = sum / double(count);
+        return power > 0. ? float(-0.691 + 10. * std::log10(power)) : -HUGE_VALF;
+    }
+    
+    void
+    LoudnessMeter::publish()
+    {
+        AudioLevels levels;
+        levels.channelCount = std::min(m_channelCount, int(AudioLevels::kMaxChannels));
+        for ( int c = 0 ; c < AudioLevels::kMaxChannels ; ++c ) {
+            levels.peak[c] = c < levels.channelCount ? m_peak[c] : 0.f;
+            levels.rms[c] = c < levels.channelCount ? std::sqrt(m_squares[c] / float(m_intervalPos)) : 0.f;
+        }
+        levels.momentary = loudness(m_blocks, m_blockCount, kMomentaryBlocks);
+        levels.shortTerm = loudness(m_blocks, m_blockCount, kShortTermBlocks);
+        levels.frames = m_frames;
+        
+        std::fill(m_peak.begin(), m_peak.end(), 0.f);
+        std::fill(m_squares.begin(), m_squares.end(), 0.f);
+        m_intervalPos = 0;
+        
+        // Odd while writing.  Readers retry until they see the same even sequence before and after their copy.
+        const uint32_t sequence = m_sequence.load(std::memory_order_relaxed);
+        m_sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_published = levels;
+        m_sequence.store(sequence + 2, std::memory_order_release);
+    }
+    
+    bool
+    LoudnessMeter::levels(AudioLevels& levels) const
+    {
+        for(;;) {
+            const uint32_t before = m_sequence.load(std::memory_order_acquire);
+            if(!before) {
+                return false;
+            }
+            if(before & 1) {
+                continue;
+            }
+            levels = m_published;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(m_sequence.load(std::memory_order_relaxed) == before) {
+                return true;
+            }
+        }
+    }
+}
@@ -0,0 +1,122 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+#ifndef __videocore__LoudnessMeter__
+#define __videocore__LoudnessMeter__
+
+#include <VideoCore/system/audio/ChannelLayout.hpp>
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace videocore {
+    
+    /*! One reading of a LoudnessMeter. */
+    struct AudioLevels {
+        static const int kMaxChannels = 8;
+        
+        int   channelCount;             /*!< Channels with a peak and rms below, at most kMaxChannels */
+        float peak[kMaxChannels];       /*!< Largest |sample| over the interval, full scale is 1 */
+        float rms[kMaxChannels];        /*!< Over the interval, full scale is 1 */
+        float momentary;                /*!< EBU R128 momentary loudness (400 ms) in LUFS, -HUGE_VALF when silent */
+        float shortTerm;                /*!< EBU R128 short-term loudness (3 s) in LUFS, -HUGE_VALF when silent */
+        uint64_t frames;                /*!< Frames measured since the meter was reset */
+    };
+    
+    /*!
+     *  Peak, RMS and ITU-R BS.1770 / EBU R128 loudness of interleaved float audio.
+     *
+     *  One pass over the samples keeps a SIMD lane per channel: the peak, the sum of squares and the K-weighting
+     *  filters (a high shelf and a high pass) run side by side for up to four channels at a time.  K-weighted power
+     *  is summed in 100 ms blocks, from which the momentary and short-term loudness are taken.
+     *
+     *  process() is called by one thread at a time.  At the end of every interval the levels are published with
+     *  a sequence lock, so levels() can be called from any thread without blocking the one measuring.
+     */
+    class LoudnessMeter
+    {
+    public:
+        LoudnessMeter();
+        
+        /*! Set the format of the samples and start over. */
+        void setFormat(int sampleRate, const ChannelLayout& layout);
+        
+        /*! Seconds between published readings, and the window of the peak and rms. */
+        void setInterval(double seconds);
+        double interval() const { return m_interval; };
+        
+        /*! Measure frameCount interleaved frames. */
+        void process(const float* samples, size_t frameCount);
+        
+        /*! Measure frameCount frames of digital silence without reading them. */
+        void processSilence(size_t frameCount);
+        
+        /*! The last published reading.  \return false if there is none yet. */
+        bool levels(AudioLevels& levels) const;
+        
+        /*! Forget the filter state and the blocks measured so far. */
+        void reset();
+        
+    private:
+        void advance(const float* samples, size_t frameCount);
+        void measure(const float* samples, size_t frames);
+        void endBlock();
+        void publish();
+        
+    private:
+        struct Biquad {
+            float b0, b1, b2, a1, a2;
+        };
+        
+        Biquad m_shelf;
+        Biquad m_highPass;
+        
+        int    m_sampleRate;
+        int    m_channelCount;
+        int    m_laneCount;             /*!< m_channelCount rounded up to a multiple of 4 */
+        double m_interval;
+        size_t m_blockFrames;
+        size_t m_intervalFrames;
+        
+        // Per lane
+        std::vector<float>  m_weights;  /*!< BS.1770 channel weights */
+        std::vector<float>  m_state;    /*!< Four filter states per lane, grouped by four lanes */
+        std::vector<float>  m_peak;
+        std::vector<float>  m_squares;
+        std::vector<float>  m_power;    /*!< K-weighted sum of squares in the current block */
+        
+        std::vector<double> m_blocks;   /*!< Weighted mean square of the last 30 blocks */
+        size_t m_blockCount;
+        size_t m_blockPos;
+        size_t m_intervalPos;
+        uint64_t m_frames;
+        
+        alignas(64) std::atomic<uint32_t> m_sequence;
+        AudioLevels m_published;
+    };
+}
+
+#endif /* defined(__videocore__LoudnessMeter__) */
@@ -0,0 +1,443 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+
+#include <VideoCore/system/audio/MixKernels.h>
+
+#include <algorithm>
+#include <cmath>
+
+// VC_MIX_SCALAR builds the plain C++ kernels only and VC_MIX_NO_AVX2 leaves out the AVX2 ones, for comparison.
+#if defined(VC_MIX_SCALAR)
+#elif defined(__x86_64__) || defined(__i386__)
+#   define VC_MIX_X86 1
+#   include <immintrin.h>
+#   if !defined(VC_MIX_NO_AVX2) && (defined(__GNUC__) || defined(__clang__))
+#       define VC_MIX_AVX2 1
+#       include <cpuid.h>
+#   endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#   define VC_MIX_NEON 1
+#   include <arm_neon.h>
+#endif
+
+namespace videocore {
+    
+    static const float kInt16Scale = 1.f / 32768.f;
+    
+#if defined(VC_MIX_AVX2)
+    
+    // The AVX2 kernels do the bulk of the accumulate loops when the CPU and the OS support them; the SSE2 and scalar
+    // loops finish what is left.  They do the same arithmetic in the same order as SSE2, without FMA, so the result
+    // does not depend on the machine.
+    
+    static bool
+    detectAVX2()
+    {
+        unsigned a, b, c, d;
+        if(!__get_cpuid(1, &a, &b, &c, &d) || !(c & bit_OSXSAVE) || !(c & bit_AVX)) {
+            return false;
+        }
+        // The OS has to save the upper halves of the ymm registers.
+        unsigned lo, hi;
+        __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+        if((lo & 0x6) != 0x6 || __get_cpuid_max(0, nullptr) < 7) {
+            return false;
+        }
+        __cpuid_count(7, 0, a, b, c, d);
+        return (b & bit_AVX2) != 0;
+    }
+    static bool
+    hasAVX2()
+    {
+        static const bool avx2 = detectAVX2();
+        return avx2;
+    }
+    __attribute__((target("avx2"))) static size_t
+    accumulateAVX2(float* dst, const int16_t* src, size_t count, float g)
+    {
+        const __m256 vg = _mm256_set1_ps(g);
+        size_t i = 0;
+        for ( ; i + 16 <= count ; i += 16 ) {
+            const __m256 lo = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(src + i))));
+            const __m256 hi = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(src + i + 8))));
+            _mm256_storeu_ps(dst + i,     _mm256_add_ps(_mm256_loadu_ps(dst + i),     _mm256_mul_ps(lo, vg)));
+            _mm256_storeu_ps(dst + i + 8, _mm256_add_ps(_mm256_loadu_ps(dst + i + 8), _mm256_mul_ps(hi, vg)));
+        }
+        return i;
+    }
+    __attribute__((target("avx2"))) static size_t
+    accumulateAVX2(float* dst, const float* src, size_t count, float gain)
+    {
+        const __m256 vg = _mm256_set1_ps(gain);
+        size_t i = 0;
+        for ( ; i + 16 <= count ; i += 16 ) {
+            _mm256_storeu_ps(dst + i,     _mm256_add_ps(_mm256_loadu_ps(dst + i),     _mm256_mul_ps(_mm256_loadu_ps(src + i), vg)));
+            _mm256_storeu_ps(dst + i + 8, _mm256_add_ps(_mm256_loadu_ps(dst + i + 8), _mm256_mul_ps(_mm256_loadu_ps(src + i + 8), vg)));
+        }
+        return i;
+    }
+    __attribute__((target("avx2"))) static size_t
+    accumulateRampAVX2(float* dst, const float* src, size_t count, int frameShift, float gain, float step, const float* lane)
+    {
+        // Each half works out its gain as the SSE2 loop does for the same four samples.
+        const __m128 l = _mm_loadu_ps(lane);
+        const __m256 vs = _mm256_mul_ps(_mm256_insertf128_ps(_mm256_castps128_ps256(l), l, 1), _mm256_set1_ps(step));
+        size_t i = 0;
+        for ( ; i + 8 <= count ; i += 8 ) {
+            const __m256 base = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(gain + step * float(i >> frameShift))),
+                                                     _mm_set1_ps(gain + step * float((i + 4) >> frameShift)), 1);
+            const __m256 vg = _mm256_add_ps(base, vs);
+            _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), _mm256_mul_ps(_mm256_loadu_ps(src + i), vg)));
+        }
+        return i;
+    }
+#endif
+    
+    void
+    accumulateSamples(float* dst, const int16_t* src, size_t count, float gain)
+    {
+        const float g = gain * kInt16Scale;
+        size_t i = 0;
+#if defined(VC_MIX_AVX2)
+        if(hasAVX2()) {
+            i = accumulateAVX2(dst, src, count, g);
+        }
+#endif
+#if defined(VC_MIX_X86)
+        const __m128 vg = _mm_set1_ps(g);
+        for ( ; i + 8 <= count ; i += 8 ) {
+            const __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+            const __m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16));
+            const __m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16));
+            _mm_storeu_ps(dst + i,     _mm_add_ps(_mm_loadu_ps(dst + i),     _mm_mul_ps(lo, vg)));
+            _mm_storeu_ps(dst + i + 4, _mm_add_ps(_mm_loadu_ps(dst + i + 4), _mm_mul_ps(hi, vg)));
+        }
+#elif defined(VC_MIX_NEON)
+        for ( ; i + 8 <= count ; i += 8 ) {
+            const int16x8_t s = vld1q_s16(src + i);
+            const float32x4_t lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(s)));
+            const float32x4_t hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(s)));
+            vst1q_f32(dst + i,     vaddq_f32(vld1q_f32(dst + i),     vmulq_n_f32(lo, g)));
+            vst1q_f32(dst + i + 4, vaddq_f32(vld1q_f32(dst + i + 4), vmulq_n_f32(hi, g)));
+        }
+#endif
+        for ( ; i < count ; ++i ) {
+            dst[i] += float(src[i]) * g;
+        }
+    }
+    void
+    accumulateSamples(float* dst, const float* src, size_t count, float gain)
+    {
+        size_t i = 0;
+#if defined(VC_MIX_AVX2)
+        if(hasAVX2()) {
+            i = accumulateAVX2(dst, src, count, gain);
+        }
+#endif
+#if defined(VC_MIX_X86)
+        const __m128 vg = _mm_set1_ps(gain);
+        for ( ; i + 8 <= count ; i += 8 ) {
+            _mm_storeu_ps(dst + i,     _mm_add_ps(_mm_loadu_ps(dst + i),     _mm_mul_ps(_mm_loadu_ps(src + i), vg)));
+            _mm_storeu_ps(dst + i + 4, _mm_add_ps(_mm_loadu_ps(dst + i + 4), _mm_mul_ps(_mm_loadu_ps(src + i + 4), vg)));
+        }
+#elif defined(VC_MIX_NEON)
+        for ( ; i + 8 <= count ; i += 8 ) {
+            vst1q_f32(dst + i,     vaddq_f32(vld1q_f32(dst + i),     vmulq_n_f32(vld1q_f32(src + i), gain)));
+            vst1q_f32(dst + i + 4, vaddq_f32(vld1q_f32(dst + i + 4), vmulq_n_f32(vld1q_f32(src + i + 4), gain)));
+        }
+#endif
+        for ( ; i < count ; ++i ) {
+            dst[i] += src[i] * gain;
+        }
+    }
+    float
+    accumulateRamp(float* dst, const float* src, size_t frameCount, int channelCount, float gain, float step)
+    {
+        const size_t count = frameCount * channelCount;
+        size_t i = 0;
+        
+        // Four samples at a time hold whole frames, or a whole number of them, for one, two and four channels.  The
+        // gain of each block is worked out from its frame index rather than added up, so rounding does not build up.
+        if(channelCount == 1 || channelCount == 2 || channelCount == 4) {
+            const float lanes[3][4] = { { 0.f, 1.f, 2.f, 3.f }, { 0.f, 0.f, 1.f, 1.f }, { 0.f, 0.f, 0.f, 0.f } };
+            const float* lane = lanes[channelCount >> 1];
+            const int frameShift = channelCount >> 1;   // i >> frameShift is the frame of sample i
+#if defined(VC_MIX_AVX2)
+            if(hasAVX2()) {
+                i = accumulateRampAVX2(dst, src, count, frameShift, gain, step, lane);
+            }
+#endif
+#if defined(VC_MIX_X86)
+            const __m128 vs = _mm_mul_ps(_mm_loadu_ps(lane), _mm_set1_ps(step));
+            for ( ; i + 4 <= count ; i += 4 ) {
+                const __m128 vg = _mm_add_ps(_mm_set1_ps(gain + step * float(i >> frameShift)), vs);
+                _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(_mm_loadu_ps(src + i), vg)));
+            }
+#elif defined(VC_MIX_NEON)
+            const float32x4_t vs = vmulq_n_f32(vld1q_f32(lane), step);
+            for ( ; i + 4 <= count ; i += 4 ) {
+                const float32x4_t vg = vaddq_f32(vdupq_n_f32(gain + step * float(i >> frameShift)), vs);
+                vst1q_f32(dst + i, vmlaq_f32(vld1q_f32(dst + i), vld1q_f32(src + i), vg));
+            }
+#else
+            (void)lane;
+            (void)frameShift;
+#endif
+        }
+        for ( ; i < count ; ++i ) {
+            dst[i] += src[i] * (gain + step * float(i / channelCount));
+        }
+        return gain + step * float(frameCount);
+    }
+    float
+    scaleRamp(float* samples, size_t frameCount, int channelCount, float gain, float step)
+    {
+        const size_t count = frameCount * channelCount;
+        size_t i = 0;
+        
+        // Blocks of four samples as in accumulateRamp.
+        if(channelCount == 1 || channelCount == 2 || channelCount == 4) {
+            const float lanes[3][4] = { { 0.f, 1.f, 2.f, 3.f }, { 0.f, 0.f, 1.f, 1.f }, { 0.f, 0.f, 0.f, 0.f } };
+            const float* lane = lanes[channelCount >> 1];
+            const int frameShift = channelCount >> 1;   // i >> frameShift is the frame of sample i
+#if defined(VC_MIX_X86)
+            const __m128 vs = _mm_mul_ps(_mm_loadu_ps(lane), _mm_set1_ps(step));
+            for ( ; i + 4 <= count ; i += 4 ) {
+                const __m128 vg = _mm_add_ps(_mm_set1_ps(gain + step * float(i >> frameShift)), vs);
+                _mm_storeu_ps(samples + i, _mm_mul_ps(_mm_loadu_ps(samples + i), vg));
+            }
+#elif defined(VC_MIX_NEON)
+            const float32x4_t vs = vmulq_n_f32(vld1q_f32(lane), step);
+            for ( ; i + 4 <= count ; i += 4 ) {
+                const float32x4_t vg = vaddq_f32(vdupq_n_f32(gain + step * float(i >> frameShift)), vs);
+                vst1q_f32(samples + i, vmulq_f32(vld1q_f32(samples + i), vg));
+            }
+#else
+            (void)lane;
+            (void)frameShift;
+#endif
+        }
+        for ( ; i < count ; ++i ) {
+            samples[i] *= gain + step * float(i / channelCount);
+        }
+        return gain + step * float(frameCount);
+    }
+    void
+    addTriangularDither(float* samples, size_t count, uint32_t state[4], float scale)
+    {
+        // Each noise value is the difference of two uniform values of 24 bits from the lane's generator.
+        const float k = scale * (1.f / 16777216.f);
+        size_t i = 0;
+#if defined(VC_MIX_X86)
+        __m128i x = _mm_loadu_si128((const __m128i*)state);
+        const __m128 vk = _mm_set1_ps(k);
+        for ( ; i + 4 <= count ; i += 4 ) {
+            x = _mm_xor_si128(x, _mm_slli_epi32(x, 13)); x = _mm_xor_si128(x, _mm_srli_epi32(x, 17)); x = _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+            const __m128 r1 = _mm_cvtepi32_ps(_mm_srli_epi32(x, 8));
+            x = _mm_xor_si128(x, _mm_slli_epi32(x, 13)); x = _mm_xor_si128(x, _mm_srli_epi32(x, 17)); x = _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+            const __m128 r2 = _mm_cvtepi32_ps(_mm_srli_epi32(x, 8));
+            _mm_storeu_ps(samples + i, _mm_add_ps(_mm_loadu_ps(samples + i), _mm_mul_ps(_mm_sub_ps(r1, r2), vk)));
+        }
+        _mm_storeu_si128((__m128i*)state, x);
+#elif defined(VC_MIX_NEON)
+        uint32x4_t x = vld1q_u32(state);
+        for ( ; i + 4 <= count ; i += 4 ) {
+            x = veorq_u32(x, vshlq_n_u32(x, 13)); x = veorq_u32(x, vshrq_n_u32(x, 17)); x = veorq_u32(x, vshlq_n_u32(x, 5));
+            const float32x4_t r1 = vcvtq_f32_u32(vshrq_n_u32(x, 8));
+            x = veorq_u32(x, vshlq_n_u32(x, 13)); x = veorq_u32(x, vshrq_n_u32(x, 17)); x = veorq_u32(x, vshlq_n_u32(x, 5));
+            const float32x4_t r2 = vcvtq_f32_u32(vshrq_n_u32(x, 8));
+            vst1q_f32(samples + i, vmlaq_n_f32(vld1q_f32(samples + i), vsubq_f32(r1, r2), k));
+        }
+        vst1q_u32(state, x);
+#endif
+        for ( ; i < count ; ++i ) {
+            uint32_t& s = state[i & 3];
+            s ^= s << 13; s ^= s >> 17; s ^= s << 5;
+            const float r1 = float(s >> 8);
+            s ^= s << 13; s ^= s >> 17; s ^= s << 5;
+            const float r2 = float(s >> 8);
+            samples[i] += (r1 - r2) * k;
+        }
+    }
+    float
+    dotProduct(const float* a, const float* b, size_t count)
+    {
+        float sum = 0.f;
+        size_t i = 0;
+#if defined(VC_MIX_X86)
+        __m128 s0 = _mm_setzero_ps();
+        __m128 s1 = _mm_setzero_ps();
+        for ( ; i + 8 <= count ; i += 8 ) {
+            s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(a + i),     _mm_loadu_ps(b + i)));
+            s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+        }
+        s0 = _mm_add_ps(s0, s1);
+        s0 = _mm_add_ps(s0, _mm_shuffle_ps(s0, s0, _MM_SHUFFLE(1, 0, 3, 2)));
+        s0 = _mm_add_ss(s0, _mm_shuffle_ps(s0, s0, _MM_SHUFFLE(2, 3, 0, 1)));
+        sum = _mm_cvtss_f32(s0);
+#elif defined(VC_MIX_NEON)
+        float32x4_t s0 = vdupq_n_f32(0.f);
+        float32x4_t s1 = vdupq_n_f32(0.f);
+        for ( ; i + 8 <= count ; i += 8 ) {
+            s0 = vmlaq_f32(s0, vld1q_f32(a + i),     vld1q_f32(b + i));
+            s1 = vmlaq_f32(s1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+        }
+        s0 = vaddq_f32(s0, s1);
+        float32x2_t s = vadd_f32(vget_low_f32(s0), vget_high_f32(s0));
+        sum = vget_lane_f32(vpadd_f32(s, s), 0);
+#endif
+        for ( ; i < count ; ++i ) {
+            sum += a[i] * b[i];
+        }
+        return sum;
+    }
+    float
+    peakLevel(const float* src, size_t count)
+    {
+        float peak = 0.f;
+        size_t i = 0;
+#if defined(VC_MIX_X86)
+        const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+        __m128 p0 = _mm_setzero_ps();
+        __m128 p1 = _mm_setzero_ps();
+        for ( ; i + 8 <= count ; i += 8 ) {
+            p0 = _mm_max_ps(p0, _mm_and_ps(_mm_loadu_ps(src + i), absMask));
+            p1 = _mm_max_ps(p1, _mm_and_ps(_mm_loadu_ps(src + i + 4), absMask));
+        }
+        p0 = _mm_max_ps(p0, p1);
+        p0 = _mm_max_ps(p0, _mm_shuffle_ps(p0, p0, _MM_SHUFFLE(1, 0, 3, 2)));
+        p0 = _mm_max_ps(p0, _mm_shuffle_ps(p0, p0, _MM_SHUFFLE(2, 3, 0, 1)));
+        peak = _mm_cvtss_f32(p0);
+#elif defined(VC_MIX_NEON)
+        float32x4_t p0 = vdupq_n_f32(0.f);
+        float32x4_t p1 = vdupq_n_f32(0.f);
+        for ( ; i + 8 <= count ; i += 8 ) {
+            p0 = vmaxq_f32(p0, vabsq_f32(vld1q_f32(src + i)));
+            p1 = vmaxq_f32(p1, vabsq_f32(vld1q_f32(src + i + 4)));
+        }
+        p0 = vmaxq_f32(p0, p1);
+        float32x2_t p = vpmax_f32(vget_low_f32(p0), vget_high_f32(p0));
+        p = vpmax_f32(p, p);
+        peak = vget_lane_f32(p, 0);
+#endif
+        for ( ; i < count ; ++i ) {
+            peak = std::max(peak, std::fabs(src[i]));
+        }
+        return peak;
+    }
+    bool
+    isSilent(const void* data, size_t size)
+    {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        size_t i = 0;
+#if defined(VC_MIX_X86)
+        for ( ; i + 64 <= size ; i += 64 ) {
+            const __m128i a = _mm_or_si128(_mm_loadu_si128((const __m128i*)(p + i)), _mm_loadu_si128((const __m128i*)(p + i + 16)));
+            const __m128i b = _mm_or_si128(_mm_loadu_si128((const __m128i*)(p + i + 32)), _mm_loadu_si128((const __m128i*)(p + i + 48)));
+            if(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(a, b), _mm_setzero_si128())) != 0xFFFF) {
+                return false;
+            }
+        }
+#elif defined(VC_MIX_NEON)
+        for ( ; i + 64 <= size ; i += 64 ) {
+            const uint8x16_t a = vorrq_u8(vld1q_u8(p + i), vld1q_u8(p + i + 16));
+            const uint8x16_t b = vorrq_u8(vld1q_u8(p + i + 32), vld1q_u8(p + i + 48));
+            const uint64x2_t o = vreinterpretq_u64_u8(vorrq_u8(a, b));
+            if(vgetq_lane_u64(o, 0) | vgetq_lane_u64(o, 1)) {
+                return false;
+            }
+        }
+#endif
+        for ( ; i < size ; ++i ) {
+            if(p[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+    void
+    remixChannels(float* dst, size_t dstChannels, const float* src, size_t srcChannels, const float* matrix, size_t frames)
+    {
+        size_t f = 0;
+#if defined(VC_MIX_X86) || defined(VC_MIX_NEON)
+        static const size_t kMaxVectorChannels = 16;
+        
+        if(dstChannels <= 8 && srcChannels <= kMaxVectorChannels) {
+            // Each frame is the sum of the matrix columns scaled by its input samples, over up to eight lanes.  The
+            // lanes past dstChannels spill into the next frame, which is written afterwards; the scalar loop does
+            // the frames at the end that would spill past dst.
+            alignas(16) float columns[kMaxVectorChannels][8] = { { 0.f } };
+            for ( size_t i = 0 ; i < srcChannels ; ++i ) {
+                for ( size_t o = 0 ; o < dstChannels ; ++o ) {
+                    columns[i][o] = matrix[o * srcChannels + i];
+                }
+            }
+            const size_t lanes = dstChannels > 4 ? 8 : 4;
+            const size_t total = frames * dstChannels;
+            
+            for ( ; f * dstChannels + lanes <= total ; ++f ) {
+                const float* s = src + f * srcChannels;
+                float* d = dst + f * dstChannels;
+#if defined(VC_MIX_X86)
+                __m128 lo = _mm_setzero_ps();
+                __m128 hi = _mm_setzero_ps();
+                for ( size_t i = 0 ; i < srcChannels ; ++i ) {
+                    const __m128 v = _mm_set1_ps(s[i]);
+                    lo = _mm_add_ps(lo, _mm_mul_ps(v, _mm_load_ps(columns[i])));
+                    hi = _mm_add_ps(hi, _mm_mul_ps(v, _mm_load_ps(columns[i] + 4)));
+                }
+                _mm_storeu_ps(d, lo);
+                if(lanes == 8) {
+                    _mm_storeu_ps(d + 4, hi);
+                }
+#else
+                float32x4_t lo = vdupq_n_f32(0.f);
+                float32x4_t hi = vdupq_n_f32(0.f);
+                for ( size_t i = 0 ; i < srcChannels ; ++i ) {
+                    lo = vmlaq_n_f32(lo, vld1q_f32(columns[i]),     s[i]);
+                    hi = vmlaq_n_f32(hi, vld1q_f32(columns[i] + 4), s[i]);
+                }
+                vst1q_f32(d, lo);
+                if(lanes == 8) {
+                    vst1q_f32(d + 4, hi);
+                }
+#endif
+            }
+        }
+#endif
+        for ( ; f < frames ; ++f ) {
+            const float* s = src + f * srcChannels;
+            float* d = dst + f * dstChannels;
+            for ( size_t o = 0 ; o < dstChannels ; ++o ) {
+                const float* m = matrix + o * srcChannels;
+                float sum = 0.f;
+                for ( size_t i = 0 ; i < srcChannels ; ++i ) {
+                    sum += m[i] * s[i];
+                }
+                d[o] = sum;
+            }
+        }
+    }
+}
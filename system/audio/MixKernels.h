@@ -0,0 +1,85 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+#ifndef __videocore__MixKernels__
+#define __videocore__MixKernels__
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace videocore {
+    
+    /*
+     *  Mix bus kernels.  Samples on the bus are normalised so that full scale int16 is [-1, 1).  These use SSE2
+     *  on x86 and NEON on ARM, which every target of those architectures has.  On x86 the accumulate kernels also
+     *  have AVX2 versions, picked at runtime when the CPU supports them, that give the same results.
+     */
+    
+    /*! dst[i] += src[i] * gain / 32768 */
+    void accumulateSamples(float* dst, const int16_t* src, size_t count, float gain);
+    
+    /*! dst[i] += src[i] * gain */
+    void accumulateSamples(float* dst, const float* src, size_t count, float gain);
+    
+    /*!
+     *  dst[i] += src[i] * (gain + step * f), f being the frame of sample i in interleaved frames of channelCount
+     *  samples: a gain that moves linearly from frame to frame, so that a change of gain does not click.
+     *
+     *  \return the gain of the frame after the last one.
+     */
+    float accumulateRamp(float* dst, const float* src, size_t frameCount, int channelCount, float gain, float step);
+    
+    /*!
+     *  samples[i] *= gain + step * f, with f the frame of sample i as in accumulateRamp.
+     *
+     *  \return the gain of the frame after the last one.
+     */
+    float scaleRamp(float* samples, size_t frameCount, int channelCount, float gain, float step);
+    
+    /*!
+     *  Add triangular (TPDF) dither of +/- scale to samples.  state holds four xorshift32 generators, one per lane
+     *  of four samples, and must not be all zero; the noise is the same with and without SIMD.
+     */
+    void addTriangularDither(float* samples, size_t count, uint32_t state[4], float scale);
+    
+    /*! The sum of a[i] * b[i]. */
+    float dotProduct(const float* a, const float* b, size_t count);
+    
+    /*! The largest |src[i]|. */
+    float peakLevel(const float* src, size_t count);
+    
+    /*!
+     *  True if every byte of data is zero: digital silence in any integer PCM format, and in float apart from
+     *  negative zeros.  Returns at the first block that is not, so sound is rejected after a few bytes.
+     */
+    bool isSilent(const void* data, size_t size);
+    
+    /*!
+     *  Matrix remix of interleaved frames: dst[f * dstChannels + o] is the sum over i of
+     *  matrix[o * srcChannels + i] * src[f * srcChannels + i].  dst and src must not overlap.
+     */
+    void remixChannels(float* dst, size_t dstChannels, const float* src, size_t srcChannels, const float* matrix, size_t frames);
+}
+
+#endif
@@ -0,0 +1,143 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+
+#include <VideoCore/system/audio/OutputLimiter.h>
+#include <VideoCore/system/audio/MixKernels.h>
+#include <VideoCore/system/audio/SampleFormat.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace videocore {
+    
+    static const size_t kBlockFrames = 32;
+    static const float  kKneeRatio = 0.9f;          // knee relative to the ceiling, about -0.9 dB
+    static const float  kTruePeakCheck = 0.7f;      // inter-sample peaks can exceed sample peaks by about 3 dB
+    static const float  kDitherScale = 1.f / 32768.f;
+    
+    OutputLimiter::OutputLimiter(int sampleRate, float ceiling, float releaseTime)
+    : m_releaseTime(releaseTime), m_gain(1.f), m_dither(false)
+    {
+        m_ditherState[0] = 0x9E3779B9;
+        m_ditherState[1] = 0x7F4A7C15;
+        m_ditherState[2] = 0x85EBCA6B;
+        m_ditherState[3] = 0xC2B2AE35;
+        setCeiling(ceiling);
+        setSampleRate(sampleRate);
+    }
+    void
+    OutputLimiter::setSampleRate(int sampleRate)
+    {
+        m_sampleRate = sampleRate;
+        m_release = std::exp(-float(kBlockFrames) / (m_releaseTime * float(std::max(sampleRate, 1))));
+    }
+    void
+    OutputLimiter::setCeiling(float ceiling)
+    {
+        m_ceiling = std::max(0.01f, std::min(1.f, ceiling));
+        m_knee = m_ceiling * kKneeRatio;
+    }
+    void
+    OutputLimiter::reset()
+    {
+        m_gain = 1.f;
+    }
+    void
+    OutputLimiter::process(float* samples, int16_t* out, size_t frameCount, int channelCount)
+    {
+        const size_t count = frameCount * channelCount;
+        const size_t blocks = (frameCount + kBlockFrames - 1) / kBlockFrames;
+        
+        float target = blocks > 0 ? blockTarget(samples, frameCount, channelCount, 0) : 1.f;
+        for ( size_t b = 0 ; b < blocks ; ++b ) {
+            const size_t first = b * kBlockFrames;
+            const size_t frames = std::min(kBlockFrames, frameCount - first);
+            
+            // Measured before this block is scaled: the interpolator reads a frame back into it.
+            const float next = b + 1 < blocks ? blockTarget(samples, frameCount, channelCount, b + 1) : 1.f;
+            
+            if(m_gain < 1.f || target < 1.f || next < 1.f) {
+                // Ending each block at or under the next block's target keeps the ramp under both targets.
+                const float from = m_gain;
+                const float to = std::min(1.f - (1.f - from) * m_release, std::min(target, next));
+                const float step = (to - from) / float(frames);
+                
+                scaleRamp(samples + first * channelCount, frames, channelCount, from + step, step);
+                m_gain = to > 0.9999f ? 1.f : to;
+            }
+            target = next;
+        }
+        
+        if(peakLevel(samples, count) > m_knee) {
+            softClip(samples, count);
+        }
+        if(m_dither) {
+            addTriangularDither(samples, count, m_ditherState, kDitherScale);
+        }
+        convertFromFloat(out, samples, kSampleFormatS16, count);
+    }
+    float
+    OutputLimiter::blockTarget(const float* samples, size_t frameCount, int channelCount, size_t b)
+    {
+        const size_t first = b * kBlockFrames;
+        const size_t frames = std::min(kBlockFrames, frameCount - first);
+        
+        float peak = peakLevel(samples + first * channelCount, frames * channelCount);
+        if(peak > m_knee * kTruePeakCheck) {
+            peak = std::max(peak, truePeak(samples, frameCount, channelCount, first, frames));
+        }
+        return peak > m_knee ? m_knee / peak : 1.f;
+    }
+    float
+    OutputLimiter::truePeak(const float* samples, size_t frameCount, int channelCount, size_t first, size_t frames)
+    {
+        // Half sample points from a four tap cubic interpolator.
+        float peak = 0.f;
+        const size_t last = frameCount - 1;
+        for ( size_t n = first ; n < first + frames ; ++n ) {
+            const float* x0 = samples + (n > 0 ? n - 1 : 0) * channelCount;
+            const float* x1 = samples + n * channelCount;
+            const float* x2 = samples + std::min(n + 1, last) * channelCount;
+            const float* x3 = samples + std::min(n + 2, last) * channelCount;
+            for ( int c = 0 ; c < channelCount ; ++c ) {
+                const float y = (9.f * (x1[c] + x2[c]) - (x0[c] + x3[c])) * (1.f / 16.f);
+                peak = std::max(peak, std::fabs(y));
+            }
+        }
+        return peak;
+    }
+    void
+    OutputLimiter::softClip(float* samples, size_t count)
+    {
+        const float range = m_ceiling - m_knee;
+        for ( size_t i = 0 ; i < count ; ++i ) {
+            const float a = std::fabs(samples[i]);
+            if(a > m_knee) {
+                const float v = m_knee + range * std::tanh((a - m_knee) / range);
+                samples[i] = samples[i] < 0.f ? -v : v;
+            }
+        }
+    }
+}
@@ -0,0 +1,83 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+#ifndef __videocore__OutputLimiter__
+#define __videocore__OutputLimiter__
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace videocore {
+    
+    /*!
+     *  The last stage of a float mix bus: a peak limiter with a soft knee, optional TPDF dither and the conversion to
+     *  int16.
+     *
+     *  Gain is computed per block of frames.  Because a whole mix window is available when it is emitted, each block
+     *  sees the peak of the next one and gain reductions are ramped in before the peak arrives.  Loud blocks also have
+     *  their peaks between samples estimated by 2x interpolation, so the output stays under the ceiling after
+     *  reconstruction.  The gain brings peaks down to a knee just under the ceiling; a soft clipper between the knee
+     *  and the ceiling catches anything the ramp missed, such as a peak at the very start of a window.
+     */
+    class OutputLimiter
+    {
+    public:
+        /*!
+         *  \param sampleRate   Output sampling rate, used for the release time.
+         *  \param ceiling      Highest output level, 0 to 1 of full scale.
+         *  \param releaseTime  Seconds for the gain to recover most of the way after a peak.
+         */
+        OutputLimiter(int sampleRate, float ceiling = 0.944f /* -0.5 dBFS */, float releaseTime = 0.1f);
+        
+        void setSampleRate(int sampleRate);
+        void setCeiling(float ceiling);
+        void setDither(bool dither) { m_dither = dither; };
+        
+        /*! Limit frameCount interleaved frames of samples in place and write them to out as int16. */
+        void process(float* samples, int16_t* out, size_t frameCount, int channelCount);
+        
+        /*! Current gain reduction, 1 when idle. */
+        float gain() const { return m_gain; };
+        
+        void reset();
+        
+    private:
+        /*! The gain that brings block b down to the knee, 1 if it is already under it. */
+        float blockTarget(const float* samples, size_t frameCount, int channelCount, size_t b);
+        float truePeak(const float* samples, size_t frameCount, int channelCount, size_t first, size_t frames);
+        void  softClip(float* samples, size_t count);
+        
+    private:
+        float    m_ceiling;
+        float    m_knee;
+        float    m_releaseTime;
+        float    m_release;         /*!< Per block recovery coefficient */
+        float    m_gain;
+        int      m_sampleRate;
+        uint32_t m_ditherState[4];  /*!< One xorshift32 generator per SIMD lane */
+        bool     m_dither;
+    };
+}
+
+#endif
@@ -0,0 +1,250 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+
+#include <VideoCore/system/audio/Resampler.h>
+#include <VideoCore/system/audio/MixKernels.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace videocore {
+    
+    static const uint32_t kMaxExactPhases = 256;
+    static const uint32_t kInterpolatedPhases = 256;
+    static const double   kMaxAdjust = 0.01;
+    
+    struct ResamplerPreset {
+        int    taps;
+        double rolloff;     // passband edge as a fraction of the lower Nyquist frequency
+        double beta;        // Kaiser window shape
+    };
+    static const ResamplerPreset s_presets[] = {
+        { 16, 0.85, 6.0 },
+        { 32, 0.91, 8.0 },
+        { 64, 0.95, 10.0 }
+    };
+    
+    static uint32_t
+    gcd(uint32_t a, uint32_t b)
+    {
+        while(b) {
+            const uint32_t t = a % b;
+            a = b;
+            b = t;
+        }
+        return a;
+    }
+    static double
+    besselI0(double x)
+    {
+        double sum = 1.;
+        double term = 1.;
+        for ( int k = 1 ; k < 32 ; ++k ) {
+            term *= (x / (2. * k)) * (x / (2. * k));
+            sum += term;
+        }
+        return sum;
+    }
+    
+    Resampler::Resampler(int inFrequencyInHz, int outFrequencyInHz, int channelCount, ResamplerQuality_t quality)
+    : m_adjust(0.), m_fraction(0.), m_historyFrames(0), m_position(0), m_phase(0),
+      m_inRate(std::max(inFrequencyInHz, 1)), m_outRate(std::max(outFrequencyInHz, 1)), m_channelCount(std::max(channelCount, 1)),
+      m_quality(quality)
+    {
+        const uint32_t g = gcd(uint32_t(m_inRate), uint32_t(m_outRate));
+        m_up = uint32_t(m_outRate) / g;
+        m_down = uint32_t(m_inRate) / g;
+        m_taps = s_presets[quality].taps;
+        m_exact = m_up <= kMaxExactPhases;
+        
+        m_history.resize(m_channelCount);
+        buildFilters();
+        reset();
+    }
+    void
+    Resampler::buildFilters()
+    {
+        const ResamplerPreset& preset = s_presets[m_quality];
+        const double cutoff = preset.rolloff * std::min(1., double(m_outRate) / double(m_inRate));
+        const double delay = m_taps / 2 - 1;
+        const double halfLength = m_taps / 2;
+        const double i0Beta = besselI0(preset.beta);
+        
+        m_phases = m_exact ? m_up : kInterpolatedPhases + 1;
+        m_filters.resize(size_t(m_phases) * m_taps);
+        
+        for ( uint32_t p = 0 ; p < m_phases ; ++p ) {
+            const double fraction = m_exact ? double(p) / double(m_up) : double(p) / double(kInterpolatedPhases);
+            float* h = &m_filters[size_t(p) * m_taps];
+            double sum = 0.;
+            for ( int k = 0 ; k < m_taps ; ++k ) {
+                const double t = double(k) - delay - fraction;
+                const double x = M_PI * cutoff * t;
+                const double sinc = std::fabs(x) < 1e-9 ? 1. : std::sin(x) / x;
+                const double w = t / halfLength;
+                const double window = std::fabs(w) >= 1. ? 0. : besselI0(preset.beta * std::sqrt(1. - w * w)) / i0Beta;
+                h[k] = float(cutoff * sinc * window);
+                sum += h[k];
+            }
+            // Unity gain at DC for every phase.
+            for ( int k = 0 ; k < m_taps ; ++k ) {
+                h[k] = float(h[k] / sum);
+            }
+        }
+    }
+    void
+    Resampler::reset()
+    {
+        // Prime with zeros so the first output lines up with the first input frame.
+        const size_t delay = m_taps / 2 - 1;
+        for ( auto & h : m_history ) {
+            h.assign(delay, 0.f);
+        }
+        m_historyFrames = delay;
+        m_position = 0;
+        m_phase = 0;
+        m_fraction = 0.;
+    }
+    void
+    Resampler::setRatioAdjust(double adjust)
+    {
+        adjust = std::max(-kMaxAdjust, std::min(kMaxAdjust, adjust));
+        if(adjust != 0. && m_exact) {
+            m_fraction = double(m_phase) / double(m_up);
+            m_exact = false;
+            buildFilters();
+        }
+        m_adjust = adjust;
+    }
+    size_t
+    Resampler::maxOutputFrames(size_t inFrames) const
+    {
+        const double available = double(m_historyFrames - m_position + inFrames);
+        return size_t(std::ceil(available * m_up / (m_down * (1. - std::fabs(m_adjust))))) + 1;
+    }
+    size_t
+    Resampler::process(const float* in, size_t inFrames, float* out, size_t maxOutFrames)
+    {
+        for ( int c = 0 ; c < m_channelCount ; ++c ) {
+            auto & h = m_history[c];
+            h.resize(m_historyFrames + inFrames);
+            float* p = &h[m_historyFrames];
+            const float* s = in + c;
+            for ( size_t i = 0 ; i < inFrames ; ++i, s += m_channelCount ) {
+                p[i] = *s;
+            }
+        }
+        m_historyFrames += inFrames;
+        
+        const size_t produced = m_exact ? processExact(out, maxOutFrames) : processInterpolated(out, maxOutFrames);
+        
+        // Keep only what the next output still needs.
+        if(m_position) {
+            const size_t keep = m_historyFrames - std::min(m_position, m_historyFrames);
+            for ( auto & h : m_history ) {
+                std::copy(h.begin() + (m_historyFrames - keep), h.begin() + m_historyFrames, h.begin());
+                h.resize(keep);
+            }
+            m_position -= m_historyFrames - keep;
+            m_historyFrames = keep;
+        }
+        return produced;
+    }
+    size_t
+    Resampler::skip(size_t inFrames)
+    {
+        m_historyFrames += inFrames;
+        
+        // Outputs are produced while their window fits in the history, that is while the whole input frames
+        // stepped over stay within room.  Count them and step over all of them at once.
+        size_t n = 0;
+        if(m_position + m_taps <= m_historyFrames) {
+            const uint64_t room = m_historyFrames - m_taps - m_position;
+            if(m_exact) {
+                n = size_t(((room + 1) * m_up - m_phase + m_down - 1) / m_down);
+                const uint64_t phase = m_phase + uint64_t(n) * m_down;
+                m_position += size_t(phase / m_up);
+                m_phase = uint32_t(phase % m_up);
+            } else {
+                const double step = double(m_down) / double(m_up) * (1. + m_adjust);
+                n = size_t(std::ceil((double(room + 1) - m_fraction) / step));
+                const double fraction = m_fraction + double(n) * step;
+                const double whole = std::floor(fraction);
+                m_position += size_t(whole);
+                m_fraction = fraction - whole;
+            }
+        }
+        
+        // What the next output still needs is silence.
+        const size_t keep = m_historyFrames - std::min(m_position, m_historyFrames);
+        for ( auto & h : m_history ) {
+            h.assign(keep, 0.f);
+        }
+        m_position -= m_historyFrames - keep;
+        m_historyFrames = keep;
+        return n;
+    }
+    size_t
+    Resampler::processExact(float* out, size_t maxOutFrames)
+    {
+        size_t n = 0;
+        while(n < maxOutFrames && m_position + m_taps <= m_historyFrames) {
+            const float* h = &m_filters[size_t(m_phase) * m_taps];
+            for ( int c = 0 ; c < m_channelCount ; ++c ) {
+                *out++ = dotProduct(&m_history[c][m_position], h, m_taps);
+            }
+            m_phase += m_down;
+            m_position += m_phase / m_up;
+            m_phase %= m_up;
+            ++n;
+        }
+        return n;
+    }
+    size_t
+    Resampler::processInterpolated(float* out, size_t maxOutFrames)
+    {
+        const double step = double(m_down) / double(m_up) * (1. + m_adjust);
+        size_t n = 0;
+        while(n < maxOutFrames && m_position + m_taps <= m_historyFrames) {
+            const double f = m_fraction * kInterpolatedPhases;
+            const uint32_t row = std::min(uint32_t(f), kInterpolatedPhases - 1);
+            const float a = float(f - row);
+            const float* h0 = &m_filters[size_t(row) * m_taps];
+            const float* h1 = h0 + m_taps;
+            for ( int c = 0 ; c < m_channelCount ; ++c ) {
+                const float* x = &m_history[c][m_position];
+                const float y0 = dotProduct(x, h0, m_taps);
+                const float y1 = dotProduct(x, h1, m_taps);
+                *out++ = y0 + a * (y1 - y0);
+            }
+            m_fraction += step;
+            const double whole = std::floor(m_fraction);
+            m_position += size_t(whole);
+            m_fraction -= whole;
+            ++n;
+        }
+        return n;
+    }
+}
@@ -0,0 +1,121 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+#ifndef __videocore__Resampler__
+#define __videocore__Resampler__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace videocore {
+    
+    typedef enum {
+        kResamplerQualityLow,       /*!< 16 taps, passband to 0.85 of Nyquist */
+        kResamplerQualityMedium,    /*!< 32 taps, passband to 0.91 of Nyquist */
+        kResamplerQualityHigh       /*!< 64 taps, passband to 0.95 of Nyquist */
+    } ResamplerQuality_t;
+    
+    /*!
+     *  Polyphase windowed-sinc sample rate converter for interleaved float audio with any number of channels.
+     *
+     *  The filter history is kept between calls, so a stream can be fed in buffers of any size without
+     *  discontinuities at the buffer edges.  Use one Resampler per stream.
+     *
+     *  When the reduced ratio has at most kMaxExactPhases output phases (44.1 kHz <-> 48 kHz, for example) every
+     *  phase gets its own filter and output positions are tracked exactly with integers.  Otherwise, and whenever a
+     *  fine ratio adjustment is set, the filter for each output position is interpolated between neighbouring
+     *  phases of a finer table.
+     */
+    class Resampler
+    {
+    public:
+        Resampler(int inFrequencyInHz, int outFrequencyInHz, int channelCount,
+                  ResamplerQuality_t quality = kResamplerQualityMedium);
+        
+        int inFrequencyInHz() const { return m_inRate; };
+        int outFrequencyInHz() const { return m_outRate; };
+        int channelCount() const { return m_channelCount; };
+        ResamplerQuality_t quality() const { return m_quality; };
+        
+        /*!
+         *  Multiply the conversion ratio by (1 + adjust), for tracking a source clock that drifts from the nominal
+         *  rate.  Small values only: |adjust| is limited to 1%.
+         */
+        void setRatioAdjust(double adjust);
+        double ratioAdjust() const { return m_adjust; };
+        
+        /*! The most output frames that process() can produce for inFrames input frames. */
+        size_t maxOutputFrames(size_t inFrames) const;
+        
+        /*!
+         *  Convert inFrames interleaved frames.  All input is consumed.
+         *
+         *  \return The number of interleaved frames written to out, at most maxOutFrames.
+         */
+        size_t process(const float* in, size_t inFrames, float* out, size_t maxOutFrames);
+        
+        /*!
+         *  Advance over inFrames frames of silence without filtering them.  The output position moves exactly as
+         *  process() would move it and the filter history is cleared, so a stream that falls silent can stop and
+         *  later resume converting without a shift in timing.
+         *
+         *  \return The number of frames process() would have written.
+         */
+        size_t skip(size_t inFrames);
+        
+        /*! Drop the filter history. */
+        void reset();
+        
+    private:
+        void buildFilters();
+        size_t processExact(float* out, size_t maxOutFrames);
+        size_t processInterpolated(float* out, size_t maxOutFrames);
+        
+    private:
+        std::vector<float> m_filters;   /*!< phases * taps coefficients, phase major */
+        std::vector<std::vector<float>> m_history;  /*!< Unconsumed input, one vector per channel */
+        
+        double   m_adjust;
+        double   m_fraction;            /*!< Interpolated mode: position between input frames, 0 to 1 */
+        
+        size_t   m_historyFrames;       /*!< Valid frames in each channel of m_history */
+        size_t   m_position;            /*!< First input frame of the next output's filter window */
+        
+        uint32_t m_up;                  /*!< Reduced ratio: m_up output frames for every m_down input frames */
+        uint32_t m_down;
+        uint32_t m_phase;               /*!< Exact mode: current phase, 0 to m_up - 1 */
+        uint32_t m_phases;              /*!< Rows in m_filters */
+        
+        int      m_taps;
+        int      m_inRate;
+        int      m_outRate;
+        int      m_channelCount;
+        
+        ResamplerQuality_t m_quality;
+        bool     m_exact;
+    };
+}
+
+#endif
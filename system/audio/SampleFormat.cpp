@@ -0,0 +1,463 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+#include <VideoCore/system/audio/SampleFormat.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#   define VC_PCM_X86 1
+#   include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#   define VC_PCM_NEON 1
+#   include <arm_neon.h>
+#endif
+
+namespace videocore {
+    
+    static const size_t kBlockFrames = 256;     // planar conversions go through the stack in blocks of this many frames
+    
+    static const float kS8Scale  = 128.f;
+    static const float kS16Scale = 32768.f;
+    static const float kS24Scale = 8388608.f;
+    static const float kS32Scale = 2147483648.f;
+    
+    size_t
+    bytesPerSample(SampleFormat_t format)
+    {
+        switch(format) {
+            case kSampleFormatS8:  return 1;
+            case kSampleFormatS16: return 2;
+            case kSampleFormatS24: return 3;
+            default:               return 4;
+        }
+    }
+    
+    SampleFormat_t
+    sampleFormat(int bitsPerChannel, bool isFloat)
+    {
+        if(isFloat) {
+            return kSampleFormatF32;
+        }
+        switch(bitsPerChannel) {
+            case 8:  return kSampleFormatS8;
+            case 24: return kSampleFormatS24;
+            case 32: return kSampleFormatS32;
+            default: return kSampleFormatS16;
+        }
+    }
+    
+    /*  A packed 24 bit sample in the top three bytes of an int32, that is scaled by 2^8. */
+    static inline int32_t
+    load24(const uint8_t* p)
+    {
+        return int32_t(uint32_t(p[0]) << 8 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 24);
+    }
+    static inline void
+    store24(uint8_t* p, int32_t v)
+    {
+        p[0] = uint8_t(v);
+        p[1] = uint8_t(v >> 8);
+        p[2] = uint8_t(v >> 16);
+    }
+    static inline int32_t
+    roundSaturate(float v, float low, float high)
+    {
+        return int32_t(lrintf(std::max(low, std::min(high, v))));
+    }
+    
+#if defined(VC_PCM_X86)
+    
+    static inline void
+    storeS16(float* dst, __m128i v, __m128 scale)
+    {
+        _mm_storeu_ps(dst,     _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16)), scale));
+        _mm_storeu_ps(dst + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16)), scale));
+    }
+    static inline uint32_t
+    load32(const uint8_t* p)
+    {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+    
+#elif defined(VC_PCM_NEON)
+    
+    static inline void
+    storeS16(float* dst, int16x8_t v, float scale)
+    {
+        vst1q_f32(dst,     vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), scale));
+        vst1q_f32(dst + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), scale));
+    }
+    
+#endif
+    
+    static void
+    s8ToFloat(float* dst, const int8_t* src, size_t count)
+    {
+        size_t i = 0;
+#if defined(VC_PCM_X86)
+        const __m128 scale = _mm_set1_ps(1.f / kS8Scale);
+        for ( ; i + 16 <= count ; i += 16 ) {
+            const __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+            storeS16(dst + i,     _mm_srai_epi16(_mm_unpacklo_epi8(v, v), 8), scale);
+            storeS16(dst + i + 8, _mm_srai_epi16(_mm_unpackhi_epi8(v, v), 8), scale);
+        }
+#elif defined(VC_PCM_NEON)
+        for ( ; i + 16 <= count ; i += 16 ) {
+            const int8x16_t v = vld1q_s8(src + i);
+            storeS16(dst + i,     vmovl_s8(vget_low_s8(v)), 1.f / kS8Scale);
+            storeS16(dst + i + 8, vmovl_s8(vget_high_s8(v)), 1.f / kS8Scale);
+        }
+#endif
+        for ( ; i < count ; ++i ) {
+            dst[i] = float(src[i]) * (1.f / kS8Scale);
+        }
+    }
+    static void
+    s16ToFloat(float* dst, const int16_t* src, size_t count)
+    {
+        size_t i = 0;
+#if defined(VC_PCM_X86)
+        const __m128 scale = _mm_set1_ps(1.f / kS16Scale);
+        for ( ; i + 8 <= count ; i += 8 ) {
+            storeS16(dst + i, _mm_loadu_si128((const __m128i*)(src + i)), scale);
+        }
+#elif defined(VC_PCM_NEON)
+        for ( ; i + 8 <= count ; i += 8 ) {
+            storeS16(dst + i, vld1q_s16(src + i), 1.f / kS16Scale);
+        }
+#endif
+        for ( ; i < count ; ++i ) {
+            dst[i] = float(src[i]) * (1.f / kS16Scale);
+        }
+    }
+    static void
+    s24ToFloat(float* dst, const uint8_t* src, size_t count)
+    {
+        size_t i = 0;
+#if defined(VC_PCM_X86)
+        // Four byte loads at each sample leave it in the low three bytes; shifting it to the top scales it by 2^8.
+        // The last load of a group reads the first byte of the next sample, so there has to be one.
+        const __m128 scale = _mm_set1_ps(1.f / kS32Scale);
+        for ( ; i + 4 < count ; i += 4 ) {
+            const uint8_t* p = src + i * 3;
+            const __m128i v = _mm_setr_epi32(int(load32(p)), int(load32(p + 3)), int(load32(p + 6)), int(load32(p + 9)));
+            _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_slli_epi32(v, 8)), scale));
+        }
+#elif defined(VC_PCM_NEON)
+        // Zipping a zero byte under the three bytes of each sample gives it scaled by 2^8.
+        const uint8x8_t zero = vdup_n_u8(0);
+        for ( ; i + 8 <= count ; i += 8 ) {
+            const uint8x8x3_t b = vld3_u8(src + i * 3);
+            const uint8x8x2_t low = vzip_u8(zero, b.val[0]);
+            const uint8x8x2_t high = vzip_u8(b.val[1], b.val[2]);
+            const uint16x4x2_t s0 = vzip_u16(vreinterpret_u16_u8(low.val[0]), vreinterpret_u16_u8(high.val[0]));
+            const uint16x4x2_t s1 = vzip_u16(vreinterpret_u16_u8(low.val[1]), vreinterpret_u16_u8(high.val[1]));
+            const int32x4_t v0 = vreinterpretq_s32_u16(vcombine_u16(s0.val[0], s0.val[1]));
+            const int32x4_t v1 = vreinterpretq_s32_u16(vcombine_u16(s1.val[0], s1.val[1]));
+            vst1q_f32(dst + i,     vmulq_n_f32(vcvtq_f32_s32(v0), 1.f / kS32Scale));
+            vst1q_f32(dst + i + 4, vmulq_n_f32(vcvtq_f32_s32(v1), 1.f / kS32Scale));
+        }
+#endif
+        for ( ; i < count ; ++i ) {
+            dst[i] = float(load24(src + i * 3)) * (1.f / kS32Scale);
+        }
+    }
+    static void
+    s32ToFloat(float* dst, const int32_t* src, size_t count)
+    {
+        size_t i = 0;
+#if defined(VC_PCM_X86)
+        const __m128 scale = _mm_set1_ps(1.f / kS32Scale);
+        for ( ; i + 8 <= count ; i += 8 ) {
+            _mm_storeu_ps(dst + i,     _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(src + i))), scale));
+            _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(src + i + 4))), scale));
+        }
+#elif defined(VC_PCM_NEON)
+        for ( ; i + 8 <= count ; i += 8 ) {
+            vst1q_f32(dst + i,     vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(src + i)), 1.f / kS32Scale));
+            vst1q_f32(dst + i + 4, vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(src + i + 4)), 1.f / kS32Scale));
+        }
+#endif
+        for ( ; i < count ; ++i ) {
+            dst[i] = float(src[i]) * (1.f / kS32Scale);
+        }
+    }
+    
+    /*
+     *  cvtps and vcvtnq round to nearest even, like lrintf in the default rounding mode.  cvtps turns anything out of
+     *  the int32 range into INT32_MIN, which is right for large negative samples, so only the top is clamped before
+     *  converting; 8 and 16 bit samples are then saturated by the packs.
+     */
+    
+    static void
+    floatToS8(int8_t* dst, const float* src, size_t count)
+    {
+        size_t i = 0;
+#if defined(VC_PCM_X86)
+        const __m128 scale = _mm_set1_ps(kS8Scale);
+        const __m128 high = _mm_set1_ps(kS8Scale);
+        for ( ; i + 16 <= count ; i += 16 ) {
+            const __m128i a = _mm_cvtps_epi32(_mm_min_ps(high, _mm_mul_ps(_mm_loadu_ps(src + i), scale)));
+            const __m128i b = _mm_cvtps_epi32(_mm_min_ps(high, _mm_mul_ps(_mm_loadu_ps(src + i + 4), scale)));
+            const __m128i c = _mm_cvtps_epi32(_mm_min_ps(high, _mm_mul_ps(_mm_loadu_ps(src + i + 8), scale)));
+            const __m128i d = _mm_cvtps_epi32(_mm_min_ps(high, _mm_mul_ps(_mm_loadu_ps(src + i + 12), scale)));
+            _mm_storeu_si128((__m128i*)(dst + i), _mm_packs_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+        }
+#elif defined(VC_PCM_NEON) && defined(__aarch64__)
+        for ( ; i + 16 <= count ; i += 16 ) {
+            const int16x8_t lo = vcombine_s16(vqmovn_s32(vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(src + i), kS8Scale))),
+                                              vqmovn_s32(vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(src + i + 4), kS8Scale))));
+            const int16x8_t hi = vcombine_s16(vqmovn_s32(vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(src + i + 8), kS8Scale))),
+                                              vqmovn_s32(vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(src + i + 12), kS8Scale))));
+            vst1q_s8(dst + i, vcombine_s8(vqmovn_s16(lo), vqmovn_s16(hi)));
+        }
+#endif
+        for ( ; i < count ; ++i ) {
+            dst[i] = int8_t(roundSaturate(src[i] * kS8Scale, -kS8Scale, kS8Scale - 1.f));
+        }
+    }
+    static void
+    floatToS16(int16_t* dst, const float* src, size_t count)
+    {
+        size_t i = 0;
+#if defined(VC_PCM_X86)
+        const __m128 scale = _mm_set1_ps(kS16Scale);
+        const __m128 high = _mm_set1_ps(kS16Scale);
+        for ( ; i + 8 <= count ; i += 8 ) {
+            const __m128i lo = _mm_cvtps_epi32(_mm_min_ps(high, _mm_mul_ps(_mm_loadu_ps(src + i), scale)));
+            const __m128i hi = _mm_cvtps_epi32(_mm_min_ps(high, _mm_mul_ps(_mm_loadu_ps(src + i + 4), scale)));
+            _mm_storeu_si128((__m128i*)(dst + i), _mm_packs_epi32(lo, hi));
+        }
+#elif defined(VC_PCM_NEON) && defined(__aarch64__)
+        for ( ; i + 8 <= count ; i += 8 ) {
+            const int32x4_t lo = vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(src + i), kS16Scale));
+            const int32x4_t hi = vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(src + i + 4), kS16Scale));
+            vst1q_s16(dst + i, vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+        }
+#endif
+        for ( ; i < count ; ++i ) {
+            dst[i] = int16_t(roundSaturate(src[i] * kS16Scale, -kS16Scale, kS16Scale - 1.f));
+        }
+    }
+    static void
+    floatToS24(uint8_t* dst, const float* src, size_t count)
+    {
+        size_t i = 0;
+#if defined(VC_PCM_X86)
+        // Each pair of samples is packed into the low six bytes of its half, then the upper half is moved down
+        // against the lower one, leaving the four samples in twelve bytes.
+        const __m128 scale = _mm_set1_ps(kS24Scale);
+        const __m128 low = _mm_set1_ps(-kS24Scale);
+        const __m128 high = _mm_set1_ps(kS24Scale - 1.f);
+        const __m128i even = _mm_set_epi32(0, 0xFFFFFF, 0, 0xFFFFFF);
+        const __m128i odd = _mm_set_epi32(0xFFFFFF, 0, 0xFFFFFF, 0);
+        const __m128i first = _mm_set_epi32(0, 0, 0xFFFF, -1);
+        for ( ; i + 4 <= count ; i += 4 ) {
+            const __m128i v = _mm_cvtps_epi32(_mm_min_ps(high, _mm_max_ps(low, _mm_mul_ps(_mm_loadu_ps(src + i), scale))));
+            const __m128i pairs = _mm_or_si128(_mm_and_si128(v, even), _mm_srli_epi64(_mm_and_si128(v, odd), 8));
+            const __m128i packed = _mm_or_si128(_mm_and_si128(pairs, first), _mm_andnot_si128(first, _mm_srli_si128(pairs, 2)));
+            _mm_storel_epi64((__m128i*)(dst + i * 3), packed);
+            const uint32_t last = uint32_t(_mm_cvtsi128_si32(_mm_srli_si128(packed, 8)));
+            memcpy(dst + i * 3 + 8, &last, sizeof(last));
+        }
+#elif defined(VC_PCM_NEON) && defined(__aarch64__)
+        for ( ; i + 8 <= count ; i += 8 ) {
+            const float32x4_t low = vdupq_n_f32(-kS24Scale);
+            const float32x4_t high = vdupq_n_f32(kS24Scale - 1.f);
+            const uint32x4_t a = vreinterpretq_u32_s32(vcvtnq_s32_f32(vminq_f32(high, vmaxq_f32(low, vmulq_n_f32(vld1q_f32(src + i), kS24Scale)))));
+            const uint32x4_t b = vreinterpretq_u32_s32(vcvtnq_s32_f32(vminq_f32(high, vmaxq_f32(low, vmulq_n_f32(vld1q_f32(src + i + 4), kS24Scale)))));
+            uint8x8x3_t o;
+            o.val[0] = vmovn_u16(vcombine_u16(vmovn_u32(a), vmovn_u32(b)));
+            o.val[1] = vmovn_u16(vcombine_u16(vshrn_n_u32(a, 8), vshrn_n_u32(b, 8)));
+            o.val[2] = vmovn_u16(vcombine_u16(vshrn_n_u32(a, 16), vshrn_n_u32(b, 16)));
+            vst3_u8(dst + i * 3, o);
+        }
+#endif
+        for ( ; i < count ; ++i ) {
+            store24(dst + i * 3, roundSaturate(src[i] * kS24Scale, -kS24Scale, kS24Scale - 1.f));
+        }
+    }
+    static void
+    floatToS32(int32_t* dst, const float* src, size_t count)
+    {
+        size_t i = 0;
+#if defined(VC_PCM_X86)
+        const __m128 scale = _mm_set1_ps(kS32Scale);
+        for ( ; i + 8 <= count ; i += 8 ) {
+            // Out of range lanes convert to INT32_MIN, which is right below -2^31; flipping every bit of the ones at
+            // or above 2^31 makes them INT32_MAX, as fcvtns and the scalar loop give.
+            const __m128 v0 = _mm_mul_ps(_mm_loadu_ps(src + i), scale);
+            const __m128 v1 = _mm_mul_ps(_mm_loadu_ps(src + i + 4), scale);
+            _mm_storeu_si128((__m128i*)(dst + i),     _mm_xor_si128(_mm_cvtps_epi32(v0), _mm_castps_si128(_mm_cmpge_ps(v0, scale))));
+            _mm_storeu_si128((__m128i*)(dst + i + 4), _mm_xor_si128(_mm_cvtps_epi32(v1), _mm_castps_si128(_mm_cmpge_ps(v1, scale))));
+        }
+#elif defined(VC_PCM_NEON) && defined(__aarch64__)
+        for ( ; i + 8 <= count ; i += 8 ) {
+            // fcvtns saturates.
+            vst1q_s32(dst + i,     vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(src + i), kS32Scale)));
+            vst1q_s32(dst + i + 4, vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(src + i + 4), kS32Scale)));
+        }
+#endif
+        for ( ; i < count ; ++i ) {
+            // 2^31 - 1 has no float, so the top of the range is handled apart.
+            const float v = src[i] * kS32Scale;
+            dst[i] = v >= kS32Scale ? INT32_MAX : roundSaturate(v, -kS32Scale, kS32Scale);
+        }
+    }
+    
+    void
+    convertToFloat(float* dst, const void* src, SampleFormat_t format, size_t count)
+    {
+        switch(format) {
+            case kSampleFormatS8:  s8ToFloat(dst, static_cast<const int8_t*>(src), count); break;
+            case kSampleFormatS16: s16ToFloat(dst, static_cast<const int16_t*>(src), count); break;
+            case kSampleFormatS24: s24ToFloat(dst, static_cast<const uint8_t*>(src), count); break;
+            case kSampleFormatS32: s32ToFloat(dst, static_cast<const int32_t*>(src), count); break;
+            case kSampleFormatF32: memmove(dst, src, count * sizeof(float)); break;
+        }
+    }
+    void
+    convertFromFloat(void* dst, const float* src, SampleFormat_t format, size_t count)
+    {
+        switch(format) {
+            case kSampleFormatS8:  floatToS8(static_cast<int8_t*>(dst), src, count); break;
+            case kSampleFormatS16: floatToS16(static_cast<int16_t*>(dst), src, count); break;
+            case kSampleFormatS24: floatToS24(static_cast<uint8_t*>(dst), src, count); break;
+            case kSampleFormatS32: floatToS32(static_cast<int32_t*>(dst), src, count); break;
+            case kSampleFormatF32: memmove(dst, src, count * sizeof(float)); break;
+        }
+    }
+    
+    /*  dst[f * 2] = left[f], dst[f * 2 + 1] = right[f] */
+    static void
+    interleaveStereo(float* dst, const float* left, const float* right, size_t frames)
+    {
+        size_t f = 0;
+#if defined(VC_PCM_X86)
+        for ( ; f + 4 <= frames ; f += 4 ) {
+            const __m128 l = _mm_loadu_ps(left + f);
+            const __m128 r = _mm_loadu_ps(right + f);
+            _mm_storeu_ps(dst + f * 2,     _mm_unpacklo_ps(l, r));
+            _mm_storeu_ps(dst + f * 2 + 4, _mm_unpackhi_ps(l, r));
+        }
+#elif defined(VC_PCM_NEON)
+        for ( ; f + 4 <= frames ; f += 4 ) {
+            float32x4x2_t v;
+            v.val[0] = vld1q_f32(left + f);
+            v.val[1] = vld1q_f32(right + f);
+            vst2q_f32(dst + f * 2, v);
+        }
+#endif
+        for ( ; f < frames ; ++f ) {
+            dst[f * 2] = left[f];
+            dst[f * 2 + 1] = right[f];
+        }
+    }
+    /*  left[f] = src[f * 2], right[f] = src[f * 2 + 1] */
+    static void
+    deinterleaveStereo(float* left, float* right, const float* src, size_t frames)
+    {
+        size_t f = 0;
+#if defined(VC_PCM_X86)
+        for ( ; f + 4 <= frames ; f += 4 ) {
+            const __m128 a = _mm_loadu_ps(src + f * 2);
+            const __m128 b = _mm_loadu_ps(src + f * 2 + 4);
+            _mm_storeu_ps(left + f,  _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+            _mm_storeu_ps(right + f, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+        }
+#elif defined(VC_PCM_NEON)
+        for ( ; f + 4 <= frames ; f += 4 ) {
+            const float32x4x2_t v = vld2q_f32(src + f * 2);
+            vst1q_f32(left + f, v.val[0]);
+            vst1q_f32(right + f, v.val[1]);
+        }
+#endif
+        for ( ; f < frames ; ++f ) {
+            left[f] = src[f * 2];
+            right[f] = src[f * 2 + 1];
+        }
+    }
+    
+    void
+    convertToFloat(float* dst, const void* const* planes, SampleFormat_t format, size_t frameCount, size_t channelCount)
+    {
+        if(channelCount == 1) {
+            convertToFloat(dst, planes[0], format, frameCount);
+            return;
+        }
+        const size_t bytes = bytesPerSample(format);
+        alignas(16) float block[2][kBlockFrames];
+        
+        for ( size_t f = 0 ; f < frameCount ; f += kBlockFrames ) {
+            const size_t frames = std::min(kBlockFrames, frameCount - f);
+            float* out = dst + f * channelCount;
+            
+            if(channelCount == 2) {
+                convertToFloat(block[0], static_cast<const uint8_t*>(planes[0]) + f * bytes, format, frames);
+                convertToFloat(block[1], static_cast<const uint8_t*>(planes[1]) + f * bytes, format, frames);
+                interleaveStereo(out, block[0], block[1], frames);
+                continue;
+            }
+            for ( size_t c = 0 ; c < channelCount ; ++c ) {
+                convertToFloat(block[0], static_cast<const uint8_t*>(planes[c]) + f * bytes, format, frames);
+                for ( size_t i = 0 ; i < frames ; ++i ) {
+                    out[i * channelCount + c] = block[0][i];
+                }
+            }
+        }
+    }
+    void
+    convertFromFloat(void* const* planes, const float* src, SampleFormat_t format, size_t frameCount, size_t channelCount)
+    {
+        if(channelCount == 1) {
+            convertFromFloat(planes[0], src, format, frameCount);
+            return;
+        }
+        const size_t bytes = bytesPerSample(format);
+        alignas(16) float block[2][kBlockFrames];
+        
+        for ( size_t f = 0 ; f < frameCount ; f += kBlockFrames ) {
+            const size_t frames = std::min(kBlockFrames, frameCount - f);
+            const float* in = src + f * channelCount;
+            
+            if(channelCount == 2) {
+                deinterleaveStereo(block[0], block[1], in, frames);
+                convertFromFloat(static_cast<uint8_t*>(planes[0]) + f * bytes, block[0], format, frames);
+                convertFromFloat(static_cast<uint8_t*>(planes[1]) + f * bytes, block[1], format, frames);
+                continue;
+            }
+            for ( size_t c = 0 ; c < channelCount ; ++c ) {
+                for ( size_t i = 0 ; i < frames ; ++i ) {
+                    block[0][i] = in[i * channelCount + c];
+                }
+                convertFromFloat(static_cast<uint8_t*>(planes[c]) + f * bytes, block[0], format, frames);
+            }
+        }
+    }
+}
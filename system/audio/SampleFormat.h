@@ -0,0 +1,67 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+#ifndef __videocore__SampleFormat__
+#define __videocore__SampleFormat__
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace videocore {
+    
+    /*! Signed LPCM sample formats, in native byte order. */
+    typedef enum {
+        kSampleFormatS8,
+        kSampleFormatS16,
+        kSampleFormatS24,       /*!< Packed, three bytes per sample */
+        kSampleFormatS32,
+        kSampleFormatF32
+    } SampleFormat_t;
+    
+    /*! Bytes taken by one sample of format. */
+    size_t bytesPerSample(SampleFormat_t format);
+    
+    /*! The format with bitsPerChannel bits per sample, float or signed integer.  Unknown sizes are taken as 16 bit. */
+    SampleFormat_t sampleFormat(int bitsPerChannel, bool isFloat);
+    
+    /*
+     *  Conversions between the sample formats and float, full scale [-1, 1).  Integer samples are scaled by
+     *  2^(bits - 1) in both directions; on the way back they are rounded to nearest and saturated to their range.
+     *  Float is copied as it is in both directions.  These use SSE2 on x86 and NEON on ARM, like the mix kernels.
+     */
+    
+    /*! count interleaved samples of src to float. */
+    void convertToFloat(float* dst, const void* src, SampleFormat_t format, size_t count);
+    
+    /*! count float samples of src to interleaved samples of format. */
+    void convertFromFloat(void* dst, const float* src, SampleFormat_t format, size_t count);
+    
+    /*! Planar to interleaved: channelCount planes of frameCount samples each to interleaved float frames. */
+    void convertToFloat(float* dst, const void* const* planes, SampleFormat_t format, size_t frameCount, size_t channelCount);
+    
+    /*! Interleaved to planar: frameCount interleaved float frames to channelCount planes of format. */
+    void convertFromFloat(void* const* planes, const float* src, SampleFormat_t format, size_t frameCount, size_t channelCount);
+}
+
+#endif /* defined(__videocore__SampleFormat__) */
@@ -0,0 +1,109 @@
+/*
+ 
+ Video Core
+ Copyright (c) 2014 James G. Hurley
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ 
+ */
+#ifndef videocore_SampleRing_hpp
+#define videocore_SampleRing_hpp
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <string.h>
+
+namespace videocore {
+    
+    /*!
+     *  Wait-free single producer, single consumer ring of float samples.
+     *
+     *  Read and write positions only ever grow; they are reduced modulo the capacity, a power of two, to index the
+     *  storage.  The producer owns the write position and the consumer the read position, so neither side ever
+     *  waits for the other.
+     */
+    class SampleRing
+    {
+    public:
+        SampleRing(size_t capacity) : m_write(0), m_read(0) {
+            size_t size = 2;
+            while(size < capacity) {
+                size <<= 1;
+            }
+            m_mask = size - 1;
+            m_samples.reset(new float[size]());
+        }
+        
+        size_t capacity() const { return m_mask + 1; };
+        
+        /*! Producer: the position the next write starts at. */
+        uint64_t writePosition() const { return m_write.load(std::memory_order_relaxed); };
+        
+        /*! Producer: space available to write.  It can only grow until the next write. */
+        size_t writable() const {
+            return capacity() - size_t(m_write.load(std::memory_order_relaxed) - m_read.load(std::memory_order_acquire));
+        }
+        
+        /*! Producer: append count samples.  Nothing is written if they do not all fit. */
+        bool write(const float* samples, size_t count) {
+            const uint64_t w = m_write.load(std::memory_order_relaxed);
+            const uint64_t r = m_read.load(std::memory_order_acquire);
+            if(count > capacity() - size_t(w - r)) {
+                return false;
+            }
+            const size_t start = size_t(w & m_mask);
+            const size_t first = std::min(count, capacity() - start);
+            memcpy(&m_samples[start], samples, first * sizeof(float));
+            memcpy(&m_samples[0], samples + first, (count - first) * sizeof(float));
+            m_write.store(w + count, std::memory_order_release);
+            return true;
+        }
+        
+        /*! Consumer: the position the next read starts at. */
+        uint64_t readPosition() const { return m_read.load(std::memory_order_relaxed); };
+        
+        /*! Consumer: samples available to read. */
+        size_t readable() const {
+            return size_t(m_write.load(std::memory_order_acquire) - m_read.load(std::memory_order_relaxed));
+        }
+        
+        /*! Consumer: the contiguous samples at the read position, at most count.  \return The number available there. */
+        size_t peek(const float** samples, size_t count) const {
+            const size_t start = size_t(m_read.load(std::memory_order_relaxed) & m_mask);
+            *samples = &m_samples[start];
+            return std::min(count, capacity() - start);
+        }
+        
+        /*! Consumer: release count samples back to the producer. */
+        void consume(size_t count) {
+            m_read.store(m_read.load(std::memory_order_relaxed) + count, std::memory_order_release);
+        }
+        
+    private:
+        std::unique_ptr<float[]> m_samples;
+        size_t m_mask;
+        
+        alignas(64) std::atomic<uint64_t> m_write;
+        alignas(64) std::atomic<uint64_t> m_read;
+    };
+}
+
+#endif
@@ -60,6 +60,10 @@ namespace videocore { namespace Apple {
         void finishWriting();
         void setSessionParameters(IMetadata & parameters);
         void setBandwidthCallback(BandwidthCallback callback);
+        void setBandwidthProbeCallback(BandwidthProbeCallback callback);
+        void setBandwidthResultCallback(ThroughputResultCallback callback);
+        void setBandwidthEstimator(BandwidthEstimator_t estimator);
+        void setBandwidthFastReaction(const FastReactionConfig& config);
         void pushBuffer(const uint8_t* const data, size_t size, IMetadata& metadata);
         void setEpoch(const std::chrono::steady_clock::time_point epoch) { m_epoch = epoch; };
         
@@ -223,6 +223,26 @@ namespace videocore { namespace Apple {
     {
     }
     
+    void
+    MP4Multiplexer::setBandwidthProbeCallback(BandwidthProbeCallback callback)
+    {
+    }
+    
+    void
+    MP4Multiplexer::setBandwidthResultCallback(ThroughputResultCallback callback)
+    {
+    }
+    
+    void
+    MP4Multiplexer::setBandwidthEstimator(BandwidthEstimator_t estimator)
+    {
+    }
+    
+    void
+    MP4Multiplexer::setBandwidthFastReaction(const FastReactionConfig& config)
+    {
+    }
+    
     void
     MP4Multiplexer::pushBuffer(const uint8_t *const data, size_t size, videocore::IMetadata &metadata)
     {
@@ -31,6 +31,7 @@
 #include <string>
 #include <boost/lexical_cast.hpp>
 #include <VideoCore/system/util.h>
+#include <VideoCore/system/MediaTime.hpp>
 
 
 namespace videocore
@@ -49,6 +50,9 @@ namespace videocore
             double timestampDelta;// __attribute__((deprecated));
         };
         double dts;
+        
+        /*! The exact presentation time, when the producer counts samples; pts is then mediaTime in milliseconds. */
+        MediaTime mediaTime;
     };
     
     template <int32_t MetaDataType, typename... Types>
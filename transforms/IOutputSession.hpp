@@ -27,6 +27,7 @@
 #define videocore_IOutputSession_hpp
 
 #include <VideoCore/transforms/IOutput.hpp>
+#include <VideoCore/stream/IThroughputAdaptation.h>
 
 namespace videocore {
 
@@ -39,12 +40,30 @@ namespace videocore {
      */
     using BandwidthCallback = std::function<void(float rateVector, float estimatedAvailableBandwidth, int immediateThroughput)>;
     
+    /*!
+     *  Called once, shortly after publishing starts, with the result of the startup bandwidth probe.
+     *
+     *  \param measuredBandwidth  The goodput measured while the session sent its initial burst of media [Bytes per second].
+     *  \param linkLimited        true if the network was the bottleneck.  false if the measurement is only a lower bound.
+     */
+    using BandwidthProbeCallback = std::function<void(float measuredBandwidth, bool linkLimited)>;
+    
     class IOutputSession : public IOutput
     {
     public:
         
         virtual void setSessionParameters(IMetadata & parameters) = 0 ;
         virtual void setBandwidthCallback(BandwidthCallback callback) = 0;
+        virtual void setBandwidthProbeCallback(BandwidthProbeCallback callback) = 0;
+        
+        /*! Receives the full ThroughputResult for every measurement, including the estimator's confidence and reason. */
+        virtual void setBandwidthResultCallback(ThroughputResultCallback callback) = 0;
+        
+        /*! Select the bandwidth estimation algorithm used by this session. */
+        virtual void setBandwidthEstimator(BandwidthEstimator_t estimator) = 0;
+        
+        /*! Configure the immediate decrease reported when the send queue suddenly backs up. */
+        virtual void setBandwidthFastReaction(const FastReactionConfig& config) = 0;
         
         virtual ~IOutputSession() {};
         
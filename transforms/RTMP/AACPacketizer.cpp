@@ -61,13 +61,21 @@ namespace videocore { namespace rtmp {
         const int flags_size = 2;
 
 
-        if(m_relativeTimestamp == 0)
-            m_relativeTimestamp = metadata.timestampDelta;
-        
-        int ts = metadata.timestampDelta + m_ctsOffset - m_relativeTimestamp;
-        
-        if(m_sampleRate != 48000) {
-            ts = metadata.timestampDelta + m_ctsOffset ;
+        int ts;
+        if(metadata.mediaTime.isValid()) {
+            // Counted in samples upstream: converted to milliseconds here and only here, so every timestamp is the
+            // exact sample time rounded once and the stream neither jitters nor drifts against video.
+            ts = static_cast<int>(metadata.mediaTime.milliseconds()) + m_ctsOffset;
+        } else {
+            // Encoded elsewhere and stamped in milliseconds by the sender.
+            if(m_relativeTimestamp == 0)
+                m_relativeTimestamp = metadata.timestampDelta;
+            
+            ts = metadata.timestampDelta + m_ctsOffset - m_relativeTimestamp;
+            
+            if(m_sampleRate != 48000) {
+                ts = metadata.timestampDelta + m_ctsOffset ;
+            }
         }
         
         //DLog("*#*# AAC: %06d", ts);